@@ -0,0 +1,412 @@
+//
+// loadgen.cpp
+// ~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// An open-loop load generator. Requests are started on a fixed schedule at the
+// target rate, whether or not earlier requests have completed. Each request's
+// latency is measured from the time at which the schedule said it should
+// start, so a stalled server is charged for the requests it delayed, and not
+// just for the ones that happened to be in flight.
+//
+// Parameters are given as name=value pairs:
+//
+//   url=http://host/path   (may be repeated)
+//   urls=file              (one URL per line, optionally preceded by a weight)
+//   rate=100               (requests per second)
+//   seconds=10             (time for which new requests are scheduled)
+//   max_in_flight=1000     (requests beyond this wait, and their wait counts)
+//   threads=1              (threads running the io_service)
+
+#include <urdl/read_stream.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+typedef boost::posix_time::ptime time_type;
+
+time_type now()
+{
+  return boost::posix_time::microsec_clock::universal_time();
+}
+
+// A histogram of values in microseconds, in the style of HdrHistogram. Values
+// below 128 are recorded exactly. Above that, each power of two is divided into
+// 64 linear sub-buckets, so any recorded value is within 1.6% of the true one.
+class histogram
+{
+public:
+  enum { sub_bucket_bits = 7, sub_bucket_count = 1 << sub_bucket_bits };
+  enum { half_count = sub_bucket_count / 2, max_shift = 40 };
+
+  histogram()
+    : counts_(sub_bucket_count + max_shift * half_count),
+      total_(0),
+      sum_(0),
+      max_(0)
+  {
+  }
+
+  void record(boost::uint64_t value)
+  {
+    counts_[index_of(value)]++;
+    ++total_;
+    sum_ += value;
+    if (value > max_)
+      max_ = value;
+  }
+
+  boost::uint64_t total() const
+  {
+    return total_;
+  }
+
+  double mean() const
+  {
+    return total_ ? static_cast<double>(sum_) / total_ : 0;
+  }
+
+  boost::uint64_t max() const
+  {
+    return max_;
+  }
+
+  // Returns the highest value equivalent to the value at the given percentile.
+  boost::uint64_t percentile(double p) const
+  {
+    boost::uint64_t target = static_cast<boost::uint64_t>(
+        p / 100.0 * total_ + 0.5);
+    if (target < 1)
+      target = 1;
+    boost::uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts_.size(); ++i)
+    {
+      seen += counts_[i];
+      if (seen >= target)
+      {
+        boost::uint64_t value = highest_equivalent(i);
+        return value < max_ ? value : max_;
+      }
+    }
+    return max_;
+  }
+
+private:
+  static std::size_t index_of(boost::uint64_t value)
+  {
+    if (value < sub_bucket_count)
+      return static_cast<std::size_t>(value);
+    std::size_t shift = 0;
+    while ((value >> shift) >= sub_bucket_count)
+      ++shift;
+    if (shift > max_shift)
+      return sub_bucket_count + max_shift * half_count - 1;
+    return sub_bucket_count + (shift - 1) * half_count
+      + static_cast<std::size_t>((value >> shift) - half_count);
+  }
+
+  static boost::uint64_t highest_equivalent(std::size_t index)
+  {
+    if (index < sub_bucket_count)
+      return index;
+    std::size_t shift = (index - sub_bucket_count) / half_count + 1;
+    boost::uint64_t sub = (index - sub_bucket_count) % half_count + half_count;
+    return ((sub + 1) << shift) - 1;
+  }
+
+  std::vector<boost::uint64_t> counts_;
+  boost::uint64_t total_;
+  boost::uint64_t sum_;
+  boost::uint64_t max_;
+};
+
+class load_generator
+{
+public:
+  load_generator(boost::asio::io_service& io_service,
+      const std::vector<std::string>& urls, double rate, double seconds,
+      std::size_t max_in_flight)
+    : io_service_(io_service),
+      timer_(io_service),
+      urls_(urls),
+      interval_(boost::posix_time::microseconds(
+            static_cast<long>(1000000.0 / rate))),
+      max_in_flight_(max_in_flight),
+      scheduled_(0),
+      launched_(0),
+      in_flight_(0),
+      errors_(0),
+      bytes_(0)
+  {
+    if (interval_.total_microseconds() <= 0)
+      throw std::runtime_error("Rate too high");
+    start_ = now();
+    end_ = start_ + boost::posix_time::microseconds(
+        static_cast<long>(seconds * 1000000));
+    next_ = start_;
+  }
+
+  void start()
+  {
+    timer_.expires_at(next_);
+    timer_.async_wait(boost::bind(&load_generator::handle_timer, this, _1));
+  }
+
+  void report() const
+  {
+    double elapsed = (finish_ - start_).total_microseconds() / 1000000.0;
+    std::printf("  requests: %llu scheduled, %llu completed, %llu errors\n",
+        static_cast<unsigned long long>(scheduled_),
+        static_cast<unsigned long long>(latencies_.total()),
+        static_cast<unsigned long long>(errors_));
+    std::printf("  achieved: %.1f requests/sec, %.2f MB/sec\n",
+        latencies_.total() / elapsed, bytes_ / elapsed / (1024 * 1024));
+    std::printf("  latency (ms), measured from the scheduled start time:\n");
+    std::printf("    %10s %12.3f\n", "mean", latencies_.mean() / 1000);
+    static const double percentiles[] =
+      { 50, 75, 90, 99, 99.9, 99.99, 99.999 };
+    for (std::size_t i = 0; i < sizeof(percentiles) / sizeof(double); ++i)
+    {
+      std::printf("    %9g%% %12.3f\n", percentiles[i],
+          latencies_.percentile(percentiles[i]) / 1000.0);
+    }
+    std::printf("    %10s %12.3f\n", "max", latencies_.max() / 1000.0);
+  }
+
+private:
+  class request
+    : public boost::enable_shared_from_this<request>
+  {
+  public:
+    request(load_generator& owner, const std::string& url, time_type scheduled)
+      : owner_(owner),
+        read_stream_(owner.io_service_),
+        url_(url),
+        scheduled_(scheduled),
+        bytes_(0)
+    {
+    }
+
+    void start()
+    {
+      read_stream_.async_open(url_,
+          boost::bind(&request::handle_open, shared_from_this(), _1));
+    }
+
+  private:
+    void handle_open(const boost::system::error_code& ec)
+    {
+      if (ec)
+        owner_.complete(scheduled_, ec, bytes_);
+      else
+        read_stream_.async_read_some(boost::asio::buffer(buffer_),
+            boost::bind(&request::handle_read, shared_from_this(), _1, _2));
+    }
+
+    void handle_read(const boost::system::error_code& ec, std::size_t length)
+    {
+      bytes_ += length;
+      if (ec)
+        owner_.complete(scheduled_, ec, bytes_);
+      else
+        read_stream_.async_read_some(boost::asio::buffer(buffer_),
+            boost::bind(&request::handle_read, shared_from_this(), _1, _2));
+    }
+
+    load_generator& owner_;
+    urdl::read_stream read_stream_;
+    std::string url_;
+    time_type scheduled_;
+    unsigned long long bytes_;
+    char buffer_[16384];
+  };
+
+  void handle_timer(const boost::system::error_code& ec)
+  {
+    if (ec)
+      return;
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    // Start every request whose scheduled time has passed. If the timer fired
+    // late, the overdue requests are started together, but each keeps its
+    // own scheduled time.
+    time_type current = now();
+    while (next_ <= current && next_ < end_)
+    {
+      ++scheduled_;
+      if (in_flight_ < max_in_flight_)
+        launch(next_);
+      else
+        waiting_.push_back(next_);
+      next_ += interval_;
+    }
+
+    if (next_ < end_)
+    {
+      timer_.expires_at(next_);
+      timer_.async_wait(boost::bind(&load_generator::handle_timer, this, _1));
+    }
+    else if (in_flight_ == 0 && waiting_.empty())
+    {
+      finish_ = now();
+    }
+  }
+
+  // Must be called with the mutex held.
+  void launch(time_type scheduled)
+  {
+    ++in_flight_;
+    const std::string& url = urls_[launched_++ % urls_.size()];
+    boost::shared_ptr<request> r(new request(*this, url, scheduled));
+    r->start();
+  }
+
+  void complete(time_type scheduled, const boost::system::error_code& ec,
+      unsigned long long bytes)
+  {
+    time_type completed = now();
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    --in_flight_;
+    bytes_ += bytes;
+    if (ec == boost::asio::error::eof)
+      latencies_.record((completed - scheduled).total_microseconds());
+    else
+      ++errors_;
+
+    // A waiting request is charged for the time it spent in the queue.
+    if (!waiting_.empty())
+    {
+      launch(waiting_.front());
+      waiting_.pop_front();
+    }
+
+    if (next_ >= end_ && in_flight_ == 0 && waiting_.empty())
+      finish_ = completed;
+  }
+
+  boost::asio::io_service& io_service_;
+  boost::asio::deadline_timer timer_;
+  std::vector<std::string> urls_;
+  boost::posix_time::time_duration interval_;
+  std::size_t max_in_flight_;
+  boost::mutex mutex_;
+  time_type start_;
+  time_type end_;
+  time_type next_;
+  time_type finish_;
+  std::deque<time_type> waiting_;
+  boost::uint64_t scheduled_;
+  boost::uint64_t launched_;
+  std::size_t in_flight_;
+  boost::uint64_t errors_;
+  unsigned long long bytes_;
+  histogram latencies_;
+};
+
+// Each line of the file is a URL, optionally preceded by an integer weight. A
+// URL with weight N appears N times in the rotation.
+void read_url_file(const std::string& file, std::vector<std::string>& urls)
+{
+  std::ifstream is(file.c_str());
+  if (!is)
+    throw std::runtime_error("Unable to open " + file);
+
+  std::string line;
+  while (std::getline(is, line))
+  {
+    std::istringstream fields(line);
+    std::string first, second;
+    if (!(fields >> first) || first[0] == '#')
+      continue;
+    std::size_t weight = 1;
+    if (fields >> second)
+      weight = std::strtoul(first.c_str(), 0, 10);
+    else
+      second = first;
+    urls.insert(urls.end(), weight, second);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    std::vector<std::string> urls;
+    double rate = 100;
+    double seconds = 10;
+    std::size_t max_in_flight = 1000;
+    std::size_t threads = 1;
+    bool valid = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+      std::string arg = argv[i];
+      std::string::size_type eq = arg.find('=');
+      std::string name = arg.substr(0, eq);
+      std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+      if (name == "url" && !value.empty())
+        urls.push_back(value);
+      else if (name == "urls" && !value.empty())
+        read_url_file(value, urls);
+      else if (name == "rate" && !value.empty())
+        rate = std::atof(value.c_str());
+      else if (name == "seconds" && !value.empty())
+        seconds = std::atof(value.c_str());
+      else if (name == "max_in_flight" && !value.empty())
+        max_in_flight = std::strtoul(value.c_str(), 0, 10);
+      else if (name == "threads" && !value.empty())
+        threads = std::strtoul(value.c_str(), 0, 10);
+      else
+        valid = false;
+    }
+
+    if (!valid || urls.empty() || rate <= 0 || max_in_flight == 0 || threads == 0)
+    {
+      std::cerr << "Usage: loadgen url=<url> [url=<url> ...] [urls=<file>]";
+      std::cerr << " [rate=n] [seconds=n] [max_in_flight=n] [threads=n]\n";
+      return 1;
+    }
+
+    boost::asio::io_service io_service;
+    load_generator generator(io_service, urls, rate, seconds, max_in_flight);
+    generator.start();
+
+    boost::thread_group group;
+    for (std::size_t i = 0; i < threads; ++i)
+      group.create_thread(
+          boost::bind(&boost::asio::io_service::run, &io_service));
+    group.join_all();
+
+    std::printf("%g requests/sec for %g seconds, %lu URLs,"
+        " max %lu in flight, %lu threads\n", rate, seconds,
+        static_cast<unsigned long>(urls.size()),
+        static_cast<unsigned long>(max_in_flight),
+        static_cast<unsigned long>(threads));
+    generator.report();
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,109 @@
+//
+// blocking_io_service.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_DETAIL_BLOCKING_IO_SERVICE_HPP
+#define URDL_DETAIL_BLOCKING_IO_SERVICE_HPP
+
+#include <cstddef>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/asio/detail/thread.hpp>
+#include "urdl/detail/scoped_ptr.hpp"
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+namespace detail {
+
+// A small pool of threads, owned by an io_service, on which blocking file
+// operations are run so that they do not hold up the io_service's own
+// threads. The threads are started when the pool is first used, and are
+// stopped when the io_service is destroyed.
+class blocking_io_service
+  : public boost::asio::detail::service_base<blocking_io_service>
+{
+public:
+  explicit blocking_io_service(boost::asio::io_service& io_service)
+    : boost::asio::detail::service_base<blocking_io_service>(io_service),
+      work_io_service_(new boost::asio::io_service)
+  {
+  }
+
+  ~blocking_io_service()
+  {
+    shutdown_service();
+  }
+
+  void shutdown_service()
+  {
+    work_.reset();
+    if (work_io_service_.get())
+    {
+      work_io_service_->stop();
+      for (std::size_t i = 0; i < thread_count; ++i)
+      {
+        if (threads_[i].get())
+        {
+          threads_[i]->join();
+          threads_[i].reset();
+        }
+      }
+      work_io_service_.reset();
+    }
+  }
+
+  // Runs a function on one of the pool's threads. The function is responsible
+  // for posting its result back to the owning io_service.
+  template <typename Function>
+  void post(Function f)
+  {
+    start_threads();
+    work_io_service_->post(f);
+  }
+
+private:
+  enum { thread_count = 2 };
+
+  struct work_io_service_runner
+  {
+    boost::asio::io_service* io_service_;
+
+    void operator()()
+    {
+      io_service_->run();
+    }
+  };
+
+  void start_threads()
+  {
+    boost::asio::detail::mutex::scoped_lock lock(mutex_);
+    if (!work_.get())
+    {
+      work_.reset(new boost::asio::io_service::work(*work_io_service_));
+      for (std::size_t i = 0; i < thread_count; ++i)
+      {
+        work_io_service_runner runner = { work_io_service_.get() };
+        threads_[i].reset(new boost::asio::detail::thread(runner));
+      }
+    }
+  }
+
+  boost::asio::detail::mutex mutex_;
+  scoped_ptr<boost::asio::io_service> work_io_service_;
+  scoped_ptr<boost::asio::io_service::work> work_;
+  scoped_ptr<boost::asio::detail::thread> threads_[thread_count];
+};
+
+} // namespace detail
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // URDL_DETAIL_BLOCKING_IO_SERVICE_HPP
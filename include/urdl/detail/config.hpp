@@ -55,6 +55,18 @@
 # define URDL_INITFN_RESULT_TYPE(h, sig) void
 #endif // (BOOST_VERSION >= 105400)
 
+// Support move construction and assignment of streams where the compiler
+// supports rvalue references.
+#if !defined(URDL_HAS_MOVE)
+# if !defined(URDL_DISABLE_MOVE)
+#  if !defined(BOOST_NO_CXX11_RVALUE_REFERENCES) \
+    && !defined(BOOST_NO_RVALUE_REFERENCES)
+#   define URDL_HAS_MOVE 1
+#  endif // !defined(BOOST_NO_CXX11_RVALUE_REFERENCES)
+         //   && !defined(BOOST_NO_RVALUE_REFERENCES)
+# endif // !defined(URDL_DISABLE_MOVE)
+#endif // !defined(URDL_HAS_MOVE)
+
 // Enable library autolinking for MSVC.
 
 #if !defined(BOOST_ALL_NO_LIB) && !defined(URDL_NO_LIB) \
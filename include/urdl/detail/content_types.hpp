@@ -0,0 +1,74 @@
+//
+// content_types.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_DETAIL_CONTENT_TYPES_HPP
+#define URDL_DETAIL_CONTENT_TYPES_HPP
+
+#include <cctype>
+#include <cstddef>
+#include <string>
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+namespace detail {
+
+// Guesses a file's content type from its extension. Returns an empty string
+// if the extension is not recognised.
+inline std::string content_type_for_path(const std::string& path)
+{
+  static const struct { const char* extension; const char* type; } types[] =
+  {
+    { "bin", "application/octet-stream" },
+    { "css", "text/css" },
+    { "csv", "text/csv" },
+    { "gif", "image/gif" },
+    { "gz", "application/gzip" },
+    { "htm", "text/html" },
+    { "html", "text/html" },
+    { "ico", "image/x-icon" },
+    { "jpeg", "image/jpeg" },
+    { "jpg", "image/jpeg" },
+    { "js", "application/javascript" },
+    { "json", "application/json" },
+    { "mp3", "audio/mpeg" },
+    { "mp4", "video/mp4" },
+    { "pdf", "application/pdf" },
+    { "png", "image/png" },
+    { "svg", "image/svg+xml" },
+    { "tar", "application/x-tar" },
+    { "txt", "text/plain" },
+    { "wasm", "application/wasm" },
+    { "xml", "application/xml" },
+    { "zip", "application/zip" }
+  };
+
+  std::size_t dot = path.find_last_of("./");
+  if (dot == std::string::npos || path[dot] != '.')
+    return std::string();
+
+  std::string extension = path.substr(dot + 1);
+  for (std::size_t i = 0; i < extension.size(); ++i)
+    extension[i] = static_cast<char>(std::tolower(
+          static_cast<unsigned char>(extension[i])));
+
+  for (std::size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+    if (extension == types[i].extension)
+      return types[i].type;
+
+  return std::string();
+}
+
+} // namespace detail
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // URDL_DETAIL_CONTENT_TYPES_HPP
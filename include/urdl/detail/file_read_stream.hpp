@@ -15,10 +15,33 @@
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/detail/bind_handler.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/shared_ptr.hpp>
 #include <cctype>
-#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "urdl/file.hpp"
+#include "urdl/flight_recorder.hpp"
 #include "urdl/option_set.hpp"
 #include "urdl/url.hpp"
+#include "urdl/detail/blocking_io_service.hpp"
+#include "urdl/detail/content_types.hpp"
+#include "urdl/detail/coroutine.hpp"
+#include "urdl/detail/io_uring_file.hpp"
+#include "urdl/detail/plain_file.hpp"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if !defined(BOOST_WINDOWS)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <unistd.h>
+#endif // !defined(BOOST_WINDOWS)
 
 #include "urdl/detail/abi_prefix.hpp"
 
@@ -31,32 +54,95 @@ public:
   explicit file_read_stream(boost::asio::io_service& io_service,
       option_set& options)
     : io_service_(io_service),
-      options_(options)
+      options_(options),
+#if defined(URDL_HAS_IO_URING)
+      uring_(io_service),
+#endif // defined(URDL_HAS_IO_URING)
+      buffer_start_(0),
+      buffer_end_(0),
+      use_thread_pool_(false),
+      content_length_(~std::size_t(0)),
+      mapped_(false),
+      map_data_(0),
+      map_size_(0),
+      map_pos_(0)
   {
   }
 
+  ~file_read_stream()
+  {
+    abandon_pool_ops();
+    unmap();
+  }
+
   boost::system::error_code open(const url& u, boost::system::error_code& ec)
   {
-    file_.clear();
+    file_.close();
+    buffer_start_ = buffer_end_ = 0;
+    unmap();
+#if defined(URDL_HAS_IO_URING)
+    uring_.close();
+#endif // defined(URDL_HAS_IO_URING)
+    clear_file_info();
+    use_thread_pool_ = options_.get_option<urdl::file::thread_pool>().value();
     std::string path = u.path();
 #if defined(BOOST_WINDOWS)
     if (path.length() >= 3 && path[0] == '/'
         && std::isalpha(path[1]) && path[2] == ':')
       path = path.substr(1);
 #endif // defined(BOOST_WINDOWS)
-    file_.open(path.c_str(), std::ios_base::in | std::ios_base::binary);
-    if (!file_)
+    // Only a regular file can be mapped or read using io_uring. Its type is
+    // checked before either of them opens it, since opening a FIFO waits for
+    // a writer.
+    stat_type st;
+#if defined(BOOST_WINDOWS)
+    bool regular = true;
+#else // defined(BOOST_WINDOWS)
+    bool regular = ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+#endif // defined(BOOST_WINDOWS)
+    if (regular && options_.get_option<urdl::file::memory_map>().value()
+        && map(path, st))
+    {
+      stat_file(path, &st);
+      ec = boost::system::error_code();
+      URDL_FLIGHT_RECORD(this, open_complete, 0, ec);
+      return ec;
+    }
+#if defined(URDL_HAS_IO_URING)
+    if (regular && options_.get_option<urdl::file::io_uring>().value()
+        && uring_.open(path))
+    {
+      stat_file(path, stat_open_file(path, st) ? &st : 0);
+      ec = boost::system::error_code();
+      URDL_FLIGHT_RECORD(this, open_complete, 0, ec);
+      return ec;
+    }
+#endif // defined(URDL_HAS_IO_URING)
+    if (!file_.open(path,
+          options_.get_option<urdl::file::direct_io>().value(),
+          options_.get_option<urdl::file::drop_cache>().value()))
     {
       ec = make_error_code(boost::system::errc::no_such_file_or_directory);
+      URDL_FLIGHT_RECORD(this, open_complete, 0, ec);
       return ec;
     }
+    stat_file(path, stat_open_file(path, st) ? &st : 0);
     ec = boost::system::error_code();
+    URDL_FLIGHT_RECORD(this, open_complete, 0, ec);
     return ec;
   }
 
   template <typename Handler>
   void async_open(const url& u, Handler handler)
   {
+    if (options_.get_option<urdl::file::thread_pool>().value())
+    {
+      open_op<Handler> op = { this, &io_service_, pool_state(), u, handler,
+        boost::asio::io_service::work(io_service_) };
+      boost::asio::use_service<blocking_io_service>(io_service_).post(op);
+      return;
+    }
+
     boost::system::error_code ec;
     open(u, ec);
     io_service_.post(boost::asio::detail::bind_handler(handler, ec));
@@ -64,61 +150,649 @@ public:
 
   boost::system::error_code close(boost::system::error_code& ec)
   {
+    abandon_pool_ops();
     file_.close();
-    file_.clear();
+    buffer_start_ = buffer_end_ = 0;
+    unmap();
+#if defined(URDL_HAS_IO_URING)
+    uring_.close();
+#endif // defined(URDL_HAS_IO_URING)
+    clear_file_info();
     ec = boost::system::error_code();
+    URDL_FLIGHT_RECORD(this, close, 0, ec);
     return ec;
   }
 
   bool is_open() const
   {
-    // Some older versions of libstdc++ have a non-const is_open().
-    return const_cast<std::ifstream&>(file_).is_open();
+    return mapped_ || uring_is_open() || file_.is_open();
+  }
+
+  boost::system::error_code seek(boost::uint64_t offset,
+      boost::system::error_code& ec)
+  {
+    if (!is_open())
+    {
+      ec = boost::asio::error::bad_descriptor;
+      return ec;
+    }
+
+    buffer_start_ = buffer_end_ = 0;
+    if (mapped_)
+      map_pos_ = offset < map_size_ ? static_cast<std::size_t>(offset)
+        : map_size_;
+#if defined(URDL_HAS_IO_URING)
+    else if (uring_.is_open())
+      uring_.seek(offset);
+#endif // defined(URDL_HAS_IO_URING)
+    else if (!file_.seek(offset))
+    {
+      ec = boost::asio::error::operation_not_supported;
+      return ec;
+    }
+
+    ec = boost::system::error_code();
+    return ec;
+  }
+
+  // Whether a read can complete without waiting for the disk.
+  bool data_is_available() const
+  {
+#if defined(URDL_HAS_IO_URING)
+    if (uring_.is_open())
+      return uring_.ready();
+#endif // defined(URDL_HAS_IO_URING)
+    if (use_thread_pool_ && !mapped_)
+      return buffer_start_ != buffer_end_;
+    return is_open();
+  }
+
+  std::string content_type() const
+  {
+    return content_type_;
+  }
+
+  std::size_t content_length() const
+  {
+    return content_length_;
+  }
+
+  std::string headers() const
+  {
+    return headers_;
   }
 
   template <typename MutableBufferSequence>
   std::size_t read_some(const MutableBufferSequence& buffers,
       boost::system::error_code& ec)
   {
-    if (!file_)
+    // A mapped file is copied straight from the mapping.
+    if (mapped_)
     {
-      ec = boost::asio::error::eof;
-      return 0;
+      std::size_t bytes_transferred = copy_buffers(buffers,
+          map_data_ + map_pos_, map_size_ - map_pos_);
+      map_pos_ += bytes_transferred;
+      if (bytes_transferred == 0 && map_pos_ == map_size_)
+        ec = boost::asio::error::eof;
+      else
+        ec = boost::system::error_code();
+      URDL_FLIGHT_RECORD(this, read_complete, bytes_transferred, ec);
+      return bytes_transferred;
     }
 
-    typename MutableBufferSequence::const_iterator iter = buffers.begin();
-    typename MutableBufferSequence::const_iterator end = buffers.end();
-    for (; iter != end; ++iter)
+#if defined(URDL_HAS_IO_URING)
+    // Data read using io_uring is copied out of the head block.
+    if (uring_.is_open())
     {
-      boost::asio::mutable_buffer buffer(*iter);
-      size_t length = boost::asio::buffer_size(buffer);
-      if (length > 0)
+      if (uring_.wait(ec))
+        return 0;
+      boost::asio::const_buffers_1 data = uring_.data();
+      std::size_t bytes_transferred = copy_buffers(buffers,
+          boost::asio::buffer_cast<const char*>(data),
+          boost::asio::buffer_size(data));
+      uring_.consume(bytes_transferred);
+      if (bytes_transferred == 0 && boost::asio::buffer_size(data) == 0)
+        ec = uring_.error();
+      else
+        ec = boost::system::error_code();
+      URDL_FLIGHT_RECORD(this, read_complete, bytes_transferred, ec);
+      return bytes_transferred;
+    }
+#endif // defined(URDL_HAS_IO_URING)
+
+    // If we have any data in the buffer_, return that first.
+    if (buffer_start_ != buffer_end_)
+    {
+      std::size_t bytes_transferred = 0;
+      typename MutableBufferSequence::const_iterator iter = buffers.begin();
+      typename MutableBufferSequence::const_iterator end = buffers.end();
+      for (; iter != end && buffer_start_ != buffer_end_; ++iter)
       {
-        file_.read(boost::asio::buffer_cast<char*>(buffer), length);
-        length = file_.gcount();
-        if (length == 0 && !file_)
-          ec = boost::asio::error::eof;
-        return length;
+        boost::asio::mutable_buffer buffer(*iter);
+        size_t length = boost::asio::buffer_size(buffer);
+        if (length > buffer_end_ - buffer_start_)
+          length = buffer_end_ - buffer_start_;
+        std::memcpy(boost::asio::buffer_cast<char*>(buffer),
+            &buffer_[buffer_start_], length);
+        buffer_start_ += length;
+        bytes_transferred += length;
       }
+      ec = boost::system::error_code();
+      URDL_FLIGHT_RECORD(this, read_complete, bytes_transferred, ec);
+      return bytes_transferred;
     }
 
-    ec = boost::system::error_code();
-    return 0;
+    std::size_t bytes_transferred = file_.read_some(buffers, ec);
+    URDL_FLIGHT_RECORD(this, read_complete, bytes_transferred, ec);
+    return bytes_transferred;
   }
 
   template <typename MutableBufferSequence, typename Handler>
   void async_read_some(const MutableBufferSequence& buffers, Handler handler)
   {
+#if defined(URDL_HAS_IO_URING)
+    if (uring_.is_open())
+    {
+      uring_coro<MutableBufferSequence, Handler>(
+          this, buffers, false, handler)(boost::system::error_code());
+      return;
+    }
+#endif // defined(URDL_HAS_IO_URING)
+
+    if (use_thread_pool_ && !mapped_)
+    {
+      read_op<MutableBufferSequence, Handler> op = { this, &io_service_,
+        pool_state(), buffers, false, handler,
+        boost::asio::io_service::work(io_service_) };
+      boost::asio::use_service<blocking_io_service>(io_service_).post(op);
+      return;
+    }
+
     boost::system::error_code ec;
     std::size_t bytes_transferred = read_some(buffers, ec);
     io_service_.post(boost::asio::detail::bind_handler(
           handler, ec, bytes_transferred));
   }
 
+  boost::asio::const_buffers_1 data() const
+  {
+#if defined(URDL_HAS_IO_URING)
+    if (uring_.is_open())
+      return uring_.data();
+#endif // defined(URDL_HAS_IO_URING)
+    if (mapped_)
+      return boost::asio::const_buffers_1(
+          map_data_ + map_pos_, map_size_ - map_pos_);
+    return boost::asio::const_buffers_1(buffer_.empty() ? 0
+        : &buffer_[buffer_start_], buffer_end_ - buffer_start_);
+  }
+
+  void consume(std::size_t n)
+  {
+#if defined(URDL_HAS_IO_URING)
+    if (uring_.is_open())
+    {
+      uring_.consume(n);
+      return;
+    }
+#endif // defined(URDL_HAS_IO_URING)
+    if (mapped_)
+    {
+      if (n > map_size_ - map_pos_)
+        n = map_size_ - map_pos_;
+      map_pos_ += n;
+      return;
+    }
+    if (n > buffer_end_ - buffer_start_)
+      n = buffer_end_ - buffer_start_;
+    buffer_start_ += n;
+  }
+
+  std::size_t fill(boost::system::error_code& ec)
+  {
+#if defined(URDL_HAS_IO_URING)
+    if (uring_.is_open())
+    {
+      if (uring_.wait(ec))
+        return 0;
+      std::size_t bytes_available = boost::asio::buffer_size(uring_.data());
+      ec = bytes_available ? boost::system::error_code() : uring_.error();
+      return bytes_available;
+    }
+#endif // defined(URDL_HAS_IO_URING)
+
+    // The whole of a mapped file is always available.
+    if (mapped_)
+    {
+      if (map_pos_ == map_size_)
+        ec = boost::asio::error::eof;
+      else
+        ec = boost::system::error_code();
+      return map_size_ - map_pos_;
+    }
+
+    // Nothing to do if there is still data in the buffer_.
+    if (buffer_start_ != buffer_end_)
+    {
+      ec = boost::system::error_code();
+      return buffer_end_ - buffer_start_;
+    }
+
+    // The buffer is only allocated if the stream is used in this way.
+    buffer_.resize(fill_size);
+    buffer_start_ = 0;
+    buffer_end_ = file_.read(&buffer_[0], buffer_.size(), ec);
+    URDL_FLIGHT_RECORD(this, read_complete, buffer_end_, ec);
+    return buffer_end_;
+  }
+
+  template <typename Handler>
+  void async_fill(Handler handler)
+  {
+#if defined(URDL_HAS_IO_URING)
+    if (uring_.is_open())
+    {
+      uring_coro<boost::asio::mutable_buffers_1, Handler>(this,
+          boost::asio::mutable_buffers_1(0, 0), true, handler)(
+            boost::system::error_code());
+      return;
+    }
+#endif // defined(URDL_HAS_IO_URING)
+
+    if (use_thread_pool_ && !mapped_)
+    {
+      read_op<boost::asio::mutable_buffers_1, Handler> op = { this,
+        &io_service_, pool_state(), boost::asio::mutable_buffers_1(0, 0), true,
+        handler, boost::asio::io_service::work(io_service_) };
+      boost::asio::use_service<blocking_io_service>(io_service_).post(op);
+      return;
+    }
+
+    boost::system::error_code ec;
+    std::size_t bytes_transferred = fill(ec);
+    io_service_.post(boost::asio::detail::bind_handler(
+          handler, ec, bytes_transferred));
+  }
+
 private:
+  // The amount of data read from the file by fill() and async_fill().
+  enum { fill_size = 16384 };
+
+  // State shared between the stream and the operations it has posted to the
+  // thread pool. An operation only touches the stream while holding the
+  // mutex, and not at all once the stream has abandoned it.
+  struct pool_state_type
+  {
+    pool_state_type()
+      : abandoned_(false)
+    {
+    }
+
+    boost::asio::detail::mutex mutex_;
+    bool abandoned_;
+  };
+
+  boost::shared_ptr<pool_state_type> pool_state()
+  {
+    if (!pool_state_)
+      pool_state_.reset(new pool_state_type);
+    return pool_state_;
+  }
+
+  // Waits for any operation running on the thread pool to finish, and makes
+  // those that have not yet started complete with operation_aborted.
+  void abandon_pool_ops()
+  {
+    if (pool_state_)
+    {
+      boost::asio::detail::mutex::scoped_lock lock(pool_state_->mutex_);
+      pool_state_->abandoned_ = true;
+    }
+    pool_state_.reset();
+  }
+
+  // Opens the file on a thread pool thread, then posts the result back.
+  template <typename Handler>
+  struct open_op
+  {
+    file_read_stream* this_;
+    boost::asio::io_service* io_service_;
+    boost::shared_ptr<pool_state_type> state_;
+    url url_;
+    Handler handler_;
+    boost::asio::io_service::work work_;
+
+    void operator()()
+    {
+      boost::system::error_code ec;
+      {
+        boost::asio::detail::mutex::scoped_lock lock(state_->mutex_);
+        if (state_->abandoned_)
+          ec = boost::asio::error::operation_aborted;
+        else
+          this_->open(url_, ec);
+      }
+      io_service_->post(boost::asio::detail::bind_handler(handler_, ec));
+    }
+  };
+
+  // Reads from the file on a thread pool thread, then posts the result back.
+  template <typename MutableBufferSequence, typename Handler>
+  struct read_op
+  {
+    file_read_stream* this_;
+    boost::asio::io_service* io_service_;
+    boost::shared_ptr<pool_state_type> state_;
+    MutableBufferSequence buffers_;
+    bool fill_;
+    Handler handler_;
+    boost::asio::io_service::work work_;
+
+    void operator()()
+    {
+      boost::system::error_code ec;
+      std::size_t bytes_transferred = 0;
+      {
+        boost::asio::detail::mutex::scoped_lock lock(state_->mutex_);
+        if (state_->abandoned_)
+          ec = boost::asio::error::operation_aborted;
+        else if (fill_)
+          bytes_transferred = this_->fill(ec);
+        else
+          bytes_transferred = this_->read_some(buffers_, ec);
+      }
+      io_service_->post(boost::asio::detail::bind_handler(
+            handler_, ec, bytes_transferred));
+    }
+  };
+
+  template <typename Handler> friend struct open_op;
+  template <typename MutableBufferSequence, typename Handler>
+  friend struct read_op;
+
+  void clear_file_info()
+  {
+    content_length_ = ~std::size_t(0);
+    content_type_.clear();
+    headers_.clear();
+  }
+
+#if defined(BOOST_WINDOWS)
+  typedef struct _stati64 stat_type;
+#else // defined(BOOST_WINDOWS)
+  typedef struct stat stat_type;
+#endif // defined(BOOST_WINDOWS)
+
+  // Gets the status of the file that has just been opened. Where there is a
+  // descriptor it is used in preference to the path, so that the status is
+  // that of the file being read even if the path has since been replaced.
+  bool stat_open_file(const std::string& path, stat_type& st)
+  {
+#if defined(BOOST_WINDOWS)
+    return ::_stati64(path.c_str(), &st) == 0;
+#else // defined(BOOST_WINDOWS)
+    (void)path;
+# if defined(URDL_HAS_IO_URING)
+    if (uring_.is_open())
+      return ::fstat(uring_.native_handle(), &st) == 0;
+# endif // defined(URDL_HAS_IO_URING)
+    return ::fstat(file_.native_handle(), &st) == 0;
+#endif // defined(BOOST_WINDOWS)
+  }
+
+  // Presents the length and modification time of an open file as the
+  // equivalent HTTP headers. The status may be null if it is not known.
+  void stat_file(const std::string& path, const stat_type* st)
+  {
+    clear_file_info();
+    if (options_.get_option<urdl::file::guess_content_type>().value())
+      content_type_ = content_type_for_path(path);
+
+    std::ostringstream headers;
+    if (st)
+    {
+      // Only a regular file has a meaningful size.
+      if ((st->st_mode & S_IFMT) == S_IFREG)
+      {
+        content_length_ = static_cast<std::size_t>(st->st_size);
+        headers << "Content-Length: " << content_length_ << "\r\n";
+      }
+      headers << "Last-Modified: " << format_http_date(st->st_mtime) << "\r\n";
+    }
+    if (!content_type_.empty())
+      headers << "Content-Type: " << content_type_ << "\r\n";
+    headers << "\r\n";
+    headers_ = headers.str();
+  }
+
+  // Formats a time in the preferred HTTP date format from RFC 2616.
+  static std::string format_http_date(std::time_t t)
+  {
+    static const char* days[] =
+      { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+    static const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+      "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+    std::tm tm;
+#if defined(BOOST_WINDOWS)
+    ::gmtime_s(&tm, &t);
+#else // defined(BOOST_WINDOWS)
+    ::gmtime_r(&t, &tm);
+#endif // defined(BOOST_WINDOWS)
+
+    char buffer[64];
+    std::sprintf(buffer, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+        days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon],
+        tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    return buffer;
+  }
+
+  // Copies as much of the data as will fit into the buffers.
+  template <typename MutableBufferSequence>
+  static std::size_t copy_buffers(const MutableBufferSequence& buffers,
+      const char* data, std::size_t size)
+  {
+    std::size_t bytes_transferred = 0;
+    typename MutableBufferSequence::const_iterator iter = buffers.begin();
+    typename MutableBufferSequence::const_iterator end = buffers.end();
+    for (; iter != end && bytes_transferred != size; ++iter)
+    {
+      boost::asio::mutable_buffer buffer(*iter);
+      size_t length = boost::asio::buffer_size(buffer);
+      if (length > size - bytes_transferred)
+        length = size - bytes_transferred;
+      std::memcpy(boost::asio::buffer_cast<char*>(buffer),
+          data + bytes_transferred, length);
+      bytes_transferred += length;
+    }
+    return bytes_transferred;
+  }
+
+  bool uring_is_open() const
+  {
+#if defined(URDL_HAS_IO_URING)
+    return uring_.is_open();
+#else // defined(URDL_HAS_IO_URING)
+    return false;
+#endif // defined(URDL_HAS_IO_URING)
+  }
+
+#if defined(URDL_HAS_IO_URING)
+  // Waits for the head block to be read using io_uring, then completes the
+  // read_some or fill operation from it.
+  template <typename MutableBufferSequence, typename Handler>
+  class uring_coro : coroutine
+  {
+  public:
+    uring_coro(file_read_stream* this_ptr,
+        const MutableBufferSequence& buffers, bool fill, Handler handler)
+      : this_(this_ptr),
+        buffers_(buffers),
+        fill_(fill),
+        handler_(handler)
+    {
+    }
+
+    void operator()(boost::system::error_code ec,
+        std::size_t /*bytes_transferred*/ = 0)
+    {
+      URDL_CORO_BEGIN;
+
+      // The handler must not be called from within the initiating function.
+      if (this_->uring_.ready())
+      {
+        URDL_CORO_YIELD(this_->io_service_.post(
+              boost::asio::detail::bind_handler(*this, ec)));
+      }
+
+      while (!ec && this_->uring_.is_open() && !this_->uring_.ready())
+      {
+        URDL_CORO_YIELD(this_->uring_.async_wait(*this));
+        if (!ec)
+          this_->uring_.reap();
+      }
+
+      if (!ec && !this_->uring_.is_open())
+        ec = boost::asio::error::operation_aborted;
+
+      if (ec)
+      {
+        handler_(ec, 0);
+        return;
+      }
+
+      {
+        std::size_t bytes_transferred = fill_
+          ? this_->fill(ec) : this_->read_some(buffers_, ec);
+        handler_(ec, bytes_transferred);
+      }
+
+      URDL_CORO_END;
+    }
+
+    friend void* asio_handler_allocate(std::size_t size,
+        uring_coro<MutableBufferSequence, Handler>* this_handler)
+    {
+      using boost::asio::asio_handler_allocate;
+      return asio_handler_allocate(size, &this_handler->handler_);
+    }
+
+    friend void asio_handler_deallocate(void* pointer, std::size_t size,
+        uring_coro<MutableBufferSequence, Handler>* this_handler)
+    {
+      using boost::asio::asio_handler_deallocate;
+      asio_handler_deallocate(pointer, size, &this_handler->handler_);
+    }
+
+    template <typename Function>
+    friend void asio_handler_invoke(Function& function,
+        uring_coro<MutableBufferSequence, Handler>* this_handler)
+    {
+      using boost::asio::asio_handler_invoke;
+      asio_handler_invoke(function, &this_handler->handler_);
+    }
+
+    template <typename Function>
+    friend void asio_handler_invoke(const Function& function,
+        uring_coro<MutableBufferSequence, Handler>* this_handler)
+    {
+      using boost::asio::asio_handler_invoke;
+      asio_handler_invoke(function, &this_handler->handler_);
+    }
+
+  private:
+    file_read_stream* this_;
+    MutableBufferSequence buffers_;
+    bool fill_;
+    Handler handler_;
+  };
+
+  template <typename MutableBufferSequence, typename Handler>
+  friend class uring_coro;
+#endif // defined(URDL_HAS_IO_URING)
+
+  // Maps the whole of the file into memory. Returns false if the file cannot
+  // be mapped, in which case it is read using plain_file instead.
+  // Maps the whole file. The status used to size the mapping is returned in
+  // st, so that the content length agrees with the mapping.
+  bool map(const std::string& path, stat_type& st)
+  {
+#if !defined(BOOST_WINDOWS)
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+      return false;
+
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+      ::close(fd);
+      return false;
+    }
+
+    // An empty file has nothing to map.
+    void* data = 0;
+    if (st.st_size > 0)
+    {
+      data = ::mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED)
+      {
+        ::close(fd);
+        return false;
+      }
+      ::madvise(data, st.st_size, MADV_SEQUENTIAL);
+    }
+
+    // The mapping remains valid after the descriptor is closed.
+    ::close(fd);
+    mapped_ = true;
+    map_data_ = static_cast<const char*>(data);
+    map_size_ = static_cast<std::size_t>(st.st_size);
+    map_pos_ = 0;
+    return true;
+#else // !defined(BOOST_WINDOWS)
+    (void)path;
+    (void)st;
+    return false;
+#endif // !defined(BOOST_WINDOWS)
+  }
+
+  void unmap()
+  {
+#if !defined(BOOST_WINDOWS)
+    if (map_data_)
+      ::munmap(const_cast<char*>(map_data_), map_size_);
+#endif // !defined(BOOST_WINDOWS)
+    mapped_ = false;
+    map_data_ = 0;
+    map_size_ = map_pos_ = 0;
+  }
+
   boost::asio::io_service& io_service_;
   option_set& options_;
-  std::ifstream file_;
+#if defined(URDL_HAS_IO_URING)
+  io_uring_file uring_;
+#endif // defined(URDL_HAS_IO_URING)
+  plain_file file_;
+  std::vector<char> buffer_;
+  std::size_t buffer_start_;
+  std::size_t buffer_end_;
+
+  // Whether asynchronous reads are run on the blocking_io_service.
+  bool use_thread_pool_;
+
+  // Shared with the operations posted to the thread pool. Created when the
+  // first one is posted, and replaced once they are abandoned.
+  boost::shared_ptr<pool_state_type> pool_state_;
+
+  // Information about the file, as it would be described by an HTTP server.
+  std::size_t content_length_;
+  std::string content_type_;
+  std::string headers_;
+
+  // The file's contents when it is read through a memory mapping.
+  bool mapped_;
+  const char* map_data_;
+  std::size_t map_size_;
+  std::size_t map_pos_;
 };
 
 } // namespace detail
@@ -19,9 +19,11 @@
 #include <boost/asio/write.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/detail/bind_handler.hpp>
+#include <boost/shared_ptr.hpp>
 #include <algorithm>
 #include <ostream>
 #include <iterator>
+#include "urdl/flight_recorder.hpp"
 #include "urdl/http.hpp"
 #include "urdl/option_set.hpp"
 #include "urdl/url.hpp"
@@ -29,12 +31,50 @@
 #include "urdl/detail/coroutine.hpp"
 #include "urdl/detail/handshake.hpp"
 #include "urdl/detail/parsers.hpp"
+#include "urdl/detail/read_available.hpp"
+#include "urdl/detail/splice.hpp"
 
 #include "urdl/detail/abi_prefix.hpp"
 
 namespace urdl {
 namespace detail {
 
+// Adds a Range header to the request if only part of the content is wanted.
+inline void write_range_header(std::ostream& os,
+    const urdl::http::byte_range& range)
+{
+  if (range.is_partial())
+  {
+    os << "Range: bytes=" << range.first() << "-";
+    if (range.last() != ~boost::uint64_t(0))
+      os << range.last();
+    os << "\r\n";
+  }
+}
+
+// Determines whether the response status indicates that the content, or the
+// requested part of it, follows. A server may ignore the Range header and send
+// the entire content, which is only what was asked for if the range starts at
+// the beginning. A partial response must start where the range does.
+inline boost::system::error_code check_status(int status_code,
+    const urdl::http::byte_range& range, const std::string& headers)
+{
+  if (status_code == http::errc::ok)
+  {
+    if (range.first() != 0)
+      return http::errc::range_not_supported;
+    return boost::system::error_code();
+  }
+  if (status_code == http::errc::partial_content && range.is_partial())
+  {
+    boost::uint64_t first = 0;
+    if (!parse_content_range_first(headers, first) || first != range.first())
+      return http::errc::range_not_supported;
+    return boost::system::error_code();
+  }
+  return make_error_code(static_cast<http::errc::errc_t>(status_code));
+}
+
 template <typename Stream>
 class http_read_stream
 {
@@ -67,13 +107,17 @@ public:
       return ec;
     }
 
+    URDL_FLIGHT_RECORD(&socket_, open_start, 0, ec);
+
     // Establish a connection to the HTTP server.
     connect(socket_.lowest_layer(), resolver_, u, ec);
+    URDL_FLIGHT_RECORD(&socket_, connected, 0, ec);
     if (ec)
       return ec;
 
     // Perform SSL handshake if required.
     handshake(socket_, u.host(), ec);
+    URDL_FLIGHT_RECORD(&socket_, handshake_complete, 0, ec);
     if (ec)
       return ec;
 
@@ -86,6 +130,8 @@ public:
       = options_.get_option<urdl::http::request_content_type>().value();
     std::string user_agent
       = options_.get_option<urdl::http::user_agent>().value();
+    urdl::http::byte_range range
+      = options_.get_option<urdl::http::byte_range>();
 
     // Form the request. We specify the "Connection: close" header so that the
     // server will close the socket after transmitting the response. This will
@@ -110,12 +156,14 @@ public:
     }
     if (user_agent.length())
       request_stream << "User-Agent: " << user_agent << "\r\n";
+    write_range_header(request_stream, range);
     request_stream << "Connection: close\r\n\r\n";
     request_stream << request_content;
 
     // Send the request.
-    boost::asio::write(socket_, request_buffer_,
-        boost::asio::transfer_all(), ec);
+    std::size_t request_length = boost::asio::write(socket_,
+        request_buffer_, boost::asio::transfer_all(), ec);
+    URDL_FLIGHT_RECORD(&socket_, request_sent, request_length, ec);
     if (ec)
       return ec;
 
@@ -123,7 +171,9 @@ public:
     for (;;)
     {
       // Read the reply status line.
-      boost::asio::read_until(socket_, reply_buffer_, "\r\n", ec);
+      std::size_t status_length = boost::asio::read_until(
+          socket_, reply_buffer_, "\r\n", ec);
+      URDL_FLIGHT_RECORD(&socket_, status_received, status_length, ec);
       if (ec)
         return ec;
 
@@ -149,12 +199,15 @@ public:
     // server.
     std::size_t bytes_transferred = boost::asio::read_until(
         socket_, reply_buffer_, "\r\n\r\n", ec);
+    URDL_FLIGHT_RECORD(&socket_, headers_received, bytes_transferred, ec);
     headers_.resize(bytes_transferred);
     reply_buffer_.sgetn(&headers_[0], bytes_transferred);
     if (ec)
       return ec;
 
-    // Parse the headers to get Content-Type and Content-Length.
+    // Parse the headers to get Content-Type and Content-Length. The length is
+    // unknown unless the server supplies it.
+    content_length_ = ~std::size_t(0);
     if (!parse_http_headers(headers_.begin(), headers_.end(),
           content_type_, content_length_, location_))
     {
@@ -163,9 +216,9 @@ public:
     }
 
     // Check the response code to see if we got the page correctly.
-    if (status_code != http::errc::ok)
-      ec = make_error_code(static_cast<http::errc::errc_t>(status_code));
+    ec = check_status(status_code, range, headers_);
 
+    URDL_FLIGHT_RECORD(&socket_, open_complete, content_length_, ec);
     return ec;
   }
 
@@ -209,9 +262,12 @@ public:
         return;
       }
 
+      URDL_FLIGHT_RECORD(&socket_, open_start, 0, ec);
+
       // Establish a connection to the HTTP server.
       URDL_CORO_YIELD(async_connect(socket_.lowest_layer(),
             resolver_, url_, *this));
+      URDL_FLIGHT_RECORD(&socket_, connected, 0, ec);
       if (ec)
       {
         handler_(ec);
@@ -220,6 +276,7 @@ public:
 
       // Perform SSL handshake if required.
       URDL_CORO_YIELD(async_handshake(socket_, url_.host(), *this));
+      URDL_FLIGHT_RECORD(&socket_, handshake_complete, 0, ec);
       if (ec)
       {
         handler_(ec);
@@ -236,6 +293,8 @@ public:
           = options_.get_option<urdl::http::request_content_type>().value();
         std::string user_agent
           = options_.get_option<urdl::http::user_agent>().value();
+        urdl::http::byte_range range
+          = options_.get_option<urdl::http::byte_range>();
 
         // Form the request. We specify the "Connection: close" header so that
         // the server will close the socket after transmitting the response.
@@ -263,6 +322,7 @@ public:
         }
         if (user_agent.length())
           request_stream << "User-Agent: " << user_agent << "\r\n";
+        write_range_header(request_stream, range);
         request_stream << "Connection: close\r\n\r\n";
         request_stream << request_content;
       }
@@ -270,6 +330,7 @@ public:
       // Send the request.
       URDL_CORO_YIELD(boost::asio::async_write(socket_,
             request_buffer_, boost::asio::transfer_all(), *this));
+      URDL_FLIGHT_RECORD(&socket_, request_sent, bytes_transferred, ec);
       if (ec)
       {
         handler_(ec);
@@ -281,6 +342,7 @@ public:
         // Read the reply status line.
         URDL_CORO_YIELD(boost::asio::async_read_until(socket_,
               reply_buffer_, "\r\n", *this));
+        URDL_FLIGHT_RECORD(&socket_, status_received, bytes_transferred, ec);
         if (ec)
         {
           handler_(ec);
@@ -312,6 +374,7 @@ public:
       // HTTP server.
       URDL_CORO_YIELD(boost::asio::async_read_until(socket_,
             reply_buffer_, "\r\n\r\n", *this));
+      URDL_FLIGHT_RECORD(&socket_, headers_received, bytes_transferred, ec);
       headers_.resize(bytes_transferred);
       reply_buffer_.sgetn(&headers_[0], bytes_transferred);
       if (ec)
@@ -320,7 +383,9 @@ public:
         return;
       }
 
-      // Parse the headers to get Content-Type and Content-Length.
+      // Parse the headers to get Content-Type and Content-Length. The length
+      // is unknown unless the server supplies it.
+      content_length_ = ~std::size_t(0);
       if (!parse_http_headers(headers_.begin(), headers_.end(),
             content_type_, content_length_, location_))
       {
@@ -330,9 +395,10 @@ public:
       }
 
       // Check the response code to see if we got the page correctly.
-      if (status_code_ != http::errc::ok)
-        ec = make_error_code(static_cast<http::errc::errc_t>(status_code_));
+      ec = check_status(status_code_,
+          options_.get_option<urdl::http::byte_range>(), headers_);
 
+      URDL_FLIGHT_RECORD(&socket_, open_complete, content_length_, ec);
       handler_(ec);
 
       URDL_CORO_END;
@@ -394,6 +460,7 @@ public:
   boost::system::error_code close(boost::system::error_code& ec)
   {
     resolver_.cancel();
+    URDL_FLIGHT_RECORD(&socket_, close, 0, boost::system::error_code());
     if (!socket_.lowest_layer().close(ec))
     {
       request_buffer_.consume(request_buffer_.size());
@@ -402,10 +469,17 @@ public:
       content_type_.clear();
       content_length_ = 0;
       location_.clear();
+      read_error_ = boost::system::error_code();
     }
     return ec;
   }
 
+  // Gets the value that identifies the stream's events in the flight recorder.
+  const void* flight_recorder_id() const
+  {
+    return &socket_;
+  }
+
   bool is_open() const
   {
     return socket_.lowest_layer().is_open();
@@ -435,30 +509,98 @@ public:
   std::size_t read_some(const MutableBufferSequence& buffers,
       boost::system::error_code& ec)
   {
-    // If we have any data in the reply_buffer_, return that first.
+    // If we have any data in the reply_buffer_, return that first. Whatever
+    // space remains in the buffers is then filled with any data the socket
+    // already has, so that the caller need not make another call to get it.
     if (reply_buffer_.size() > 0)
     {
       std::size_t bytes_transferred = 0;
+      boost::asio::mutable_buffer remaining[max_read_available_buffers];
+      std::size_t remaining_count = 0;
       typename MutableBufferSequence::const_iterator iter = buffers.begin();
       typename MutableBufferSequence::const_iterator end = buffers.end();
-      for (; iter != end && reply_buffer_.size() > 0; ++iter)
+      for (; iter != end && remaining_count < max_read_available_buffers;
+          ++iter)
       {
         boost::asio::mutable_buffer buffer(*iter);
         size_t length = boost::asio::buffer_size(buffer);
-        if (length > 0)
+        if (length > 0 && reply_buffer_.size() > 0)
         {
-          bytes_transferred += reply_buffer_.sgetn(
+          std::size_t copied = reply_buffer_.sgetn(
               boost::asio::buffer_cast<char*>(buffer), length);
+          bytes_transferred += copied;
+          buffer = buffer + copied;
+          length -= copied;
         }
+        if (length > 0)
+          remaining[remaining_count++] = buffer;
+      }
+      if (remaining_count > 0)
+      {
+        // An error found here is held back until the data has been consumed.
+        boost::system::error_code available_ec;
+        bytes_transferred += read_available(
+            socket_, remaining, remaining_count, available_ec);
+        if (available_ec)
+          read_error_ = available_ec;
       }
       ec = boost::system::error_code();
+      URDL_FLIGHT_RECORD(&socket_, read_complete, bytes_transferred, ec);
       return bytes_transferred;
     }
 
+    // Report any error found while reading the data that was buffered.
+    if (read_error_)
+    {
+      ec = take_read_error();
+      URDL_FLIGHT_RECORD(&socket_, read_complete, 0, ec);
+      return 0;
+    }
+
     // Otherwise we forward the call to the underlying socket.
     std::size_t bytes_transferred = socket_.read_some(buffers, ec);
     if (ec == boost::asio::error::shut_down)
       ec = boost::asio::error::eof;
+    URDL_FLIGHT_RECORD(&socket_, read_complete, bytes_transferred, ec);
+    return bytes_transferred;
+  }
+
+  boost::asio::const_buffers_1 data() const
+  {
+    return boost::asio::const_buffers_1(
+        boost::asio::buffer_cast<const void*>(reply_buffer_.data()),
+        reply_buffer_.size());
+  }
+
+  void consume(std::size_t n)
+  {
+    reply_buffer_.consume(n);
+  }
+
+  std::size_t fill(boost::system::error_code& ec)
+  {
+    // Nothing to do if there is still data in the reply_buffer_.
+    if (reply_buffer_.size() > 0)
+    {
+      ec = boost::system::error_code();
+      return reply_buffer_.size();
+    }
+
+    // Report any error found while reading the data that was buffered.
+    if (read_error_)
+    {
+      ec = take_read_error();
+      URDL_FLIGHT_RECORD(&socket_, read_complete, 0, ec);
+      return 0;
+    }
+
+    // Otherwise read from the socket directly into the reply_buffer_.
+    std::size_t bytes_transferred = socket_.read_some(
+        reply_buffer_.prepare(fill_size), ec);
+    reply_buffer_.commit(bytes_transferred);
+    if (ec == boost::asio::error::shut_down)
+      ec = boost::asio::error::eof;
+    URDL_FLIGHT_RECORD(&socket_, read_complete, bytes_transferred, ec);
     return bytes_transferred;
   }
 
@@ -466,15 +608,21 @@ public:
   class read_handler
   {
   public:
-    read_handler(Handler handler)
-      : handler_(handler)
+    read_handler(Handler handler, const void* stream,
+        boost::asio::streambuf* fill_buffer = 0)
+      : handler_(handler),
+        stream_(stream),
+        fill_buffer_(fill_buffer)
     {
     }
 
     void operator()(boost::system::error_code ec, std::size_t bytes_transferred)
     {
+      if (fill_buffer_)
+        fill_buffer_->commit(bytes_transferred);
       if (ec == boost::asio::error::shut_down)
         ec = boost::asio::error::eof;
+      URDL_FLIGHT_RECORD(stream_, read_complete, bytes_transferred, ec);
       handler_(ec, bytes_transferred);
     }
 
@@ -510,12 +658,15 @@ public:
 
   private:
     Handler handler_;
+    const void* stream_;
+    boost::asio::streambuf* fill_buffer_;
   };
 
   template <typename MutableBufferSequence, typename Handler>
   void async_read_some(const MutableBufferSequence& buffers, Handler handler)
   {
-    // If we have any data in the reply_buffer_, return that first.
+    // If we have any data in the reply_buffer_, return that first, along with
+    // anything that the socket can supply without blocking.
     if (reply_buffer_.size() > 0)
     {
       boost::system::error_code ec;
@@ -525,11 +676,229 @@ public:
       return;
     }
 
+    // Report any error found while reading the data that was buffered.
+    if (read_error_)
+    {
+      boost::system::error_code ec = take_read_error();
+      URDL_FLIGHT_RECORD(&socket_, read_complete, 0, ec);
+      socket_.get_io_service().post(boost::asio::detail::bind_handler(
+            handler, ec, 0));
+      return;
+    }
+
     // Otherwise we forward the call to the underlying socket.
-    socket_.async_read_some(buffers, read_handler<Handler>(handler));
+    socket_.async_read_some(buffers,
+        read_handler<Handler>(handler, &socket_));
+  }
+
+  template <typename Handler>
+  void async_fill(Handler handler)
+  {
+    // Nothing to do if there is still data in the reply_buffer_.
+    if (reply_buffer_.size() > 0)
+    {
+      boost::system::error_code ec;
+      socket_.get_io_service().post(boost::asio::detail::bind_handler(
+            handler, ec, reply_buffer_.size()));
+      return;
+    }
+
+    // Report any error found while reading the data that was buffered.
+    if (read_error_)
+    {
+      boost::system::error_code ec = take_read_error();
+      URDL_FLIGHT_RECORD(&socket_, read_complete, 0, ec);
+      socket_.get_io_service().post(boost::asio::detail::bind_handler(
+            handler, ec, 0));
+      return;
+    }
+
+    // Otherwise read from the socket directly into the reply_buffer_.
+    socket_.async_read_some(reply_buffer_.prepare(fill_size),
+        read_handler<Handler>(handler, &socket_, &reply_buffer_));
+  }
+
+#if defined(URDL_HAS_SPLICE)
+  std::size_t splice_to_file(splice_file& file, boost::system::error_code& ec)
+  {
+    // Write out any data in the reply_buffer_ first.
+    std::size_t total = file.write(
+        boost::asio::buffer_cast<const char*>(reply_buffer_.data()),
+        reply_buffer_.size(), ec);
+    reply_buffer_.consume(total);
+    if (!ec)
+      ec = take_read_error();
+
+    // Then move the rest of the content from the socket to the file.
+    while (!ec)
+    {
+      total += file.splice_some(
+          socket_.lowest_layer().native_handle(), ec);
+      if (ec == boost::asio::error::would_block)
+        socket_.read_some(boost::asio::null_buffers(), ec);
+    }
+
+    if (ec == boost::asio::error::eof)
+      ec = boost::system::error_code();
+    URDL_FLIGHT_RECORD(&socket_, read_complete, total, ec);
+    return total;
+  }
+
+  template <typename Handler>
+  class splice_coro : coroutine
+  {
+  public:
+    splice_coro(Handler handler, Stream& socket,
+        boost::asio::streambuf& reply_buffer,
+        const boost::shared_ptr<splice_file>& file,
+        const boost::system::error_code& read_error)
+      : handler_(handler),
+        socket_(socket),
+        reply_buffer_(reply_buffer),
+        file_(file),
+        read_error_(read_error),
+        total_(0)
+    {
+    }
+
+    void operator()(boost::system::error_code ec,
+        std::size_t bytes_transferred = 0)
+    {
+      URDL_CORO_BEGIN;
+
+      // Write out any data in the reply_buffer_ first.
+      total_ = file_->write(
+          boost::asio::buffer_cast<const char*>(reply_buffer_.data()),
+          reply_buffer_.size(), ec);
+      reply_buffer_.consume(total_);
+      if (!ec && read_error_ != boost::asio::error::eof)
+        ec = read_error_;
+      if (ec)
+      {
+        URDL_CORO_YIELD(socket_.get_io_service().post(
+              boost::asio::detail::bind_handler(*this, ec)));
+        handler_(ec, total_);
+        return;
+      }
+
+      // Then move the rest of the content from the socket to the file,
+      // waiting for the socket to become readable whenever it runs dry. The
+      // descriptor must be non-blocking so that splice() cannot block, but
+      // synchronous operations on the socket continue to behave as before.
+      // If it cannot be made non-blocking, the content is copied through the
+      // reply_buffer_ instead.
+      socket_.lowest_layer().native_non_blocking(true, ec);
+      if (ec)
+      {
+        for (;;)
+        {
+          URDL_CORO_YIELD(socket_.async_read_some(
+                reply_buffer_.prepare(fill_size), *this));
+          reply_buffer_.commit(bytes_transferred);
+          if (ec == boost::asio::error::shut_down)
+            ec = boost::asio::error::eof;
+          if (ec)
+            break;
+          bytes_transferred = file_->write(
+              boost::asio::buffer_cast<const char*>(reply_buffer_.data()),
+              reply_buffer_.size(), ec);
+          reply_buffer_.consume(bytes_transferred);
+          total_ += bytes_transferred;
+          if (ec)
+            break;
+        }
+      }
+      else
+      {
+        for (;;)
+        {
+          // Splice no more than max_splice_size bytes for each wait, so that
+          // a fast sender cannot stop other handlers from running.
+          URDL_CORO_YIELD(socket_.async_read_some(
+                boost::asio::null_buffers(), *this));
+          for (bytes_transferred = 0;
+              !ec && bytes_transferred < max_splice_size;)
+          {
+            std::size_t n = file_->splice_some(
+                socket_.lowest_layer().native_handle(), ec);
+            bytes_transferred += n;
+            total_ += n;
+          }
+          if (ec && ec != boost::asio::error::would_block)
+            break;
+        }
+      }
+
+      if (ec == boost::asio::error::eof)
+        ec = boost::system::error_code();
+      URDL_FLIGHT_RECORD(&socket_, read_complete, total_, ec);
+      handler_(ec, total_);
+
+      URDL_CORO_END;
+    }
+
+    friend void* asio_handler_allocate(std::size_t size,
+        splice_coro<Handler>* this_handler)
+    {
+      using boost::asio::asio_handler_allocate;
+      return asio_handler_allocate(size, &this_handler->handler_);
+    }
+
+    friend void asio_handler_deallocate(void* pointer, std::size_t size,
+        splice_coro<Handler>* this_handler)
+    {
+      using boost::asio::asio_handler_deallocate;
+      asio_handler_deallocate(pointer, size, &this_handler->handler_);
+    }
+
+    template <typename Function>
+    friend void asio_handler_invoke(Function& function,
+        splice_coro<Handler>* this_handler)
+    {
+      using boost::asio::asio_handler_invoke;
+      asio_handler_invoke(function, &this_handler->handler_);
+    }
+
+    template <typename Function>
+    friend void asio_handler_invoke(const Function& function,
+        splice_coro<Handler>* this_handler)
+    {
+      using boost::asio::asio_handler_invoke;
+      asio_handler_invoke(function, &this_handler->handler_);
+    }
+
+  private:
+    enum { max_splice_size = 1024 * 1024 };
+
+    Handler handler_;
+    Stream& socket_;
+    boost::asio::streambuf& reply_buffer_;
+    boost::shared_ptr<splice_file> file_;
+    boost::system::error_code read_error_;
+    std::size_t total_;
+  };
+
+  template <typename Handler>
+  void async_splice_to_file(const boost::shared_ptr<splice_file>& file,
+      Handler handler)
+  {
+    splice_coro<Handler>(handler, socket_, reply_buffer_, file,
+        take_read_error())(boost::system::error_code());
   }
+#endif // defined(URDL_HAS_SPLICE)
 
 private:
+  // Returns, and clears, the error found by read_available().
+  boost::system::error_code take_read_error()
+  {
+    boost::system::error_code ec = read_error_;
+    read_error_ = boost::system::error_code();
+    return ec;
+  }
+
+  // The amount of data read from the socket by fill() and async_fill().
+  enum { fill_size = 16384 };
+
   boost::asio::ip::tcp::resolver resolver_;
   Stream socket_;
   option_set& options_;
@@ -539,6 +908,10 @@ private:
   std::string content_type_;
   std::size_t content_length_;
   std::string location_;
+
+  // An error found by read_available() after it had returned data. It is
+  // reported by the next read.
+  boost::system::error_code read_error_;
 };
 
 } // namespace detail
@@ -0,0 +1,478 @@
+//
+// io_uring_file.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_DETAIL_IO_URING_FILE_HPP
+#define URDL_DETAIL_IO_URING_FILE_HPP
+
+#if defined(__linux__) && !defined(URDL_DISABLE_IO_URING)
+# if defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#   define URDL_HAS_IO_URING 1
+#  endif // __has_include(<linux/io_uring.h>)
+# endif // defined(__has_include)
+#endif // defined(__linux__) && !defined(URDL_DISABLE_IO_URING)
+
+#if defined(URDL_HAS_IO_URING)
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+namespace detail {
+
+// Reads a file sequentially using io_uring. Several blocks are kept in flight
+// ahead of the reader, and completions are signalled through an eventfd that
+// can be waited on by the io_service. Data is returned in file order, one
+// block at a time.
+class io_uring_file
+  : private boost::noncopyable
+{
+public:
+  explicit io_uring_file(boost::asio::io_service& io_service)
+    : descriptor_(io_service),
+      ring_(-1),
+      file_(-1),
+      sq_ring_(0),
+      sq_ring_size_(0),
+      cq_ring_(0),
+      cq_ring_size_(0),
+      sqes_(0),
+      sqes_size_(0),
+      buffers_(0),
+      fixed_buffers_(false),
+      head_(0),
+      next_offset_(0),
+      pending_(0),
+      unsubmitted_(0)
+  {
+  }
+
+  ~io_uring_file()
+  {
+    close();
+  }
+
+  // Opens the file and starts reading it. Returns false if io_uring cannot be
+  // used, in which case the caller should read the file some other way.
+  bool open(const std::string& path)
+  {
+    close();
+
+    file_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file_ == -1 || !setup_ring())
+    {
+      close();
+      return false;
+    }
+
+    start(0);
+    return true;
+  }
+
+  // Abandons the reads in progress and starts reading again from the given
+  // offset. Must not be called while an asynchronous wait is outstanding.
+  void seek(boost::uint64_t offset)
+  {
+    drain();
+    start(offset);
+  }
+
+  void close()
+  {
+    drain();
+
+    boost::system::error_code ignored_ec;
+    descriptor_.close(ignored_ec);
+    if (sqes_)
+      ::munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_)
+      ::munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_)
+      ::munmap(sq_ring_, sq_ring_size_);
+    if (ring_ != -1)
+      ::close(ring_);
+    if (file_ != -1)
+      ::close(file_);
+    std::free(buffers_);
+
+    ring_ = file_ = -1;
+    sq_ring_ = cq_ring_ = 0;
+    sqes_ = 0;
+    buffers_ = 0;
+    pending_ = 0;
+    unsubmitted_ = 0;
+  }
+
+  bool is_open() const
+  {
+    return ring_ != -1;
+  }
+
+  // Gets the descriptor of the file being read.
+  int native_handle() const
+  {
+    return file_;
+  }
+
+  // Whether the block at the head of the file has completed.
+  bool ready() const
+  {
+    return is_open() && blocks_[head_].state == block::complete;
+  }
+
+  // The data in the head block. Empty unless ready().
+  boost::asio::const_buffers_1 data() const
+  {
+    if (!ready())
+      return boost::asio::const_buffers_1(0, 0);
+    const block& b = blocks_[head_];
+    return boost::asio::const_buffers_1(
+        buffer(head_) + b.begin, b.end - b.begin);
+  }
+
+  // The reason there is no data in a ready head block.
+  boost::system::error_code error() const
+  {
+    return blocks_[head_].error;
+  }
+
+  void consume(std::size_t n)
+  {
+    if (!ready())
+      return;
+    block& b = blocks_[head_];
+    b.begin += (n < b.end - b.begin) ? n : b.end - b.begin;
+    advance();
+  }
+
+  // Blocks until the head block has completed.
+  boost::system::error_code wait(boost::system::error_code& ec)
+  {
+    while (is_open() && !ready())
+    {
+      if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        return ec = last_error();
+      reap();
+    }
+    return ec = boost::system::error_code();
+  }
+
+  // Waits for completions to be signalled. The handler must call reap().
+  template <typename Handler>
+  void async_wait(Handler handler)
+  {
+    descriptor_.async_read_some(boost::asio::null_buffers(), handler);
+  }
+
+  // Collects any completed reads.
+  void reap()
+  {
+    boost::uint64_t count;
+    if (::read(descriptor_.native_handle(), &count, sizeof(count)) < 0)
+    {
+      // Nothing to do. The eventfd is only a wakeup signal.
+    }
+
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+      const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+      block& b = blocks_[cqe.user_data];
+      b.state = block::complete;
+      if (cqe.res > 0)
+        b.end += cqe.res;
+      else if (cqe.res == 0)
+        b.error = boost::asio::error::eof;
+      else
+        b.error = boost::system::error_code(-cqe.res,
+            boost::system::system_category());
+      --pending_;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+    advance();
+  }
+
+private:
+  enum { block_count = 4, block_size = 65536 };
+
+  struct block
+  {
+    enum { idle, in_flight, complete } state;
+    boost::uint64_t offset;
+    std::size_t begin;
+    std::size_t end;
+    boost::system::error_code error;
+
+    block()
+      : state(idle),
+        offset(0),
+        begin(0),
+        end(0)
+    {
+    }
+  };
+
+  char* buffer(std::size_t i) const
+  {
+    return buffers_ + i * block_size;
+  }
+
+  bool setup_ring()
+  {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_ = static_cast<int>(::syscall(__NR_io_uring_setup,
+          static_cast<unsigned>(block_count), &params));
+    if (ring_ == -1)
+      return false;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes
+      + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (cq_ring_size_ > sq_ring_size_)
+        sq_ring_size_ = cq_ring_size_;
+      cq_ring_size_ = sq_ring_size_;
+    }
+
+    sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+    if (!sq_ring_)
+      return false;
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+      cq_ring_ = sq_ring_;
+    else if (!(cq_ring_ = map(cq_ring_size_, IORING_OFF_CQ_RING)))
+      return false;
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = map(sqes_size_, IORING_OFF_SQES);
+    if (!sqes)
+      return false;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sq_tail_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned*>(cq_ring_ + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq_ring_ + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq_ring_ + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ring_ + params.cq_off.cqes);
+
+    void* buffers = 0;
+    if (::posix_memalign(&buffers, 4096, block_count * block_size) != 0)
+      return false;
+    buffers_ = static_cast<char*>(buffers);
+
+    // Registering the buffers saves the kernel from mapping them for every
+    // read. It can fail if the locked memory limit is low, in which case the
+    // buffers are passed with each read instead.
+    iovec iov[block_count];
+    for (std::size_t i = 0; i < block_count; ++i)
+    {
+      iov[i].iov_base = buffer(i);
+      iov[i].iov_len = block_size;
+    }
+    fixed_buffers_ = ::syscall(__NR_io_uring_register, ring_,
+        IORING_REGISTER_BUFFERS, iov, static_cast<unsigned>(block_count)) == 0;
+
+    // Reads into unregistered buffers need IORING_OP_READ, which kernels
+    // older than 5.6 reject. Such kernels cannot be probed either.
+    if (!fixed_buffers_ && !supports(IORING_OP_READ))
+      return false;
+
+    int event = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event == -1)
+      return false;
+    boost::system::error_code ec;
+    descriptor_.assign(event, ec);
+    if (ec)
+    {
+      ::close(event);
+      return false;
+    }
+    return ::syscall(__NR_io_uring_register, ring_,
+        IORING_REGISTER_EVENTFD, &event, 1) == 0;
+  }
+
+  // Asks the kernel whether the ring supports the given operation.
+  bool supports(unsigned op)
+  {
+    enum { max_ops = 256 };
+    std::size_t size = sizeof(io_uring_probe)
+      + max_ops * sizeof(io_uring_probe_op);
+    void* storage = std::calloc(1, size);
+    if (!storage)
+      return false;
+    io_uring_probe* probe = static_cast<io_uring_probe*>(storage);
+    bool supported = ::syscall(__NR_io_uring_register, ring_,
+        IORING_REGISTER_PROBE, probe, static_cast<unsigned>(max_ops)) == 0
+      && op <= probe->last_op
+      && (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+    std::free(storage);
+    return supported;
+  }
+
+  char* map(std::size_t size, boost::uint64_t offset)
+  {
+    void* p = ::mmap(0, size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_, offset);
+    return p == MAP_FAILED ? 0 : static_cast<char*>(p);
+  }
+
+  int enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+  {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ring_,
+          to_submit, min_complete, flags, 0, 0));
+  }
+
+  // Queues a read of the rest of block i. The read is not started until
+  // flush() is called.
+  void submit(std::size_t i)
+  {
+    block& b = blocks_[i];
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & *sq_mask_;
+    io_uring_sqe& sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = fixed_buffers_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe.fd = file_;
+    sqe.off = b.offset + b.end;
+    sqe.addr = reinterpret_cast<boost::uint64_t>(buffer(i) + b.end);
+    sqe.len = static_cast<unsigned>(block_size - b.end);
+    sqe.buf_index = fixed_buffers_ ? static_cast<boost::uint16_t>(i) : 0;
+    sqe.user_data = i;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    b.state = block::in_flight;
+    ++pending_;
+    ++unsubmitted_;
+  }
+
+  void flush()
+  {
+    while (unsubmitted_ > 0)
+    {
+      int result = enter(unsubmitted_, 0, 0);
+      if (result > 0)
+        unsubmitted_ -= result;
+      else if (result < 0 && errno != EINTR)
+        break;
+    }
+  }
+
+  // Recycles the head block once it has been consumed, continuing any short
+  // read or moving the block to the end of the read-ahead window.
+  void advance()
+  {
+    for (;;)
+    {
+      block& b = blocks_[head_];
+      if (b.state != block::complete || b.begin != b.end || b.error)
+        break;
+      if (b.end < block_size)
+      {
+        submit(head_);
+        break;
+      }
+      b = block();
+      b.offset = next_offset_;
+      next_offset_ += block_size;
+      submit(head_);
+      head_ = (head_ + 1) % block_count;
+    }
+    flush();
+  }
+
+  // Starts reading the window of blocks that begins at the given offset.
+  void start(boost::uint64_t offset)
+  {
+    head_ = 0;
+    next_offset_ = offset;
+    for (std::size_t i = 0; i < block_count; ++i)
+    {
+      blocks_[i] = block();
+      blocks_[i].offset = next_offset_;
+      next_offset_ += block_size;
+      submit(i);
+    }
+    flush();
+  }
+
+  // The kernel may still be writing into the buffers, so wait for any
+  // outstanding reads before reusing or releasing them.
+  void drain()
+  {
+    while (ring_ != -1 && pending_ > 0)
+    {
+      if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        break;
+      reap();
+    }
+  }
+
+  static boost::system::error_code last_error()
+  {
+    return boost::system::error_code(errno,
+        boost::system::system_category());
+  }
+
+  boost::asio::posix::stream_descriptor descriptor_;
+  int ring_;
+  int file_;
+  char* sq_ring_;
+  std::size_t sq_ring_size_;
+  char* cq_ring_;
+  std::size_t cq_ring_size_;
+  io_uring_sqe* sqes_;
+  std::size_t sqes_size_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  io_uring_cqe* cqes_;
+  char* buffers_;
+  bool fixed_buffers_;
+  block blocks_[block_count];
+  std::size_t head_;
+  boost::uint64_t next_offset_;
+  std::size_t pending_;
+  unsigned unsubmitted_;
+};
+
+} // namespace detail
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // defined(URDL_HAS_IO_URING)
+
+#endif // URDL_DETAIL_IO_URING_FILE_HPP
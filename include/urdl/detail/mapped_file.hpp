@@ -0,0 +1,170 @@
+//
+// mapped_file.hpp
+// ~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_DETAIL_MAPPED_FILE_HPP
+#define URDL_DETAIL_MAPPED_FILE_HPP
+
+#include <boost/config.hpp>
+
+#if !defined(BOOST_WINDOWS) && !defined(URDL_DISABLE_MAPPED_FILE)
+# define URDL_HAS_MAPPED_FILE 1
+#endif // !defined(BOOST_WINDOWS) && !defined(URDL_DISABLE_MAPPED_FILE)
+
+#if defined(URDL_HAS_MAPPED_FILE)
+
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+namespace detail {
+
+// An output file of known size that is written through a shared memory
+// mapping. The file's blocks are allocated when it is opened, and pages that
+// have been written are periodically handed to the kernel for writeback.
+class mapped_file
+  : private boost::noncopyable
+{
+public:
+  mapped_file()
+    : file_(-1),
+      data_(0),
+      size_(0),
+      written_(0),
+      synced_(0)
+  {
+  }
+
+  ~mapped_file()
+  {
+    boost::system::error_code ignored_ec;
+    close(ignored_ec);
+  }
+
+  boost::system::error_code open(const std::string& path, std::size_t size,
+      boost::system::error_code& ec)
+  {
+    file_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (file_ == -1)
+      return ec = last_error();
+
+    if (allocate(size) != 0)
+      return ec = last_error();
+    size_ = size;
+
+    void* data = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_, 0);
+    if (data == MAP_FAILED)
+      return ec = last_error();
+    data_ = static_cast<char*>(data);
+    ::madvise(data_, size_, MADV_SEQUENTIAL);
+
+    return ec = boost::system::error_code();
+  }
+
+  char* data() const
+  {
+    return data_;
+  }
+
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+  std::size_t written() const
+  {
+    return written_;
+  }
+
+  // Records that the first n bytes of the mapping have been written. Once
+  // enough whole pages have accumulated, they are scheduled for writeback and
+  // released from the process's resident set.
+  void written(std::size_t n)
+  {
+    written_ = n;
+    std::size_t end = n & ~(page_size() - 1);
+    if (end - synced_ >= sync_interval)
+    {
+      ::msync(data_ + synced_, end - synced_, MS_ASYNC);
+      ::madvise(data_ + synced_, end - synced_, MADV_DONTNEED);
+      synced_ = end;
+    }
+  }
+
+  // Unmaps and closes the file, truncating it to the amount written.
+  boost::system::error_code close(boost::system::error_code& ec)
+  {
+    ec = boost::system::error_code();
+    if (data_)
+    {
+      ::munmap(data_, size_);
+      data_ = 0;
+    }
+    if (file_ != -1)
+    {
+      if (written_ < size_ && ::ftruncate(file_, written_) != 0)
+        ec = last_error();
+      ::close(file_);
+      file_ = -1;
+    }
+    return ec;
+  }
+
+private:
+  // The amount of data written between each writeback.
+  enum { sync_interval = 8 * 1024 * 1024 };
+
+  int allocate(std::size_t size)
+  {
+#if defined(__linux__)
+    // Reserve the blocks up front, so that the file is not fragmented. Not
+    // all file systems support this, in which case the file is just extended.
+    if (::fallocate(file_, 0, 0, size) == 0)
+      return 0;
+    if (errno != EOPNOTSUPP && errno != ENOSYS)
+      return -1;
+#endif // defined(__linux__)
+    return ::ftruncate(file_, size);
+  }
+
+  static std::size_t page_size()
+  {
+    static const std::size_t size = ::sysconf(_SC_PAGESIZE);
+    return size;
+  }
+
+  static boost::system::error_code last_error()
+  {
+    return boost::system::error_code(errno,
+        boost::system::system_category());
+  }
+
+  int file_;
+  char* data_;
+  std::size_t size_;
+  std::size_t written_;
+  std::size_t synced_;
+};
+
+} // namespace detail
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // defined(URDL_HAS_MAPPED_FILE)
+
+#endif // URDL_DETAIL_MAPPED_FILE_HPP
@@ -15,6 +15,7 @@
 #include <cctype>
 #include <cstdlib>
 #include <string>
+#include <boost/cstdint.hpp>
 
 #include "urdl/detail/abi_prefix.hpp"
 
@@ -289,6 +290,70 @@ bool parse_http_headers(Iterator begin, Iterator end,
   return false;
 }
 
+// Finds the value of a Content-Range header. On success, the value lies
+// between value_begin and value_end within the headers.
+inline bool find_content_range(const std::string& headers,
+    std::string::size_type& value_begin, std::string::size_type& value_end)
+{
+  std::string::size_type pos = 0;
+  while (pos < headers.length())
+  {
+    std::string::size_type eol = headers.find("\r\n", pos);
+    if (eol == std::string::npos)
+      eol = headers.length();
+    std::string::size_type colon = headers.find(':', pos);
+    if (colon < eol
+        && headers_equal(headers.substr(pos, colon - pos), "Content-Range"))
+    {
+      value_begin = colon + 1;
+      value_end = eol;
+      return true;
+    }
+    pos = eol + 2;
+  }
+  return false;
+}
+
+// Finds the complete length of the content from a Content-Range header, such
+// as "bytes 0-499/1234". Fails if there is no such header, or if the server
+// does not know the length.
+inline bool parse_content_range_length(const std::string& headers,
+    boost::uint64_t& length)
+{
+  std::string::size_type begin = 0, end = 0;
+  if (!find_content_range(headers, begin, end))
+    return false;
+  std::string::size_type slash = headers.find('/', begin);
+  if (slash >= end || !is_digit(headers[slash + 1]))
+    return false;
+  length = 0;
+  for (std::string::size_type pos = slash + 1;
+      pos < end && is_digit(headers[pos]); ++pos)
+    length = length * 10 + headers[pos] - '0';
+  return true;
+}
+
+// Finds the offset of the first byte sent from a Content-Range header, such as
+// "bytes 500-999/1234". Fails if there is no such header, or if it does not
+// give a range of bytes.
+inline bool parse_content_range_first(const std::string& headers,
+    boost::uint64_t& first)
+{
+  std::string::size_type begin = 0, end = 0;
+  if (!find_content_range(headers, begin, end))
+    return false;
+  std::string::size_type pos = headers.find_first_not_of(" \t", begin);
+  if (pos >= end || headers.compare(pos, 6, "bytes ") != 0)
+    return false;
+  pos = headers.find_first_not_of(' ', pos + 6);
+  if (pos >= end || !is_digit(headers[pos]))
+    return false;
+  first = 0;
+  for (; pos < end && is_digit(headers[pos]); ++pos)
+    first = first * 10 + headers[pos] - '0';
+  return pos < end && headers[pos] == '-';
+}
+
 } // namespace detail
 } // namespace urdl
 
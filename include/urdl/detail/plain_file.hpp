@@ -0,0 +1,389 @@
+//
+// plain_file.hpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_DETAIL_PLAIN_FILE_HPP
+#define URDL_DETAIL_PLAIN_FILE_HPP
+
+#include <boost/config.hpp>
+#include <cstddef>
+#include <string>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+
+#if defined(BOOST_WINDOWS)
+# include <fstream>
+#else // defined(BOOST_WINDOWS)
+# include <cerrno>
+# include <cstdlib>
+# include <cstring>
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <sys/uio.h>
+# include <unistd.h>
+#endif // defined(BOOST_WINDOWS)
+
+#if defined(__linux__) || defined(__FreeBSD__) \
+  || defined(__NetBSD__) || defined(__OpenBSD__)
+# define URDL_HAS_PREADV 1
+#endif // defined(__linux__) || defined(__FreeBSD__) ...
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+namespace detail {
+
+// A file read sequentially using ordinary blocking reads. On POSIX platforms
+// a read fills as much of a buffer sequence as it can in one system call.
+//
+// Files that cannot be read at an offset, such as pipes, FIFOs and character
+// devices, are read from their current position instead.
+//
+// The file may optionally bypass the page cache, in which case it is read in
+// large aligned blocks through an internal buffer, or it may tell the kernel
+// that the data will not be needed again once it has been read.
+class plain_file
+  : private boost::noncopyable
+{
+public:
+  // The maximum number of buffers filled by one read.
+  enum { max_buffers = 16 };
+
+  plain_file()
+#if !defined(BOOST_WINDOWS)
+    : fd_(-1),
+      seekable_(false),
+      offset_(0),
+      drop_cache_(false),
+      advised_(0),
+      direct_buffer_(0),
+      direct_start_(0),
+      direct_end_(0),
+      direct_skip_(0)
+#endif // !defined(BOOST_WINDOWS)
+  {
+  }
+
+  ~plain_file()
+  {
+    close();
+  }
+
+  // Opens the file. The direct_io and drop_cache flags are hints, and are
+  // ignored where they are not supported.
+  bool open(const std::string& path,
+      bool direct_io = false, bool drop_cache = false)
+  {
+    close();
+#if defined(BOOST_WINDOWS)
+    (void)direct_io;
+    (void)drop_cache;
+    file_.open(path.c_str(), std::ios_base::in | std::ios_base::binary);
+    return !!file_;
+#else // defined(BOOST_WINDOWS)
+    offset_ = 0;
+    advised_ = 0;
+    direct_start_ = direct_end_ = direct_skip_ = 0;
+    drop_cache_ = drop_cache && !direct_io;
+
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ == -1)
+      return false;
+
+    // Direct I/O is only enabled once the file is known to be a regular one,
+    // since asking for it when opening a FIFO fails only after a writer has
+    // been connected.
+    struct stat st;
+    bool have_status = ::fstat(fd_, &st) == 0;
+    bool regular = have_status && S_ISREG(st.st_mode);
+    seekable_ = regular || (have_status && S_ISBLK(st.st_mode));
+    if (direct_io && regular)
+      enable_direct();
+
+# if defined(POSIX_FADV_SEQUENTIAL)
+    if (drop_cache_)
+    {
+      ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+      ::posix_fadvise(fd_, 0, 0, POSIX_FADV_NOREUSE);
+    }
+# endif // defined(POSIX_FADV_SEQUENTIAL)
+    return true;
+#endif // defined(BOOST_WINDOWS)
+  }
+
+  void close()
+  {
+#if defined(BOOST_WINDOWS)
+    file_.close();
+    file_.clear();
+#else // defined(BOOST_WINDOWS)
+# if defined(POSIX_FADV_DONTNEED)
+    if (fd_ != -1 && drop_cache_)
+      ::posix_fadvise(fd_, advised_, 0, POSIX_FADV_DONTNEED);
+# endif // defined(POSIX_FADV_DONTNEED)
+    if (fd_ != -1)
+      ::close(fd_);
+    fd_ = -1;
+    std::free(direct_buffer_);
+    direct_buffer_ = 0;
+#endif // defined(BOOST_WINDOWS)
+  }
+
+  bool is_open() const
+  {
+#if defined(BOOST_WINDOWS)
+    // Some older versions of libstdc++ have a non-const is_open().
+    return const_cast<std::ifstream&>(file_).is_open();
+#else // defined(BOOST_WINDOWS)
+    return fd_ != -1;
+#endif // defined(BOOST_WINDOWS)
+  }
+
+#if !defined(BOOST_WINDOWS)
+  int native_handle() const
+  {
+    return fd_;
+  }
+#endif // !defined(BOOST_WINDOWS)
+
+  // Reads into the buffers, returning eof only if no data could be read.
+  template <typename MutableBufferSequence>
+  std::size_t read_some(const MutableBufferSequence& buffers,
+      boost::system::error_code& ec)
+  {
+    ec = boost::system::error_code();
+
+#if defined(BOOST_WINDOWS)
+    std::size_t bytes_transferred = 0;
+    typename MutableBufferSequence::const_iterator iter = buffers.begin();
+    typename MutableBufferSequence::const_iterator end = buffers.end();
+    for (; iter != end; ++iter)
+    {
+      boost::asio::mutable_buffer buffer(*iter);
+      std::size_t length = boost::asio::buffer_size(buffer);
+      if (length == 0)
+        continue;
+      if (!file_)
+        break;
+      file_.read(boost::asio::buffer_cast<char*>(buffer), length);
+      std::size_t n = static_cast<std::size_t>(file_.gcount());
+      bytes_transferred += n;
+      if (n < length)
+        break;
+    }
+    if (bytes_transferred == 0 && !file_)
+      ec = boost::asio::error::eof;
+    return bytes_transferred;
+#else // defined(BOOST_WINDOWS)
+    if (direct_buffer_)
+      return read_direct(buffers, ec);
+
+    iovec iov[max_buffers];
+    int count = 0;
+    typename MutableBufferSequence::const_iterator iter = buffers.begin();
+    typename MutableBufferSequence::const_iterator end = buffers.end();
+    for (; iter != end && count < max_buffers; ++iter)
+    {
+      boost::asio::mutable_buffer buffer(*iter);
+      if (boost::asio::buffer_size(buffer) > 0)
+      {
+        iov[count].iov_base = boost::asio::buffer_cast<void*>(buffer);
+        iov[count].iov_len = boost::asio::buffer_size(buffer);
+        ++count;
+      }
+    }
+    if (count == 0)
+      return 0;
+
+    ssize_t result;
+    do
+    {
+# if defined(URDL_HAS_PREADV)
+      if (seekable_)
+        result = ::preadv(fd_, iov, count, offset_);
+      else
+# endif // defined(URDL_HAS_PREADV)
+        result = ::readv(fd_, iov, count);
+    } while (result < 0 && errno == EINTR);
+
+    if (result < 0)
+    {
+      ec = boost::system::error_code(errno,
+          boost::system::system_category());
+      return 0;
+    }
+    if (result == 0)
+      ec = boost::asio::error::eof;
+    offset_ += result;
+    advise_consumed();
+    return static_cast<std::size_t>(result);
+#endif // defined(BOOST_WINDOWS)
+  }
+
+  std::size_t read(char* data, std::size_t length,
+      boost::system::error_code& ec)
+  {
+    return read_some(boost::asio::mutable_buffers_1(data, length), ec);
+  }
+
+  // Moves the position from which the next read starts. Returns false if the
+  // file does not support seeking.
+  bool seek(boost::uint64_t offset)
+  {
+#if defined(BOOST_WINDOWS)
+    file_.clear();
+    file_.seekg(static_cast<std::streamoff>(offset));
+    return !!file_;
+#else // defined(BOOST_WINDOWS)
+    if (!seekable_)
+      return false;
+
+    direct_start_ = direct_end_ = direct_skip_ = 0;
+    if (direct_buffer_)
+    {
+      // Reads must start on an aligned offset, so the data before the
+      // requested position is skipped once it has been read.
+      direct_skip_ = static_cast<std::size_t>(offset % direct_alignment);
+      offset -= direct_skip_;
+    }
+    offset_ = offset;
+    advised_ = offset;
+# if !defined(URDL_HAS_PREADV)
+    ::lseek(fd_, static_cast<off_t>(offset), SEEK_SET);
+# endif // !defined(URDL_HAS_PREADV)
+    return true;
+#endif // defined(BOOST_WINDOWS)
+  }
+
+private:
+#if defined(BOOST_WINDOWS)
+  std::ifstream file_;
+#else // defined(BOOST_WINDOWS)
+  // The size and alignment of the blocks read when bypassing the page cache,
+  // and the amount of data read between each hint to drop cached pages.
+  enum
+  {
+    direct_alignment = 4096,
+    direct_buffer_size = 1024 * 1024,
+    drop_cache_interval = 8 * 1024 * 1024
+  };
+
+  // Makes reads of the open file bypass the page cache. The file is left as it
+  // is if that is not possible, for example on file systems that do not
+  // support it.
+  void enable_direct()
+  {
+# if defined(O_DIRECT)
+    int flags = ::fcntl(fd_, F_GETFL);
+    if (flags == -1 || ::fcntl(fd_, F_SETFL, flags | O_DIRECT) == -1)
+      return;
+# elif defined(F_NOCACHE)
+    ::fcntl(fd_, F_NOCACHE, 1);
+# else // defined(F_NOCACHE)
+    return;
+# endif // defined(F_NOCACHE)
+
+    void* buffer = 0;
+    if (::posix_memalign(&buffer, direct_alignment, direct_buffer_size) != 0)
+    {
+# if defined(O_DIRECT)
+      ::fcntl(fd_, F_SETFL, flags);
+# elif defined(F_NOCACHE)
+      ::fcntl(fd_, F_NOCACHE, 0);
+# endif // defined(F_NOCACHE)
+      return;
+    }
+    direct_buffer_ = static_cast<char*>(buffer);
+  }
+
+  // Reads through the aligned buffer, since the caller's buffers may not meet
+  // the alignment requirements of the file system.
+  template <typename MutableBufferSequence>
+  std::size_t read_direct(const MutableBufferSequence& buffers,
+      boost::system::error_code& ec)
+  {
+    while (direct_start_ == direct_end_)
+    {
+      ssize_t result;
+      do
+      {
+        if (seekable_)
+          result = ::pread(fd_, direct_buffer_, direct_buffer_size, offset_);
+        else
+          result = ::read(fd_, direct_buffer_, direct_buffer_size);
+      } while (result < 0 && errno == EINTR);
+
+      if (result < 0)
+      {
+        ec = boost::system::error_code(errno,
+            boost::system::system_category());
+        return 0;
+      }
+      if (result == 0)
+      {
+        ec = boost::asio::error::eof;
+        return 0;
+      }
+      offset_ += result;
+      direct_end_ = static_cast<std::size_t>(result);
+      direct_start_ = direct_skip_ < direct_end_ ? direct_skip_ : direct_end_;
+      direct_skip_ -= direct_start_;
+    }
+
+    std::size_t bytes_transferred = 0;
+    typename MutableBufferSequence::const_iterator iter = buffers.begin();
+    typename MutableBufferSequence::const_iterator end = buffers.end();
+    for (; iter != end && direct_start_ != direct_end_; ++iter)
+    {
+      boost::asio::mutable_buffer buffer(*iter);
+      std::size_t length = boost::asio::buffer_size(buffer);
+      if (length > direct_end_ - direct_start_)
+        length = direct_end_ - direct_start_;
+      std::memcpy(boost::asio::buffer_cast<char*>(buffer),
+          direct_buffer_ + direct_start_, length);
+      direct_start_ += length;
+      bytes_transferred += length;
+    }
+    return bytes_transferred;
+  }
+
+  // Tells the kernel that the pages which have been read will not be needed
+  // again, so that they do not push other data out of the page cache.
+  void advise_consumed()
+  {
+# if defined(POSIX_FADV_DONTNEED)
+    if (drop_cache_ && offset_ - advised_ >= drop_cache_interval)
+    {
+      ::posix_fadvise(fd_, advised_, offset_ - advised_, POSIX_FADV_DONTNEED);
+      advised_ = offset_;
+    }
+# endif // defined(POSIX_FADV_DONTNEED)
+  }
+
+  int fd_;
+  bool seekable_;
+  boost::uint64_t offset_;
+  bool drop_cache_;
+  boost::uint64_t advised_;
+  char* direct_buffer_;
+  std::size_t direct_start_;
+  std::size_t direct_end_;
+  std::size_t direct_skip_;
+#endif // defined(BOOST_WINDOWS)
+};
+
+} // namespace detail
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // URDL_DETAIL_PLAIN_FILE_HPP
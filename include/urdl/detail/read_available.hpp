@@ -0,0 +1,95 @@
+//
+// read_available.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_DETAIL_READ_AVAILABLE_HPP
+#define URDL_DETAIL_READ_AVAILABLE_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <boost/version.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#if !defined(URDL_DISABLE_SSL)
+# include <boost/asio/ssl.hpp>
+#endif // !defined(URDL_DISABLE_SSL)
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+namespace detail {
+
+// The maximum number of buffers passed to read_available().
+enum { max_read_available_buffers = 16 };
+
+// Reads whatever data the socket already has, without blocking. Running out
+// of data is not an error. Any other error, including end of file, is
+// returned in ec, and the caller must report it from its next read since the
+// socket will not report it again.
+inline std::size_t read_available(boost::asio::ip::tcp::socket& socket,
+    const boost::asio::mutable_buffer* buffers, std::size_t count,
+    boost::system::error_code& ec)
+{
+  ec = boost::system::error_code();
+#if defined(MSG_DONTWAIT)
+  iovec iov[max_read_available_buffers];
+  std::size_t iov_count = 0;
+  for (std::size_t i = 0; i < count && i < max_read_available_buffers; ++i)
+  {
+    iov[iov_count].iov_base = boost::asio::buffer_cast<void*>(buffers[i]);
+    iov[iov_count].iov_len = boost::asio::buffer_size(buffers[i]);
+    ++iov_count;
+  }
+
+  msghdr msg = msghdr();
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iov_count;
+# if (BOOST_VERSION >= 104700)
+  ssize_t result = ::recvmsg(socket.native_handle(), &msg, MSG_DONTWAIT);
+# else // (BOOST_VERSION >= 104700)
+  ssize_t result = ::recvmsg(socket.native(), &msg, MSG_DONTWAIT);
+# endif // (BOOST_VERSION >= 104700)
+  if (result > 0)
+    return static_cast<std::size_t>(result);
+  if (result == 0)
+    ec = boost::asio::error::eof;
+  else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+    ec = boost::system::error_code(errno,
+        boost::asio::error::get_system_category());
+  return 0;
+#else // defined(MSG_DONTWAIT)
+  // Without a per-call non-blocking flag, only read what the socket reports
+  // as available, so that the read cannot block.
+  if (count == 0 || socket.available(ec) == 0 || ec)
+    return 0;
+  return socket.read_some(boost::asio::mutable_buffers_1(buffers[0]), ec);
+#endif // defined(MSG_DONTWAIT)
+}
+
+#if !defined(URDL_DISABLE_SSL)
+// Decrypted data cannot be read from an SSL stream without the possibility of
+// blocking, so nothing is read.
+inline std::size_t read_available(
+    boost::asio::ssl::stream<boost::asio::ip::tcp::socket>& /*socket*/,
+    const boost::asio::mutable_buffer* /*buffers*/, std::size_t /*count*/,
+    boost::system::error_code& ec)
+{
+  ec = boost::system::error_code();
+  return 0;
+}
+#endif // !defined(URDL_DISABLE_SSL)
+
+} // namespace detail
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // URDL_DETAIL_READ_AVAILABLE_HPP
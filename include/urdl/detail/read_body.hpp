@@ -0,0 +1,297 @@
+//
+// read_body.hpp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_DETAIL_READ_BODY_HPP
+#define URDL_DETAIL_READ_BODY_HPP
+
+#include <cstddef>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/detail/bind_handler.hpp>
+#include "urdl/detail/coroutine.hpp"
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+namespace detail {
+
+// The size of the first allocation made when the content length is unknown.
+enum { initial_body_size = 16384 };
+
+// Destination for a body that is grown by resizing a container of char.
+template <typename Container>
+class container_body
+{
+public:
+  explicit container_body(Container& c)
+    : container_(&c)
+  {
+  }
+
+  std::size_t max_size() const
+  {
+    return ~std::size_t(0);
+  }
+
+  char* reserve(std::size_t n)
+  {
+    container_->resize(n);
+    return n ? &(*container_)[0] : 0;
+  }
+
+  void finish(std::size_t n)
+  {
+    container_->resize(n);
+  }
+
+private:
+  Container* container_;
+};
+
+// Destination for a body that is read into a fixed region of memory.
+class arena_body
+{
+public:
+  explicit arena_body(const boost::asio::mutable_buffer& arena)
+    : arena_(arena)
+  {
+  }
+
+  std::size_t max_size() const
+  {
+    return boost::asio::buffer_size(arena_);
+  }
+
+  char* reserve(std::size_t)
+  {
+    return boost::asio::buffer_cast<char*>(arena_);
+  }
+
+  void finish(std::size_t)
+  {
+  }
+
+private:
+  boost::asio::mutable_buffer arena_;
+};
+
+// Determines how much space to make available for the body, given the number
+// of bytes already read. A known content length is reserved in one go.
+// Otherwise the space grows geometrically, up to the maximum.
+inline std::size_t next_body_size(std::size_t size,
+    std::size_t content_length, std::size_t max_size)
+{
+  if (content_length != ~std::size_t(0))
+    return content_length;
+  const std::size_t initial_size = initial_body_size;
+  if (size < initial_size)
+    return initial_size < max_size ? initial_size : max_size;
+  return size < max_size / 2 ? size * 2 : max_size;
+}
+
+// Reads the rest of the stream's content into the body. The content_length
+// is the number of bytes that remain to be read, or ~std::size_t(0) if that
+// is not known.
+template <typename Stream, typename Body>
+std::size_t read_body(Stream& s, Body body, std::size_t content_length,
+    std::size_t max_size, boost::system::error_code& ec)
+{
+  if (max_size > body.max_size())
+    max_size = body.max_size();
+
+  if (content_length != ~std::size_t(0) && content_length > max_size)
+  {
+    ec = boost::asio::error::message_size;
+    return 0;
+  }
+
+  ec = boost::system::error_code();
+  std::size_t size = 0;
+  std::size_t capacity = 0;
+  char* data = 0;
+  for (;;)
+  {
+    if (size == capacity)
+    {
+      if (size == content_length)
+        break;
+
+      if (size == max_size)
+      {
+        // The body may be exactly the maximum size. Check for the end of the
+        // content without consuming any data.
+        if (s.fill(ec) > 0)
+          ec = boost::asio::error::message_size;
+        else if (ec == boost::asio::error::eof)
+          ec = boost::system::error_code();
+        break;
+      }
+
+      capacity = next_body_size(size, content_length, max_size);
+      data = body.reserve(capacity);
+    }
+
+    size += s.read_some(boost::asio::buffer(
+          data + size, capacity - size), ec);
+    if (ec == boost::asio::error::eof)
+    {
+      // The end of the content is only an error if it came too soon.
+      if (content_length == ~std::size_t(0))
+        ec = boost::system::error_code();
+      break;
+    }
+    else if (ec)
+      break;
+  }
+
+  body.finish(size);
+  return size;
+}
+
+template <typename Stream, typename Body, typename Handler>
+class read_body_coro : coroutine
+{
+public:
+  read_body_coro(Handler handler, Stream& s, Body body,
+      std::size_t content_length, std::size_t max_size)
+    : handler_(handler),
+      stream_(s),
+      body_(body),
+      max_size_(max_size),
+      content_length_(content_length),
+      size_(0),
+      capacity_(0),
+      data_(0)
+  {
+    if (max_size_ > body_.max_size())
+      max_size_ = body_.max_size();
+  }
+
+  void operator()(boost::system::error_code ec,
+      std::size_t bytes_transferred = 0)
+  {
+    URDL_CORO_BEGIN;
+
+    if (content_length_ != ~std::size_t(0) && content_length_ > max_size_)
+    {
+      ec = boost::asio::error::message_size;
+      URDL_CORO_YIELD(stream_.get_io_service().post(
+            boost::asio::detail::bind_handler(*this, ec)));
+      handler_(ec, 0);
+      return;
+    }
+
+    for (;;)
+    {
+      if (size_ == capacity_)
+      {
+        if (size_ == content_length_)
+        {
+          // An empty body requires no reads, but the handler must still not
+          // be invoked from within the initiating function.
+          if (size_ == 0)
+          {
+            URDL_CORO_YIELD(stream_.get_io_service().post(
+                  boost::asio::detail::bind_handler(*this, ec)));
+          }
+          break;
+        }
+
+        if (size_ == max_size_)
+        {
+          // The body may be exactly the maximum size. Check for the end of
+          // the content without consuming any data.
+          URDL_CORO_YIELD(stream_.async_fill(*this));
+          if (bytes_transferred > 0)
+            ec = boost::asio::error::message_size;
+          else if (ec == boost::asio::error::eof)
+            ec = boost::system::error_code();
+          break;
+        }
+
+        capacity_ = next_body_size(size_, content_length_, max_size_);
+        data_ = body_.reserve(capacity_);
+      }
+
+      URDL_CORO_YIELD(stream_.async_read_some(boost::asio::buffer(
+              data_ + size_, capacity_ - size_), *this));
+      size_ += bytes_transferred;
+      if (ec == boost::asio::error::eof)
+      {
+        // The end of the content is only an error if it came too soon.
+        if (content_length_ == ~std::size_t(0))
+          ec = boost::system::error_code();
+        break;
+      }
+      else if (ec)
+        break;
+    }
+
+    body_.finish(size_);
+    handler_(ec, size_);
+
+    URDL_CORO_END;
+  }
+
+  friend void* asio_handler_allocate(std::size_t size,
+      read_body_coro<Stream, Body, Handler>* this_handler)
+  {
+    using boost::asio::asio_handler_allocate;
+    return asio_handler_allocate(size, &this_handler->handler_);
+  }
+
+  friend void asio_handler_deallocate(void* pointer, std::size_t size,
+      read_body_coro<Stream, Body, Handler>* this_handler)
+  {
+    using boost::asio::asio_handler_deallocate;
+    asio_handler_deallocate(pointer, size, &this_handler->handler_);
+  }
+
+  template <typename Function>
+  friend void asio_handler_invoke(Function& function,
+      read_body_coro<Stream, Body, Handler>* this_handler)
+  {
+    using boost::asio::asio_handler_invoke;
+    asio_handler_invoke(function, &this_handler->handler_);
+  }
+
+  template <typename Function>
+  friend void asio_handler_invoke(const Function& function,
+      read_body_coro<Stream, Body, Handler>* this_handler)
+  {
+    using boost::asio::asio_handler_invoke;
+    asio_handler_invoke(function, &this_handler->handler_);
+  }
+
+private:
+  Handler handler_;
+  Stream& stream_;
+  Body body_;
+  std::size_t max_size_;
+  std::size_t content_length_;
+  std::size_t size_;
+  std::size_t capacity_;
+  char* data_;
+};
+
+template <typename Stream, typename Body, typename Handler>
+void async_read_body(Stream& s, Body body, std::size_t content_length,
+    std::size_t max_size, Handler handler)
+{
+  read_body_coro<Stream, Body, Handler>(handler, s, body,
+      content_length, max_size)(boost::system::error_code());
+}
+
+} // namespace detail
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // URDL_DETAIL_READ_BODY_HPP
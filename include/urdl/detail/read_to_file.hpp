@@ -0,0 +1,295 @@
+//
+// read_to_file.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_DETAIL_READ_TO_FILE_HPP
+#define URDL_DETAIL_READ_TO_FILE_HPP
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/detail/bind_handler.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+#include "urdl/detail/coroutine.hpp"
+#include "urdl/detail/mapped_file.hpp"
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+namespace detail {
+
+// Writes the stream's buffered data to the file. Returns false on failure.
+template <typename Stream>
+bool write_buffered_data(Stream& s, std::ofstream& file,
+    std::size_t& total, boost::system::error_code& ec)
+{
+  boost::asio::const_buffers_1 data = s.data();
+  std::size_t length = boost::asio::buffer_size(data);
+  file.write(boost::asio::buffer_cast<const char*>(data), length);
+  if (!file)
+  {
+    ec = make_error_code(boost::system::errc::io_error);
+    return false;
+  }
+  s.consume(length);
+  total += length;
+  return true;
+}
+
+// Copies the remaining content to a file through the stream's own buffer, for
+// use where the data cannot be moved from the socket to the file directly.
+template <typename Stream>
+std::size_t read_to_file(Stream& s, const std::string& path,
+    boost::system::error_code& ec)
+{
+  std::ofstream file(path.c_str(), std::ios_base::out
+      | std::ios_base::trunc | std::ios_base::binary);
+  if (!file)
+  {
+    ec = make_error_code(boost::system::errc::io_error);
+    return 0;
+  }
+
+  std::size_t total = 0;
+  while (s.fill(ec) > 0)
+    if (!write_buffered_data(s, file, total, ec))
+      return total;
+
+  if (ec == boost::asio::error::eof)
+    ec = boost::system::error_code();
+  return total;
+}
+
+template <typename Stream, typename Handler>
+class read_to_file_coro : coroutine
+{
+public:
+  read_to_file_coro(Handler handler, Stream& s,
+      const boost::shared_ptr<std::ofstream>& file)
+    : handler_(handler),
+      stream_(s),
+      file_(file),
+      total_(0)
+  {
+  }
+
+  void operator()(boost::system::error_code ec,
+      std::size_t bytes_available = 0)
+  {
+    URDL_CORO_BEGIN;
+
+    if (!*file_)
+    {
+      ec = make_error_code(boost::system::errc::io_error);
+      URDL_CORO_YIELD(stream_.get_io_service().post(
+            boost::asio::detail::bind_handler(*this, ec)));
+      handler_(ec, 0);
+      return;
+    }
+
+    for (;;)
+    {
+      URDL_CORO_YIELD(stream_.async_fill(*this));
+      if (bytes_available == 0)
+        break;
+      if (!write_buffered_data(stream_, *file_, total_, ec))
+        break;
+    }
+
+    if (ec == boost::asio::error::eof)
+      ec = boost::system::error_code();
+    file_->close();
+    handler_(ec, total_);
+
+    URDL_CORO_END;
+  }
+
+  friend void* asio_handler_allocate(std::size_t size,
+      read_to_file_coro<Stream, Handler>* this_handler)
+  {
+    using boost::asio::asio_handler_allocate;
+    return asio_handler_allocate(size, &this_handler->handler_);
+  }
+
+  friend void asio_handler_deallocate(void* pointer, std::size_t size,
+      read_to_file_coro<Stream, Handler>* this_handler)
+  {
+    using boost::asio::asio_handler_deallocate;
+    asio_handler_deallocate(pointer, size, &this_handler->handler_);
+  }
+
+  template <typename Function>
+  friend void asio_handler_invoke(Function& function,
+      read_to_file_coro<Stream, Handler>* this_handler)
+  {
+    using boost::asio::asio_handler_invoke;
+    asio_handler_invoke(function, &this_handler->handler_);
+  }
+
+  template <typename Function>
+  friend void asio_handler_invoke(const Function& function,
+      read_to_file_coro<Stream, Handler>* this_handler)
+  {
+    using boost::asio::asio_handler_invoke;
+    asio_handler_invoke(function, &this_handler->handler_);
+  }
+
+private:
+  Handler handler_;
+  Stream& stream_;
+  boost::shared_ptr<std::ofstream> file_;
+  std::size_t total_;
+};
+
+template <typename Stream, typename Handler>
+void async_read_to_file(Stream& s, const std::string& path, Handler handler)
+{
+  boost::shared_ptr<std::ofstream> file(new std::ofstream(path.c_str(),
+        std::ios_base::out | std::ios_base::trunc | std::ios_base::binary));
+  read_to_file_coro<Stream, Handler>(handler, s, file)(
+      boost::system::error_code());
+}
+
+#if defined(URDL_HAS_MAPPED_FILE)
+
+// Reads the remaining content directly into a file mapped in memory. The file
+// is sized to the length of the remaining content, so running out of space
+// means that the server sent more than it said it would, and reaching the end
+// of the content first means that it sent less.
+template <typename Stream>
+std::size_t read_to_mapped_file(Stream& s, mapped_file& file,
+    boost::system::error_code& ec)
+{
+  std::size_t size = 0;
+  for (;;)
+  {
+    if (size == file.size())
+    {
+      if (s.fill(ec) > 0)
+        ec = boost::asio::error::message_size;
+      else if (ec == boost::asio::error::eof)
+        ec = boost::system::error_code();
+      break;
+    }
+
+    size += s.read_some(boost::asio::buffer(
+          file.data() + size, file.size() - size), ec);
+    file.written(size);
+    if (ec)
+      break;
+  }
+
+  boost::system::error_code close_ec;
+  if (file.close(close_ec) && !ec)
+    ec = close_ec;
+  return size;
+}
+
+template <typename Stream, typename Handler>
+class read_to_mapped_file_coro : coroutine
+{
+public:
+  read_to_mapped_file_coro(Handler handler, Stream& s,
+      const boost::shared_ptr<mapped_file>& file)
+    : handler_(handler),
+      stream_(s),
+      file_(file)
+  {
+  }
+
+  void operator()(boost::system::error_code ec,
+      std::size_t bytes_transferred = 0)
+  {
+    URDL_CORO_BEGIN;
+
+    for (;;)
+    {
+      if (file_->written() == file_->size())
+      {
+        URDL_CORO_YIELD(stream_.async_fill(*this));
+        if (bytes_transferred > 0)
+          ec = boost::asio::error::message_size;
+        else if (ec == boost::asio::error::eof)
+          ec = boost::system::error_code();
+        break;
+      }
+
+      URDL_CORO_YIELD(stream_.async_read_some(boost::asio::buffer(
+              file_->data() + file_->written(),
+              file_->size() - file_->written()), *this));
+      file_->written(file_->written() + bytes_transferred);
+      if (ec)
+        break;
+    }
+
+    {
+      boost::system::error_code close_ec;
+      if (file_->close(close_ec) && !ec)
+        ec = close_ec;
+    }
+    handler_(ec, file_->written());
+
+    URDL_CORO_END;
+  }
+
+  friend void* asio_handler_allocate(std::size_t size,
+      read_to_mapped_file_coro<Stream, Handler>* this_handler)
+  {
+    using boost::asio::asio_handler_allocate;
+    return asio_handler_allocate(size, &this_handler->handler_);
+  }
+
+  friend void asio_handler_deallocate(void* pointer, std::size_t size,
+      read_to_mapped_file_coro<Stream, Handler>* this_handler)
+  {
+    using boost::asio::asio_handler_deallocate;
+    asio_handler_deallocate(pointer, size, &this_handler->handler_);
+  }
+
+  template <typename Function>
+  friend void asio_handler_invoke(Function& function,
+      read_to_mapped_file_coro<Stream, Handler>* this_handler)
+  {
+    using boost::asio::asio_handler_invoke;
+    asio_handler_invoke(function, &this_handler->handler_);
+  }
+
+  template <typename Function>
+  friend void asio_handler_invoke(const Function& function,
+      read_to_mapped_file_coro<Stream, Handler>* this_handler)
+  {
+    using boost::asio::asio_handler_invoke;
+    asio_handler_invoke(function, &this_handler->handler_);
+  }
+
+private:
+  Handler handler_;
+  Stream& stream_;
+  boost::shared_ptr<mapped_file> file_;
+};
+
+template <typename Stream, typename Handler>
+void async_read_to_mapped_file(Stream& s,
+    const boost::shared_ptr<mapped_file>& file, Handler handler)
+{
+  read_to_mapped_file_coro<Stream, Handler>(handler, s, file)(
+      boost::system::error_code());
+}
+
+#endif // defined(URDL_HAS_MAPPED_FILE)
+
+} // namespace detail
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // URDL_DETAIL_READ_TO_FILE_HPP
@@ -0,0 +1,149 @@
+//
+// splice.hpp
+// ~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_DETAIL_SPLICE_HPP
+#define URDL_DETAIL_SPLICE_HPP
+
+#if defined(__linux__) && !defined(URDL_DISABLE_SPLICE)
+# define URDL_HAS_SPLICE 1
+#endif // defined(__linux__) && !defined(URDL_DISABLE_SPLICE)
+
+#if defined(URDL_HAS_SPLICE)
+
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/asio/error.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+namespace detail {
+
+// The destination file and the pipe through which data is spliced into it.
+// Data moves from the socket to the pipe, and from the pipe to the file, in
+// the kernel.
+class splice_file
+  : private boost::noncopyable
+{
+public:
+  splice_file()
+    : file_(-1)
+  {
+    pipe_[0] = pipe_[1] = -1;
+  }
+
+  ~splice_file()
+  {
+    if (file_ != -1)
+      ::close(file_);
+    if (pipe_[0] != -1)
+      ::close(pipe_[0]);
+    if (pipe_[1] != -1)
+      ::close(pipe_[1]);
+  }
+
+  boost::system::error_code open(const std::string& path,
+      boost::system::error_code& ec)
+  {
+    file_ = ::open(path.c_str(),
+        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (file_ == -1 || ::pipe2(pipe_, O_CLOEXEC) != 0)
+      ec = last_error();
+    else
+      ec = boost::system::error_code();
+    return ec;
+  }
+
+  // Writes data from memory, for bytes that have already left the socket.
+  std::size_t write(const char* data, std::size_t length,
+      boost::system::error_code& ec)
+  {
+    std::size_t total = 0;
+    while (total < length)
+    {
+      ssize_t n = ::write(file_, data + total, length - total);
+      if (n < 0 && errno != EINTR)
+      {
+        ec = last_error();
+        return total;
+      }
+      if (n > 0)
+        total += n;
+    }
+    ec = boost::system::error_code();
+    return total;
+  }
+
+  // Moves whatever data the socket has into the file. Fails with would_block
+  // if the socket is non-blocking and has no data, or with eof at the end of
+  // the content.
+  std::size_t splice_some(int socket, boost::system::error_code& ec)
+  {
+    ssize_t n = ::splice(socket, 0, pipe_[1], 0,
+        splice_size, SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (n == 0)
+    {
+      ec = boost::asio::error::eof;
+      return 0;
+    }
+    if (n < 0)
+    {
+      ec = (errno == EINTR)
+        ? boost::system::error_code() : last_error();
+      return 0;
+    }
+
+    // Drain the pipe into the file. Writes to a regular file do not wait on
+    // the network, so this completes promptly.
+    std::size_t remaining = n;
+    while (remaining > 0)
+    {
+      ssize_t m = ::splice(pipe_[0], 0, file_, 0, remaining, SPLICE_F_MOVE);
+      if (m < 0 && errno != EINTR)
+      {
+        ec = last_error();
+        return n - remaining;
+      }
+      if (m > 0)
+        remaining -= m;
+    }
+
+    ec = boost::system::error_code();
+    return n;
+  }
+
+private:
+  enum { splice_size = 65536 };
+
+  static boost::system::error_code last_error()
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return boost::asio::error::would_block;
+    return boost::system::error_code(errno,
+        boost::system::system_category());
+  }
+
+  int file_;
+  int pipe_[2];
+};
+
+} // namespace detail
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // defined(URDL_HAS_SPLICE)
+
+#endif // URDL_DETAIL_SPLICE_HPP
@@ -0,0 +1,476 @@
+//
+// file.hpp
+// ~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_FILE_HPP
+#define URDL_FILE_HPP
+
+#include "urdl/detail/config.hpp"
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+namespace file {
+
+/// Option to specify whether a file is read through a memory mapping.
+/**
+ * @par Remarks
+ * The default is to read files using ordinary read calls. When memory mapping is
+ * enabled, the whole file is mapped when it is opened, and the mapping is
+ * made available through @c read_stream::data() without copying. The option
+ * is ignored on platforms that do not support memory mapping, and for files
+ * that cannot be mapped, such as pipes.
+ *
+ * The mapping is not a copy of the file. If the file is truncated while it is
+ * mapped, touching the pages beyond its new end raises @c SIGBUS on POSIX
+ * systems, and this happens inside @c read_some() or wherever the data
+ * returned by @c read_stream::data() is used. Enable the option only for
+ * files that are not truncated while they are being read.
+ *
+ * @par Example
+ * To read a file through a memory mapping using an object of class
+ * @c urdl::read_stream:
+ * @code
+ * urdl::read_stream stream;
+ * stream.set_option(urdl::file::memory_map(true));
+ * stream.open("file:///var/cache/data.bin");
+ * @endcode
+ *
+ * @par Requirements
+ * @e Header: @c <urdl/file.hpp> @n
+ * @e Namespace: @c urdl::file
+ */
+class memory_map
+{
+public:
+  /// Constructs an object of class @c memory_map.
+  /**
+   * @par Remarks
+   * Postcondition: <tt>value() == false</tt>.
+   */
+  memory_map()
+    : value_(false)
+  {
+  }
+
+  /// Constructs an object of class @c memory_map.
+  /**
+   * @param v The desired value for the option.
+   *
+   * @par Remarks
+   * Postcondition: <tt>value() == v</tt>
+   */
+  explicit memory_map(bool v)
+    : value_(v)
+  {
+  }
+
+  /// Gets the value of the option.
+  /**
+   * @returns The value of the option.
+   */
+  bool value() const
+  {
+    return value_;
+  }
+
+  /// Sets the value of the option.
+  /**
+   * @param v The desired value for the option.
+   *
+   * @par Remarks
+   * Postcondition: <tt>value() == v</tt>
+   */
+  void value(bool v)
+  {
+    value_ = v;
+  }
+
+private:
+  bool value_;
+};
+
+/// Option to specify whether a file is read asynchronously using io_uring.
+/**
+ * @par Remarks
+ * The default is for asynchronous reads of a file to be performed using
+ * blocking reads on the thread that starts them. When this option is enabled
+ * on Linux, the file is instead read using io_uring, so that a slow disk or
+ * network file system does not stall the @c io_service. Several blocks of the
+ * file are read ahead of the caller. The option is ignored on other platforms
+ * and where io_uring is not available, and if @c memory_map is also enabled.
+ *
+ * @par Example
+ * To read a file using io_uring with an object of class @c urdl::read_stream:
+ * @code
+ * urdl::read_stream stream;
+ * stream.set_option(urdl::file::io_uring(true));
+ * stream.open("file:///mnt/nfs/data.bin");
+ * @endcode
+ *
+ * @par Requirements
+ * @e Header: @c <urdl/file.hpp> @n
+ * @e Namespace: @c urdl::file
+ */
+class io_uring
+{
+public:
+  /// Constructs an object of class @c io_uring.
+  /**
+   * @par Remarks
+   * Postcondition: <tt>value() == false</tt>.
+   */
+  io_uring()
+    : value_(false)
+  {
+  }
+
+  /// Constructs an object of class @c io_uring.
+  /**
+   * @param v The desired value for the option.
+   *
+   * @par Remarks
+   * Postcondition: <tt>value() == v</tt>
+   */
+  explicit io_uring(bool v)
+    : value_(v)
+  {
+  }
+
+  /// Gets the value of the option.
+  /**
+   * @returns The value of the option.
+   */
+  bool value() const
+  {
+    return value_;
+  }
+
+  /// Sets the value of the option.
+  /**
+   * @param v The desired value for the option.
+   *
+   * @par Remarks
+   * Postcondition: <tt>value() == v</tt>
+   */
+  void value(bool v)
+  {
+    value_ = v;
+  }
+
+private:
+  bool value_;
+};
+
+/// Option to specify whether blocking file operations are run on a thread
+/// pool.
+/**
+ * @par Remarks
+ * The default is for asynchronous operations on a file to perform the
+ * underlying blocking open and read calls on the thread that starts them.
+ * When this option is enabled, those calls are instead run on a small pool of
+ * threads belonging to the @c io_service, and the completion handlers are
+ * posted back to the @c io_service. This stops a slow disk or network file
+ * system from stalling the @c io_service. Reads performed using @c io_uring
+ * do not use the pool.
+ *
+ * Closing or destroying the stream waits for an open or read that is already
+ * running on the pool to finish. Operations that have not yet started
+ * complete with @c boost::asio::error::operation_aborted.
+ *
+ * @par Example
+ * To open and read a file on the thread pool using an object of class
+ * @c urdl::read_stream:
+ * @code
+ * urdl::read_stream stream;
+ * stream.set_option(urdl::file::thread_pool(true));
+ * stream.async_open("file:///mnt/nfs/data.bin", handler);
+ * @endcode
+ *
+ * @par Requirements
+ * @e Header: @c <urdl/file.hpp> @n
+ * @e Namespace: @c urdl::file
+ */
+class thread_pool
+{
+public:
+  /// Constructs an object of class @c thread_pool.
+  /**
+   * @par Remarks
+   * Postcondition: <tt>value() == false</tt>.
+   */
+  thread_pool()
+    : value_(false)
+  {
+  }
+
+  /// Constructs an object of class @c thread_pool.
+  /**
+   * @param v The desired value for the option.
+   *
+   * @par Remarks
+   * Postcondition: <tt>value() == v</tt>
+   */
+  explicit thread_pool(bool v)
+    : value_(v)
+  {
+  }
+
+  /// Gets the value of the option.
+  /**
+   * @returns The value of the option.
+   */
+  bool value() const
+  {
+    return value_;
+  }
+
+  /// Sets the value of the option.
+  /**
+   * @param v The desired value for the option.
+   *
+   * @par Remarks
+   * Postcondition: <tt>value() == v</tt>
+   */
+  void value(bool v)
+  {
+    value_ = v;
+  }
+
+private:
+  bool value_;
+};
+
+/// Option to specify whether a file's content type is guessed from its
+/// extension.
+/**
+ * @par Remarks
+ * The default is for files to have no content type. When this option is
+ * enabled, common extensions such as @c .html, @c .json and @c .png are
+ * mapped to their MIME types, and the result is returned by
+ * @c read_stream::content_type() and included in @c read_stream::headers().
+ *
+ * @par Example
+ * To guess the content type of a file using an object of class
+ * @c urdl::read_stream:
+ * @code
+ * urdl::read_stream stream;
+ * stream.set_option(urdl::file::guess_content_type(true));
+ * stream.open("file:///var/www/index.html");
+ * std::string type = stream.content_type(); // "text/html"
+ * @endcode
+ *
+ * @par Requirements
+ * @e Header: @c <urdl/file.hpp> @n
+ * @e Namespace: @c urdl::file
+ */
+class guess_content_type
+{
+public:
+  /// Constructs an object of class @c guess_content_type.
+  /**
+   * @par Remarks
+   * Postcondition: <tt>value() == false</tt>.
+   */
+  guess_content_type()
+    : value_(false)
+  {
+  }
+
+  /// Constructs an object of class @c guess_content_type.
+  /**
+   * @param v The desired value for the option.
+   *
+   * @par Remarks
+   * Postcondition: <tt>value() == v</tt>
+   */
+  explicit guess_content_type(bool v)
+    : value_(v)
+  {
+  }
+
+  /// Gets the value of the option.
+  /**
+   * @returns The value of the option.
+   */
+  bool value() const
+  {
+    return value_;
+  }
+
+  /// Sets the value of the option.
+  /**
+   * @param v The desired value for the option.
+   *
+   * @par Remarks
+   * Postcondition: <tt>value() == v</tt>
+   */
+  void value(bool v)
+  {
+    value_ = v;
+  }
+
+private:
+  bool value_;
+};
+
+/// Option to specify whether a file is read without using the page cache.
+/**
+ * @par Remarks
+ * The default is for files to be read through the operating system's page
+ * cache. When this option is enabled, a file is opened with @c O_DIRECT (or
+ * @c F_NOCACHE on Mac OS X) and read in large aligned blocks through an
+ * internal buffer, so that streaming a very large file once does not evict
+ * other data from the cache. If the file system does not support this, the
+ * file is read normally. The option does not apply to files read using
+ * @c memory_map or @c io_uring.
+ *
+ * @par Example
+ * To read a file without using the page cache with an object of class
+ * @c urdl::read_stream:
+ * @code
+ * urdl::read_stream stream;
+ * stream.set_option(urdl::file::direct_io(true));
+ * stream.open("file:///backup/disk.img");
+ * @endcode
+ *
+ * @par Requirements
+ * @e Header: @c <urdl/file.hpp> @n
+ * @e Namespace: @c urdl::file
+ */
+class direct_io
+{
+public:
+  /// Constructs an object of class @c direct_io.
+  /**
+   * @par Remarks
+   * Postcondition: <tt>value() == false</tt>.
+   */
+  direct_io()
+    : value_(false)
+  {
+  }
+
+  /// Constructs an object of class @c direct_io.
+  /**
+   * @param v The desired value for the option.
+   *
+   * @par Remarks
+   * Postcondition: <tt>value() == v</tt>
+   */
+  explicit direct_io(bool v)
+    : value_(v)
+  {
+  }
+
+  /// Gets the value of the option.
+  /**
+   * @returns The value of the option.
+   */
+  bool value() const
+  {
+    return value_;
+  }
+
+  /// Sets the value of the option.
+  /**
+   * @param v The desired value for the option.
+   *
+   * @par Remarks
+   * Postcondition: <tt>value() == v</tt>
+   */
+  void value(bool v)
+  {
+    value_ = v;
+  }
+
+private:
+  bool value_;
+};
+
+/// Option to specify whether a file's pages are dropped from the page cache
+/// after they are read.
+/**
+ * @par Remarks
+ * The default is for the operating system to cache a file's pages as usual.
+ * When this option is enabled, the kernel is told that the file will be read
+ * sequentially and only once, using @c posix_fadvise, and the pages that have
+ * been read are periodically released from the cache. The option is ignored
+ * on platforms without @c posix_fadvise, and does not apply to files read
+ * using @c memory_map or @c io_uring.
+ *
+ * @par Example
+ * To release a file's pages from the cache as it is read with an object of
+ * class @c urdl::read_stream:
+ * @code
+ * urdl::read_stream stream;
+ * stream.set_option(urdl::file::drop_cache(true));
+ * stream.open("file:///backup/disk.img");
+ * @endcode
+ *
+ * @par Requirements
+ * @e Header: @c <urdl/file.hpp> @n
+ * @e Namespace: @c urdl::file
+ */
+class drop_cache
+{
+public:
+  /// Constructs an object of class @c drop_cache.
+  /**
+   * @par Remarks
+   * Postcondition: <tt>value() == false</tt>.
+   */
+  drop_cache()
+    : value_(false)
+  {
+  }
+
+  /// Constructs an object of class @c drop_cache.
+  /**
+   * @param v The desired value for the option.
+   *
+   * @par Remarks
+   * Postcondition: <tt>value() == v</tt>
+   */
+  explicit drop_cache(bool v)
+    : value_(v)
+  {
+  }
+
+  /// Gets the value of the option.
+  /**
+   * @returns The value of the option.
+   */
+  bool value() const
+  {
+    return value_;
+  }
+
+  /// Sets the value of the option.
+  /**
+   * @param v The desired value for the option.
+   *
+   * @par Remarks
+   * Postcondition: <tt>value() == v</tt>
+   */
+  void value(bool v)
+  {
+    value_ = v;
+  }
+
+private:
+  bool value_;
+};
+
+} // namespace file
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // URDL_FILE_HPP
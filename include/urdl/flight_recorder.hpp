@@ -0,0 +1,233 @@
+//
+// flight_recorder.hpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_FLIGHT_RECORDER_HPP
+#define URDL_FLIGHT_RECORDER_HPP
+
+#include <cstddef>
+#include <iosfwd>
+#include <boost/cstdint.hpp>
+#include <boost/system/error_code.hpp>
+#include "urdl/detail/config.hpp"
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+
+/// The class @c flight_recorder retains the most recent events generated by
+/// the stream implementations, for post-mortem analysis.
+/**
+ * @par Remarks
+ * Each thread that records an event is given its own fixed-size ring buffer,
+ * holding the last @c capacity events seen on that thread. Once a thread's
+ * buffer exists, recording an event does not lock, allocate or make a system
+ * call. Writers never wait for readers, so a @c dump that runs concurrently
+ * with recording discards any events that may have been overwritten while
+ * they were being copied.
+ *
+ * Recording is on by default, and may be switched off and on at run time
+ * using @c enabled. When it is off, recording an event costs a single load. To
+ * remove the recording hooks from the stream implementations entirely,
+ * compile the program with @c URDL_DISABLE_FLIGHT_RECORDER defined, in which
+ * case @c dump writes a file containing no events.
+ *
+ * When a thread exits, its events remain available to @c dump until its
+ * buffer is reused by a thread that starts recording later. On Windows,
+ * buffers are not reused.
+ *
+ * The dump format is a @c file_header, followed by @c file_header::threads
+ * blocks, each consisting of a @c thread_header and @c thread_header::events
+ * objects of type @c event. All values are in the byte order of the machine
+ * that performed the dump.
+ *
+ * @par Example
+ * To save the recorded events when a slow request is detected:
+ * @code
+ * if (elapsed > boost::posix_time::seconds(1))
+ * {
+ *   std::ofstream os("urdl.fr", std::ios_base::out | std::ios_base::binary);
+ *   urdl::flight_recorder::dump(os);
+ * }
+ * @endcode
+ *
+ * @par Requirements
+ * @e Header: @c <urdl/flight_recorder.hpp> @n
+ * @e Namespace: @c urdl
+ */
+class flight_recorder
+{
+public:
+  /// The number of events retained for each thread.
+  enum { capacity = 4096 };
+
+  /// Identifies the point in an operation at which an event was recorded.
+  enum stage_type
+  {
+    /// An open operation has started.
+    open_start = 1,
+
+    /// A connection to the server has been established.
+    connected = 2,
+
+    /// The SSL handshake has completed.
+    handshake_complete = 3,
+
+    /// The request has been sent to the server.
+    request_sent = 4,
+
+    /// The response status line has been received.
+    status_received = 5,
+
+    /// The response headers have been received.
+    headers_received = 6,
+
+    /// An open operation has completed.
+    open_complete = 7,
+
+    /// The stream is following a redirect.
+    redirect = 8,
+
+    /// A read operation has completed.
+    read_complete = 9,
+
+    /// The stream has been closed.
+    close = 10
+  };
+
+  /// Identifies the category of the error code stored in an event.
+  enum error_category_type
+  {
+    /// The operation succeeded.
+    no_error = 0,
+
+    /// @c boost::system::system_category().
+    system_error = 1,
+
+    /// @c urdl::http::error_category().
+    http_error = 2,
+
+    /// One of the Boost.Asio netdb, addrinfo or misc categories.
+    asio_error = 3,
+
+    /// Any other category.
+    other_error = 255
+  };
+
+  /// The binary representation of a recorded event.
+  struct event
+  {
+    /// The time at which the event was recorded, in ticks.
+    boost::uint64_t timestamp;
+
+    /// The number of bytes transferred by the operation, if any.
+    boost::uint64_t bytes;
+
+    /// An opaque value identifying the stream that recorded the event.
+    boost::uint64_t stream;
+
+    /// A value of type @c stage_type.
+    boost::uint16_t stage;
+
+    /// A value of type @c error_category_type.
+    boost::uint16_t category;
+
+    /// The value of the error code.
+    boost::int32_t error;
+  };
+
+  /// The header at the start of a dump.
+  struct file_header
+  {
+    /// Contains the characters "URDLFR1" and a terminating null.
+    char magic[8];
+
+    /// The value of @c sizeof(event) on the recording machine.
+    boost::uint32_t event_size;
+
+    /// The number of thread blocks that follow the header.
+    boost::uint32_t threads;
+
+    /// The number of ticks per second used for event timestamps.
+    boost::uint64_t ticks_per_second;
+
+    /// The tick count at the time of the dump.
+    boost::uint64_t dump_ticks;
+
+    /// The wall clock time of the dump, in microseconds since the epoch.
+    boost::uint64_t dump_time;
+  };
+
+  /// The header at the start of each thread block in a dump.
+  struct thread_header
+  {
+    /// A value identifying the thread, in order of first recorded event.
+    boost::uint32_t thread;
+
+    /// The number of events that follow, oldest first.
+    boost::uint32_t events;
+  };
+
+  /// Records an event in the calling thread's ring buffer.
+  /**
+   * @param stream A value identifying the stream that is recording the event.
+   *
+   * @param stage The point in the operation at which the event occurred.
+   *
+   * @param bytes The number of bytes transferred, if any.
+   *
+   * @param ec The result of the operation, if any.
+   */
+  URDL_DECL static void record(const void* stream, stage_type stage,
+      std::size_t bytes, const boost::system::error_code& ec);
+
+  /// Determines whether events are being recorded.
+  /**
+   * @returns @c true if events are recorded, @c false otherwise. The default
+   * is @c true.
+   */
+  URDL_DECL static bool enabled();
+
+  /// Switches the recording of events on or off.
+  /**
+   * @param value @c true to record events, @c false to discard them.
+   */
+  URDL_DECL static void enabled(bool value);
+
+  /// Writes the events recorded by all threads to a stream.
+  /**
+   * @param os The stream to which the events will be written. It should be
+   * opened in binary mode.
+   */
+  URDL_DECL static void dump(std::ostream& os);
+
+  /// Gets a printable name for a stage.
+  /**
+   * @returns A string containing the name of the enumerator, or "unknown".
+   */
+  URDL_DECL static const char* stage_name(int stage);
+};
+
+} // namespace urdl
+
+#if !defined(URDL_DISABLE_FLIGHT_RECORDER)
+# define URDL_FLIGHT_RECORD(stream, stage, bytes, ec) \
+  ::urdl::flight_recorder::record(stream, \
+      ::urdl::flight_recorder::stage, bytes, ec)
+#else // !defined(URDL_DISABLE_FLIGHT_RECORDER)
+# define URDL_FLIGHT_RECORD(stream, stage, bytes, ec) ((void)(bytes))
+#endif // !defined(URDL_DISABLE_FLIGHT_RECORDER)
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#if defined(URDL_HEADER_ONLY)
+# include "urdl/impl/flight_recorder.ipp"
+#endif
+
+#endif // URDL_FLIGHT_RECORDER_HPP
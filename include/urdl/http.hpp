@@ -12,6 +12,7 @@
 #define URDL_HTTP_HPP
 
 #include <string>
+#include <boost/cstdint.hpp>
 #include <boost/system/error_code.hpp>
 #include "urdl/detail/config.hpp"
 
@@ -412,6 +413,111 @@ private:
   std::string value_;
 };
 
+/// Option to request a range of bytes from the content.
+/**
+ * @par Remarks
+ * The default is to request the entire content. When a range is specified,
+ * the request includes a @c Range header, and the server's
+ * "206 Partial Content" response is treated as success. The
+ * @c content_length() of the stream is then the length of the range.
+ *
+ * If the range does not start at the beginning of the content and the server
+ * responds with the entire content, or if the @c Content-Range header of a
+ * partial response does not start at the first byte of the range, the open
+ * operation fails with @c urdl::http::errc::range_not_supported.
+ *
+ * @par Example
+ * To read the last 1024 bytes of a 1MB resource using an object of class
+ * @c urdl::read_stream:
+ * @code
+ * urdl::read_stream stream;
+ * stream.set_option(urdl::http::byte_range(1047552, 1048575));
+ * stream.open("http://www.example.com/data.bin");
+ * @endcode
+ *
+ * @par Requirements
+ * @e Header: @c <urdl/http.hpp> @n
+ * @e Namespace: @c urdl::http
+ */
+class byte_range
+{
+public:
+  /// Constructs an object of class @c byte_range.
+  /**
+   * @par Remarks
+   * Postconditions: <tt>first() == 0</tt>,
+   * <tt>last() == std::numeric_limits<boost::uint64_t>::max()</tt>.
+   */
+  byte_range()
+    : first_(0),
+      last_(~boost::uint64_t(0))
+  {
+  }
+
+  /// Constructs an object of class @c byte_range.
+  /**
+   * @param first The offset of the first byte to be requested.
+   *
+   * @param last The offset of the last byte to be requested. The default
+   * requests all of the content from @c first onwards.
+   *
+   * @par Remarks
+   * Postconditions: <tt>first() == first</tt>, <tt>last() == last</tt>.
+   */
+  explicit byte_range(boost::uint64_t first,
+      boost::uint64_t last = ~boost::uint64_t(0))
+    : first_(first),
+      last_(last)
+  {
+  }
+
+  /// Gets the offset of the first byte to be requested.
+  boost::uint64_t first() const
+  {
+    return first_;
+  }
+
+  /// Sets the offset of the first byte to be requested.
+  /**
+   * @param v The desired value for the offset.
+   *
+   * @par Remarks
+   * Postcondition: <tt>first() == v</tt>
+   */
+  void first(boost::uint64_t v)
+  {
+    first_ = v;
+  }
+
+  /// Gets the offset of the last byte to be requested.
+  boost::uint64_t last() const
+  {
+    return last_;
+  }
+
+  /// Sets the offset of the last byte to be requested.
+  /**
+   * @param v The desired value for the offset.
+   *
+   * @par Remarks
+   * Postcondition: <tt>last() == v</tt>
+   */
+  void last(boost::uint64_t v)
+  {
+    last_ = v;
+  }
+
+  /// Determines whether the option requests less than the entire content.
+  bool is_partial() const
+  {
+    return first_ != 0 || last_ != ~boost::uint64_t(0);
+  }
+
+private:
+  boost::uint64_t first_;
+  boost::uint64_t last_;
+};
+
 namespace errc {
 
 /// HTTP error codes.
@@ -433,6 +539,10 @@ enum errc_t
   /// The response's headers were malformed.
   malformed_response_headers = 2,
 
+  /// The server responded to a request for a byte range with the entire
+  /// content, or with a different range.
+  range_not_supported = 3,
+
   // Server-generated status codes.
 
   /// The server-generated status code "100 Continue".
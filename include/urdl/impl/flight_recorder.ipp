@@ -0,0 +1,405 @@
+//
+// flight_recorder.ipp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_IMPL_FLIGHT_RECORDER_IPP
+#define URDL_IMPL_FLIGHT_RECORDER_IPP
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/detail/static_mutex.hpp>
+#include <boost/asio/detail/tss_ptr.hpp>
+#include "urdl/http.hpp"
+
+#if defined(BOOST_WINDOWS)
+# include <windows.h>
+#else // defined(BOOST_WINDOWS)
+# include <pthread.h>
+# include <sys/time.h>
+# include <time.h>
+#endif // defined(BOOST_WINDOWS)
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+namespace detail {
+
+struct flight_recorder_ring
+{
+  explicit flight_recorder_ring(boost::uint32_t thread)
+    : thread_(thread),
+      in_use_(true),
+      start_(0),
+      head_(0),
+      next_(0)
+  {
+  }
+
+  // The owning thread, whether the ring has an owner, and the index of the
+  // owner's first event. These are protected by the registry's mutex.
+  boost::uint32_t thread_;
+  bool in_use_;
+  boost::uint64_t start_;
+
+  boost::atomic<boost::uint64_t> head_;
+  flight_recorder::event events_[flight_recorder::capacity];
+  flight_recorder_ring* next_;
+};
+
+// Rings are never freed, so that the events recorded by threads that have
+// since exited are still available to a dump. Where the exit of a thread can
+// be detected, its ring is handed to the next thread that records an event, so
+// that the number of rings is bounded by the peak number of recording threads.
+template <typename T = void>
+struct flight_recorder_registry
+{
+  static boost::asio::detail::static_mutex mutex_;
+  static flight_recorder_ring* first_;
+  static boost::uint32_t threads_;
+  static boost::uint64_t reference_ticks_;
+  static boost::uint64_t reference_nanoseconds_;
+  static boost::asio::detail::tss_ptr<flight_recorder_ring> current_;
+  static boost::atomic<bool> enabled_;
+#if !defined(BOOST_WINDOWS)
+  static bool exit_key_created_;
+  static pthread_key_t exit_key_;
+#endif // !defined(BOOST_WINDOWS)
+};
+
+template <typename T>
+boost::asio::detail::static_mutex flight_recorder_registry<T>::mutex_
+  = BOOST_ASIO_STATIC_MUTEX_INIT;
+
+template <typename T>
+flight_recorder_ring* flight_recorder_registry<T>::first_ = 0;
+
+template <typename T>
+boost::uint32_t flight_recorder_registry<T>::threads_ = 0;
+
+template <typename T>
+boost::uint64_t flight_recorder_registry<T>::reference_ticks_ = 0;
+
+template <typename T>
+boost::uint64_t flight_recorder_registry<T>::reference_nanoseconds_ = 0;
+
+template <typename T>
+boost::asio::detail::tss_ptr<flight_recorder_ring>
+flight_recorder_registry<T>::current_;
+
+template <typename T>
+boost::atomic<bool> flight_recorder_registry<T>::enabled_(true);
+
+#if !defined(BOOST_WINDOWS)
+template <typename T>
+bool flight_recorder_registry<T>::exit_key_created_ = false;
+
+template <typename T>
+pthread_key_t flight_recorder_registry<T>::exit_key_;
+
+// Called when a thread that owns a ring exits.
+extern "C" inline void urdl_flight_recorder_release_ring(void* p)
+{
+  typedef flight_recorder_registry<> registry;
+  boost::asio::detail::static_mutex::scoped_lock lock(registry::mutex_);
+  static_cast<flight_recorder_ring*>(p)->in_use_ = false;
+}
+#endif // !defined(BOOST_WINDOWS)
+
+inline boost::uint64_t flight_recorder_nanoseconds()
+{
+#if defined(BOOST_WINDOWS)
+  LARGE_INTEGER counter, frequency;
+  ::QueryPerformanceCounter(&counter);
+  ::QueryPerformanceFrequency(&frequency);
+  return static_cast<boost::uint64_t>(
+      counter.QuadPart * (1000000000.0 / frequency.QuadPart));
+#else // defined(BOOST_WINDOWS)
+  timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<boost::uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif // defined(BOOST_WINDOWS)
+}
+
+// Reading the time stamp counter is several times cheaper than asking the
+// operating system for the time. The counter is converted to real time at
+// dump time.
+inline boost::uint64_t flight_recorder_ticks()
+{
+#if defined(BOOST_WINDOWS)
+  LARGE_INTEGER counter;
+  ::QueryPerformanceCounter(&counter);
+  return counter.QuadPart;
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+  return __builtin_ia32_rdtsc();
+#else
+  return flight_recorder_nanoseconds();
+#endif
+}
+
+inline boost::uint64_t flight_recorder_ticks_per_second()
+{
+#if defined(BOOST_WINDOWS)
+  LARGE_INTEGER frequency;
+  ::QueryPerformanceFrequency(&frequency);
+  return frequency.QuadPart;
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+  typedef flight_recorder_registry<> registry;
+
+  // Measure the counter against the monotonic clock over at least 10ms,
+  // starting from the point at which the first ring was created.
+  boost::uint64_t start_ns = registry::reference_nanoseconds_;
+  boost::uint64_t start_ticks = registry::reference_ticks_;
+  if (start_ns == 0)
+  {
+    start_ns = flight_recorder_nanoseconds();
+    start_ticks = flight_recorder_ticks();
+  }
+  boost::uint64_t now_ns = flight_recorder_nanoseconds();
+  while (now_ns - start_ns < 10000000)
+    now_ns = flight_recorder_nanoseconds();
+  boost::uint64_t now_ticks = flight_recorder_ticks();
+  return static_cast<boost::uint64_t>((now_ticks - start_ticks)
+      * (1000000000.0 / (now_ns - start_ns)));
+#else
+  return 1000000000;
+#endif
+}
+
+inline boost::uint64_t flight_recorder_wall_time()
+{
+#if defined(BOOST_WINDOWS)
+  FILETIME ft;
+  ::GetSystemTimeAsFileTime(&ft);
+  boost::uint64_t t = (static_cast<boost::uint64_t>(ft.dwHighDateTime) << 32)
+    | ft.dwLowDateTime;
+  return t / 10 - 11644473600000000ULL;
+#else // defined(BOOST_WINDOWS)
+  timeval tv;
+  ::gettimeofday(&tv, 0);
+  return static_cast<boost::uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+#endif // defined(BOOST_WINDOWS)
+}
+
+inline flight_recorder_ring* flight_recorder_create_ring()
+{
+  typedef flight_recorder_registry<> registry;
+  registry::mutex_.init();
+  boost::asio::detail::static_mutex::scoped_lock lock(registry::mutex_);
+
+  // Take over the ring of a thread that has exited, if there is one. Its head
+  // is not reset, as a dump may be reading it, but its previous events are no
+  // longer included in dumps.
+  flight_recorder_ring* ring = 0;
+  flight_recorder_ring** link = &registry::first_;
+  for (; *link; link = &(*link)->next_)
+  {
+    if (!ring && !(*link)->in_use_)
+    {
+      ring = *link;
+      ring->thread_ = registry::threads_++;
+      ring->in_use_ = true;
+      ring->start_ = ring->head_.load(boost::memory_order_relaxed);
+    }
+  }
+
+  if (!ring)
+  {
+    ring = new flight_recorder_ring(registry::threads_++);
+    std::memset(ring->events_, 0, sizeof(ring->events_));
+    if (registry::reference_ticks_ == 0)
+    {
+      registry::reference_nanoseconds_ = flight_recorder_nanoseconds();
+      registry::reference_ticks_ = flight_recorder_ticks();
+    }
+
+    // Append to the list so that dumps list threads in order of creation.
+    *link = ring;
+  }
+
+#if !defined(BOOST_WINDOWS)
+  if (!registry::exit_key_created_)
+  {
+    registry::exit_key_created_ = ::pthread_key_create(&registry::exit_key_,
+        urdl_flight_recorder_release_ring) == 0;
+  }
+  if (registry::exit_key_created_)
+    ::pthread_setspecific(registry::exit_key_, ring);
+#endif // !defined(BOOST_WINDOWS)
+
+  registry::current_ = ring;
+  return ring;
+}
+
+struct flight_recorder_snapshot
+{
+  flight_recorder_ring* ring;
+  boost::uint32_t thread;
+  boost::uint64_t start;
+  boost::uint64_t end;
+};
+
+inline boost::uint16_t flight_recorder_category(
+    const boost::system::error_code& ec)
+{
+  if (!ec)
+    return flight_recorder::no_error;
+  if (ec.category() == boost::system::system_category())
+    return flight_recorder::system_error;
+  if (ec.category() == http::error_category())
+    return flight_recorder::http_error;
+  if (ec.category() == boost::asio::error::get_netdb_category()
+      || ec.category() == boost::asio::error::get_addrinfo_category()
+      || ec.category() == boost::asio::error::get_misc_category())
+    return flight_recorder::asio_error;
+  return flight_recorder::other_error;
+}
+
+} // namespace detail
+
+void flight_recorder::record(const void* stream, stage_type stage,
+    std::size_t bytes, const boost::system::error_code& ec)
+{
+  typedef detail::flight_recorder_registry<> registry;
+  if (!registry::enabled_.load(boost::memory_order_relaxed))
+    return;
+
+  detail::flight_recorder_ring* ring = registry::current_;
+  if (!ring)
+    ring = detail::flight_recorder_create_ring();
+
+  // Only this thread writes to the ring, so the head can be read without
+  // synchronisation. The fence orders the publication of the previous head
+  // before the writes to the slot, so that a dump that sees the slot being
+  // overwritten also sees the head that tells it to discard the slot.
+  // Publishing the new head with release semantics ensures that a concurrent
+  // dump sees the complete event.
+  boost::uint64_t head = ring->head_.load(boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  event& e = ring->events_[head % capacity];
+  e.timestamp = detail::flight_recorder_ticks();
+  e.bytes = bytes;
+  e.stream = reinterpret_cast<std::size_t>(stream);
+  e.stage = static_cast<boost::uint16_t>(stage);
+  e.category = detail::flight_recorder_category(ec);
+  e.error = ec.value();
+  ring->head_.store(head + 1, boost::memory_order_release);
+}
+
+bool flight_recorder::enabled()
+{
+  typedef detail::flight_recorder_registry<> registry;
+  return registry::enabled_.load(boost::memory_order_relaxed);
+}
+
+void flight_recorder::enabled(bool value)
+{
+  typedef detail::flight_recorder_registry<> registry;
+  registry::enabled_.store(value, boost::memory_order_relaxed);
+}
+
+void flight_recorder::dump(std::ostream& os)
+{
+  typedef detail::flight_recorder_registry<> registry;
+
+  file_header header;
+  std::memcpy(header.magic, "URDLFR1", sizeof(header.magic));
+  header.event_size = sizeof(event);
+  header.ticks_per_second = detail::flight_recorder_ticks_per_second();
+
+  // Take a copy of the list of rings, together with the owner of each ring
+  // and the range of events recorded by that owner. Rings with no events from
+  // their current owner are left out. New rings are only ever appended.
+  std::vector<detail::flight_recorder_snapshot> rings;
+  {
+    registry::mutex_.init();
+    boost::asio::detail::static_mutex::scoped_lock lock(registry::mutex_);
+    for (detail::flight_recorder_ring* r = registry::first_; r; r = r->next_)
+    {
+      detail::flight_recorder_snapshot snapshot = { r, r->thread_, r->start_,
+        r->head_.load(boost::memory_order_acquire) };
+      if (snapshot.end != snapshot.start)
+        rings.push_back(snapshot);
+    }
+  }
+
+  header.threads = static_cast<boost::uint32_t>(rings.size());
+  header.dump_ticks = detail::flight_recorder_ticks();
+  header.dump_time = detail::flight_recorder_wall_time();
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  std::vector<event> events(capacity);
+  for (std::size_t i = 0; i < rings.size(); ++i)
+  {
+    detail::flight_recorder_ring* r = rings[i].ring;
+
+    boost::uint64_t end = rings[i].end;
+    boost::uint64_t begin = end - rings[i].start > capacity
+      ? end - capacity : rings[i].start;
+    for (boost::uint64_t n = begin; n != end; ++n)
+      events[n - begin] = r->events_[n % capacity];
+
+    // Discard any events that the owning thread may have overwritten while
+    // they were being copied. This includes the slot currently being written.
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    boost::uint64_t new_end = r->head_.load(boost::memory_order_relaxed);
+    boost::uint64_t skip = 0;
+    if (new_end + 1 > begin + capacity)
+      skip = std::min<boost::uint64_t>(new_end + 1 - begin - capacity,
+          end - begin);
+
+    thread_header th;
+    th.thread = rings[i].thread;
+    th.events = static_cast<boost::uint32_t>(end - begin - skip);
+    os.write(reinterpret_cast<const char*>(&th), sizeof(th));
+    if (th.events)
+      os.write(reinterpret_cast<const char*>(&events[skip]),
+          th.events * sizeof(event));
+  }
+
+  os.flush();
+}
+
+const char* flight_recorder::stage_name(int stage)
+{
+  switch (stage)
+  {
+  case open_start:
+    return "open_start";
+  case connected:
+    return "connected";
+  case handshake_complete:
+    return "handshake_complete";
+  case request_sent:
+    return "request_sent";
+  case status_received:
+    return "status_received";
+  case headers_received:
+    return "headers_received";
+  case open_complete:
+    return "open_complete";
+  case redirect:
+    return "redirect";
+  case read_complete:
+    return "read_complete";
+  case close:
+    return "close";
+  default:
+    return "unknown";
+  }
+}
+
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // URDL_IMPL_FLIGHT_RECORDER_IPP
@@ -35,6 +35,8 @@ class error_category_impl
       return "Malformed status line";
     case http::errc::malformed_response_headers:
       return "Malformed response headers";
+    case http::errc::range_not_supported:
+      return "Byte range not supported";
     case http::errc::continue_request:
       return "Continue";
     case http::errc::switching_protocols:
@@ -0,0 +1,80 @@
+//
+// io_engine.ipp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_IMPL_IO_ENGINE_IPP
+#define URDL_IMPL_IO_ENGINE_IPP
+
+#include <vector>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/detail/thread.hpp>
+#include "urdl/detail/scoped_ptr.hpp"
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+
+struct io_engine::body
+{
+  struct runner
+  {
+    boost::asio::io_service* io_service_;
+
+    void operator()()
+    {
+      io_service_->run();
+    }
+  };
+
+  explicit body(std::size_t threads)
+    : work_(new boost::asio::io_service::work(io_service_))
+  {
+    for (std::size_t i = 0; i < (threads > 0 ? threads : 1); ++i)
+    {
+      runner r = { &io_service_ };
+      threads_.push_back(new boost::asio::detail::thread(r));
+    }
+  }
+
+  ~body()
+  {
+    work_.reset();
+    io_service_.stop();
+    for (std::size_t i = 0; i < threads_.size(); ++i)
+    {
+      threads_[i]->join();
+      delete threads_[i];
+    }
+  }
+
+  boost::asio::io_service io_service_;
+  detail::scoped_ptr<boost::asio::io_service::work> work_;
+  std::vector<boost::asio::detail::thread*> threads_;
+};
+
+io_engine::io_engine(std::size_t threads)
+  : body_(new body(threads))
+{
+}
+
+io_engine::~io_engine()
+{
+  delete body_;
+}
+
+std::size_t io_engine::thread_count() const
+{
+  return body_->threads_.size();
+}
+
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // URDL_IMPL_IO_ENGINE_IPP
@@ -11,37 +11,168 @@
 #ifndef URDL_IMPL_ISTREAMBUF_IPP
 #define URDL_IMPL_ISTREAMBUF_IPP
 
-#include <boost/array.hpp>
+#include <utility>
+#include <vector>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/detail/event.hpp>
+#include <boost/asio/detail/mutex.hpp>
 #include <boost/system/system_error.hpp>
 #include <boost/throw_exception.hpp>
+#include "urdl/io_engine.hpp"
 #include "urdl/read_stream.hpp"
+#include "urdl/detail/scoped_ptr.hpp"
 
 #include "urdl/detail/abi_prefix.hpp"
 
 namespace urdl {
 
+namespace detail
+{
+  // Waits for the handlers of an open or read operation to complete. With a
+  // private io_service, the io_service is simply run on the calling thread.
+  // With an io_engine, the calling thread blocks until the engine's threads
+  // have invoked every expected handler.
+  class istreambuf_waiter
+  {
+  public:
+    explicit istreambuf_waiter(boost::asio::io_service* io_service)
+      : io_service_(io_service),
+        pending_(0)
+    {
+    }
+
+    // Notes that the given number of handlers are about to be started.
+    void expect(std::size_t handlers)
+    {
+      if (!io_service_)
+      {
+        boost::asio::detail::mutex::scoped_lock lock(mutex_);
+        pending_ += handlers;
+      }
+    }
+
+    // Called at the end of each handler.
+    void complete()
+    {
+      if (!io_service_)
+      {
+        boost::asio::detail::mutex::scoped_lock lock(mutex_);
+        if (--pending_ == 0)
+          event_.signal(lock);
+      }
+    }
+
+    void wait()
+    {
+      if (io_service_)
+      {
+        io_service_->reset();
+        io_service_->run();
+      }
+      else
+      {
+        boost::asio::detail::mutex::scoped_lock lock(mutex_);
+        while (pending_ > 0)
+        {
+          event_.clear(lock);
+          event_.wait(lock);
+        }
+      }
+    }
+
+  private:
+    boost::asio::io_service* io_service_;
+    boost::asio::detail::mutex mutex_;
+    boost::asio::detail::event event_;
+    std::size_t pending_;
+  };
+} // namespace detail
+
 struct istreambuf::body
 {
   enum { putback_max = 8 };
-  enum { buffer_size = 512 };
-
-  body()
-    : read_stream_(io_service_),
-      timer_(io_service_),
+  enum { default_buffer_size = 512 };
+
+  explicit body(boost::asio::io_service* engine_io_service = 0)
+    : get_buffer_(putback_max + default_buffer_size),
+      io_service_(engine_io_service ? 0 : new boost::asio::io_service),
+      waiter_(io_service_.get()),
+      read_stream_(engine_io_service ? *engine_io_service : *io_service_),
+      timer_(engine_io_service ? *engine_io_service : *io_service_),
+      strand_(engine_io_service ? *engine_io_service : *io_service_),
       open_timeout_(300 * 1000),
-      read_timeout_(300 * 1000)
+      read_timeout_(300 * 1000),
+      buffer_size_(default_buffer_size),
+      max_buffer_size_(default_buffer_size),
+      read_size_(default_buffer_size),
+      read_ahead_(false),
+      ahead_pending_(false),
+      ahead_complete_(false),
+      ahead_size_(0),
+      ahead_bytes_(0),
+      position_(0),
+      end_(~boost::uint64_t(0)),
+      at_end_(false)
   {
   }
 
-  boost::array<char, buffer_size> get_buffer_;
-  boost::asio::io_service io_service_;
+  // Opens the URL, waiting no longer than the open timeout.
+  boost::system::error_code open_url(const url& u);
+
+  // Starts a read into the second buffer, to be collected by the next call to
+  // underflow(). No timeout applies until the read is waited for.
+  void start_read_ahead();
+
+  // Waits for the read started by start_read_ahead() to complete.
+  void wait_read_ahead();
+
+  // Abandons any read started by start_read_ahead(), closing the stream.
+  void cancel_read_ahead();
+
+  // Returns the io_service of the io_engine in use, or 0 if there is none.
+  boost::asio::io_service* engine_io_service()
+  {
+    return io_service_.get() ? 0 : &read_stream_.get_io_service();
+  }
+
+  std::vector<char> get_buffer_;
+
+  // The io_service on which operations are run by the calling thread. Not
+  // created when the stream buffer uses an io_engine.
+  detail::scoped_ptr<boost::asio::io_service> io_service_;
+
+  detail::istreambuf_waiter waiter_;
   boost::system::error_code error_;
   read_stream read_stream_;
   boost::asio::deadline_timer timer_;
+  boost::asio::io_service::strand strand_;
   std::size_t open_timeout_;
   std::size_t read_timeout_;
+  std::size_t buffer_size_;
+  std::size_t max_buffer_size_;
+  std::size_t read_size_;
+  bool read_ahead_;
+  std::vector<char> ahead_buffer_;
+  bool ahead_pending_;
+  bool ahead_complete_;
+  boost::system::error_code ahead_error_;
+  std::size_t ahead_size_;
+  std::size_t ahead_bytes_;
+
+  // The URL that was opened, and the byte range that was requested for it.
+  url url_;
+  http::byte_range range_;
+
+  // The offset within the content of the end of the get area, and of the end
+  // of the content, if known.
+  boost::uint64_t position_;
+  boost::uint64_t end_;
+
+  // Set when the stream has been positioned at the end of the content without
+  // moving the underlying transport.
+  bool at_end_;
 };
 
 namespace detail
@@ -50,10 +181,12 @@ namespace detail
   {
     boost::system::error_code& error_;
     boost::asio::deadline_timer& timer_;
+    istreambuf_waiter& waiter_;
     void operator()(boost::system::error_code ec)
     {
       error_ = ec;
       timer_.cancel();
+      waiter_.complete();
     }
   };
 
@@ -62,35 +195,233 @@ namespace detail
     boost::system::error_code& error_;
     std::size_t& bytes_transferred_;
     boost::asio::deadline_timer& timer_;
+    istreambuf_waiter& waiter_;
     void operator()(boost::system::error_code ec, std::size_t bytes_transferred)
     {
       error_ = ec;
       bytes_transferred_ = bytes_transferred;
       timer_.cancel();
+      waiter_.complete();
     }
   };
 
+  struct istreambuf_read_direct_handler
+  {
+    boost::system::error_code& error_;
+    std::size_t& bytes_transferred_;
+    read_stream& read_stream_;
+    boost::asio::deadline_timer& timer_;
+    boost::asio::io_service::strand& strand_;
+    istreambuf_waiter& waiter_;
+    std::size_t read_timeout_;
+    char* data_;
+    std::size_t length_;
+    void operator()(boost::system::error_code ec,
+        std::size_t bytes_transferred);
+  };
+
   struct istreambuf_timeout_handler
   {
     read_stream& read_stream_;
+    istreambuf_waiter& waiter_;
     void operator()(boost::system::error_code ec)
     {
       if (ec != boost::asio::error::operation_aborted)
         read_stream_.close(ec);
+      waiter_.complete();
     }
   };
+
+  struct istreambuf_read_ahead_handler
+  {
+    boost::system::error_code& error_;
+    std::size_t& bytes_transferred_;
+    bool& complete_;
+    boost::asio::deadline_timer& timer_;
+    istreambuf_waiter& waiter_;
+    void operator()(boost::system::error_code ec, std::size_t bytes_transferred)
+    {
+      error_ = ec;
+      bytes_transferred_ = bytes_transferred;
+      complete_ = true;
+      timer_.cancel();
+      waiter_.complete();
+    }
+  };
+
+  // Arms the read timeout for a read ahead, unless the read has already
+  // completed. Runs in the strand, so that the check cannot race with the
+  // read's handler.
+  struct istreambuf_read_ahead_timeout_handler
+  {
+    bool& complete_;
+    read_stream& read_stream_;
+    boost::asio::deadline_timer& timer_;
+    boost::asio::io_service::strand& strand_;
+    istreambuf_waiter& waiter_;
+    std::size_t read_timeout_;
+    void operator()()
+    {
+      if (!complete_)
+      {
+        waiter_.expect(1);
+        istreambuf_timeout_handler th = { read_stream_, waiter_ };
+        timer_.expires_from_now(
+            boost::posix_time::milliseconds(read_timeout_));
+        timer_.async_wait(strand_.wrap(th));
+      }
+      waiter_.complete();
+    }
+  };
+
+  struct istreambuf_close_handler
+  {
+    read_stream& read_stream_;
+    istreambuf_waiter& waiter_;
+    void operator()()
+    {
+      boost::system::error_code ec;
+      read_stream_.close(ec);
+      waiter_.complete();
+    }
+  };
+
+  // Keeps reading until the destination is full, restarting the read timeout
+  // for each read, all within a single wait for completion.
+  inline void istreambuf_read_direct_handler::operator()(
+      boost::system::error_code ec, std::size_t bytes_transferred)
+  {
+    error_ = ec;
+    bytes_transferred_ += bytes_transferred;
+    if (!ec && bytes_transferred_ < length_)
+    {
+      // Rearming the timer aborts the previous wait, whose handler is still
+      // to be invoked.
+      waiter_.expect(2);
+      istreambuf_timeout_handler th = { read_stream_, waiter_ };
+      timer_.expires_from_now(
+          boost::posix_time::milliseconds(read_timeout_));
+      timer_.async_wait(strand_.wrap(th));
+      read_stream_.async_read_some(boost::asio::buffer(
+            data_ + bytes_transferred_, length_ - bytes_transferred_),
+          strand_.wrap(*this));
+    }
+    else
+    {
+      timer_.cancel();
+    }
+    waiter_.complete();
+  }
 } // namespace detail
 
+inline boost::system::error_code istreambuf::body::open_url(const url& u)
+{
+  waiter_.expect(2);
+
+  detail::istreambuf_timeout_handler th = { read_stream_, waiter_ };
+  timer_.expires_from_now(boost::posix_time::milliseconds(open_timeout_));
+  timer_.async_wait(strand_.wrap(th));
+
+  detail::istreambuf_open_handler oh = { error_, timer_, waiter_ };
+  read_stream_.async_open(u, strand_.wrap(oh));
+
+  waiter_.wait();
+
+  if (!read_stream_.is_open())
+    error_ = make_error_code(boost::system::errc::timed_out);
+
+  return error_;
+}
+
+inline void istreambuf::body::start_read_ahead()
+{
+  if (ahead_buffer_.size() != putback_max + read_size_)
+    ahead_buffer_.resize(putback_max + read_size_);
+  ahead_size_ = read_size_;
+  ahead_bytes_ = 0;
+  ahead_complete_ = false;
+  ahead_pending_ = true;
+
+  waiter_.expect(1);
+  detail::istreambuf_read_ahead_handler rh = { ahead_error_, ahead_bytes_,
+    ahead_complete_, timer_, waiter_ };
+  read_stream_.async_read_some(boost::asio::buffer(
+        &ahead_buffer_[putback_max], ahead_size_), strand_.wrap(rh));
+}
+
+inline void istreambuf::body::wait_read_ahead()
+{
+  waiter_.expect(1);
+  detail::istreambuf_read_ahead_timeout_handler th = { ahead_complete_,
+    read_stream_, timer_, strand_, waiter_, read_timeout_ };
+  strand_.post(th);
+  waiter_.wait();
+  ahead_pending_ = false;
+}
+
+inline void istreambuf::body::cancel_read_ahead()
+{
+  if (ahead_pending_)
+  {
+    waiter_.expect(1);
+    detail::istreambuf_close_handler ch = { read_stream_, waiter_ };
+    strand_.post(ch);
+    waiter_.wait();
+    ahead_pending_ = false;
+  }
+}
+
 istreambuf::istreambuf()
   : body_(new body)
 {
   init_buffers();
 }
 
+istreambuf::istreambuf(io_engine& engine)
+  : body_(new body(&engine.body_->io_service_))
+{
+  init_buffers();
+}
+
+#if defined(URDL_HAS_MOVE)
+istreambuf::istreambuf(istreambuf&& other)
+  : std::streambuf(other),
+    body_(new body(other.body_->engine_io_service()))
+{
+  // The get area lies within the body's buffer, which does not move. The
+  // other stream buffer is left with a fresh body on the same io_engine.
+  std::swap(body_, other.body_);
+  other.init_buffers();
+}
+
+istreambuf& istreambuf::operator=(istreambuf&& other)
+{
+  if (this != &other)
+  {
+    body* fresh_body = new body(other.body_->engine_io_service());
+    try
+    {
+      body_->cancel_read_ahead();
+    }
+    catch (std::exception&)
+    {
+      // Swallow the exception.
+    }
+    delete body_;
+    std::streambuf::operator=(other);
+    body_ = other.body_;
+    other.body_ = fresh_body;
+    other.init_buffers();
+  }
+  return *this;
+}
+#endif // defined(URDL_HAS_MOVE)
+
 istreambuf::~istreambuf()
 {
   try
   {
+    body_->cancel_read_ahead();
     delete body_;
   }
   catch (std::exception&)
@@ -114,24 +445,24 @@ istreambuf* istreambuf::open(const url& u)
   if (is_open())
     return 0;
 
+  body_->read_size_ = body_->buffer_size_;
   init_buffers();
   body_->read_stream_.close(body_->error_);
 
-  detail::istreambuf_open_handler oh = { body_->error_, body_->timer_ };
-  body_->read_stream_.async_open(u, oh);
-
-  detail::istreambuf_timeout_handler th = { body_->read_stream_ };
-  body_->timer_.expires_from_now(
-      boost::posix_time::milliseconds(body_->open_timeout_));
-  body_->timer_.async_wait(th);
+  body_->url_ = u;
+  body_->range_ = body_->read_stream_.get_options().get_option<
+    http::byte_range>();
+  body_->position_ = u.protocol() == "file" ? 0 : body_->range_.first();
+  body_->end_ = ~boost::uint64_t(0);
+  body_->at_end_ = false;
 
-  body_->io_service_.reset();
-  body_->io_service_.run();
-
-  if (!body_->read_stream_.is_open())
-    body_->error_ = make_error_code(boost::system::errc::timed_out);
+  if (body_->open_url(u))
+    return 0;
 
-  return !body_->error_ ? this : 0;
+  std::size_t length = body_->read_stream_.content_length();
+  if (length != ~std::size_t(0))
+    body_->end_ = body_->position_ + length;
+  return this;
 }
 
 bool istreambuf::is_open() const
@@ -144,6 +475,7 @@ istreambuf* istreambuf::close()
   if (!is_open())
     return 0;
 
+  body_->cancel_read_ahead();
   body_->read_stream_.close(body_->error_);
   if (!body_->error_)
     init_buffers();
@@ -175,6 +507,42 @@ void istreambuf::read_timeout(std::size_t milliseconds)
   body_->read_timeout_ = milliseconds;
 }
 
+std::size_t istreambuf::buffer_size() const
+{
+  return body_->buffer_size_;
+}
+
+void istreambuf::buffer_size(std::size_t bytes)
+{
+  body_->buffer_size_ = bytes > 0 ? bytes : 1;
+  body_->read_size_ = body_->buffer_size_;
+}
+
+std::size_t istreambuf::max_buffer_size() const
+{
+  return body_->max_buffer_size_;
+}
+
+void istreambuf::max_buffer_size(std::size_t bytes)
+{
+  body_->max_buffer_size_ = bytes;
+  if (body_->read_size_ > bytes)
+  {
+    body_->read_size_ = bytes > body_->buffer_size_
+      ? bytes : body_->buffer_size_;
+  }
+}
+
+bool istreambuf::read_ahead() const
+{
+  return body_->read_ahead_;
+}
+
+void istreambuf::read_ahead(bool enabled)
+{
+  body_->read_ahead_ = enabled;
+}
+
 std::string istreambuf::content_type() const
 {
   return body_->read_stream_.content_type();
@@ -192,25 +560,62 @@ std::string istreambuf::headers() const
 
 std::streambuf::int_type istreambuf::underflow()
 {
+  if (body_->at_end_)
+    return traits_type::eof();
+
   if (gptr() == egptr())
   {
     std::size_t bytes_transferred = 0;
-    detail::istreambuf_read_handler rh
-      = { body_->error_, bytes_transferred, body_->timer_ };
-    body_->read_stream_.async_read_some(boost::asio::buffer(
-          boost::asio::buffer(body_->get_buffer_) + body::putback_max), rh);
-
-    detail::istreambuf_timeout_handler th = { body_->read_stream_ };
-    body_->timer_.expires_from_now(
-        boost::posix_time::milliseconds(body_->read_timeout_));
-    body_->timer_.async_wait(th);
-
-    body_->io_service_.reset();
-    body_->io_service_.run();
+    std::size_t read_size = body_->read_size_;
+    std::size_t putback = body::putback_max;
+    std::size_t available = gptr() - eback();
+    putback = available < putback ? available : putback;
+    if (body_->ahead_pending_)
+    {
+      body_->wait_read_ahead();
+      body_->error_ = body_->ahead_error_;
+      bytes_transferred = body_->ahead_bytes_;
+      read_size = body_->ahead_size_;
+
+      // The second buffer becomes the get area. Carry over the tail of the
+      // current get area so that it is still available to sungetc().
+      traits_type::copy(&body_->ahead_buffer_[body::putback_max - putback],
+          gptr() - putback, putback);
+      body_->get_buffer_.swap(body_->ahead_buffer_);
+    }
+    else
+    {
+      // Move the tail of the get area to the putback area. The get area is
+      // empty, so the buffer may then be reallocated.
+      traits_type::move(&body_->get_buffer_[body::putback_max - putback],
+          gptr() - putback, putback);
+      if (body_->get_buffer_.size() != body::putback_max + read_size)
+        body_->get_buffer_.resize(body::putback_max + read_size);
+
+      body_->waiter_.expect(2);
+
+      detail::istreambuf_timeout_handler th
+        = { body_->read_stream_, body_->waiter_ };
+      body_->timer_.expires_from_now(
+          boost::posix_time::milliseconds(body_->read_timeout_));
+      body_->timer_.async_wait(body_->strand_.wrap(th));
+
+      detail::istreambuf_read_handler rh
+        = { body_->error_, bytes_transferred, body_->timer_, body_->waiter_ };
+      body_->read_stream_.async_read_some(boost::asio::buffer(
+            &body_->get_buffer_[body::putback_max], read_size),
+          body_->strand_.wrap(rh));
+
+      body_->waiter_.wait();
+    }
 
     if (!body_->read_stream_.is_open())
       body_->error_ = make_error_code(boost::system::errc::timed_out);
 
+    char* begin = &body_->get_buffer_[0];
+    setg(begin + body::putback_max - putback, begin + body::putback_max,
+        begin + body::putback_max);
+
     if (body_->error_)
     {
       if (body_->error_ == boost::asio::error::eof)
@@ -221,9 +626,23 @@ std::streambuf::int_type istreambuf::underflow()
       boost::throw_exception(boost::system::system_error(body_->error_));
     }
 
-    setg(body_->get_buffer_.begin(),
-        body_->get_buffer_.begin() + body::putback_max,
-        body_->get_buffer_.begin() + body::putback_max + bytes_transferred);
+    // A read that fills the buffer suggests that more content is waiting, so
+    // the next read is made larger.
+    if (bytes_transferred == read_size
+        && body_->read_size_ < body_->max_buffer_size_)
+    {
+      body_->read_size_ = body_->read_size_ < body_->max_buffer_size_ / 2
+        ? body_->read_size_ * 2 : body_->max_buffer_size_;
+    }
+
+    body_->position_ += bytes_transferred;
+    setg(begin + body::putback_max - putback, begin + body::putback_max,
+        begin + body::putback_max + bytes_transferred);
+
+    // Start the next read while the caller works through this one.
+    if (body_->read_ahead_)
+      body_->start_read_ahead();
+
     return traits_type::to_int_type(*gptr());
   }
   else
@@ -232,6 +651,139 @@ std::streambuf::int_type istreambuf::underflow()
   }
 }
 
+std::streamsize istreambuf::xsgetn(char_type* s, std::streamsize n)
+{
+  std::streamsize total = 0;
+  while (total < n)
+  {
+    std::streamsize available = egptr() - gptr();
+    if (available > 0)
+    {
+      std::streamsize length = available < n - total ? available : n - total;
+      traits_type::copy(s + total, gptr(), static_cast<std::size_t>(length));
+      gbump(static_cast<int>(length));
+      total += length;
+    }
+    else if (static_cast<std::size_t>(n - total) >= body_->read_size_
+        && !body_->ahead_pending_ && !body_->at_end_)
+    {
+      // Large requests bypass the get area altogether.
+      std::size_t length = read_direct(s + total,
+          static_cast<std::size_t>(n - total));
+      total += length;
+      if (total < n)
+        break;
+    }
+    else if (traits_type::eq_int_type(underflow(), traits_type::eof()))
+    {
+      break;
+    }
+  }
+  return total;
+}
+
+std::streamsize istreambuf::showmanyc()
+{
+  if (body_->at_end_)
+    return -1;
+
+  // A read ahead may be using the read_stream on another thread, and its
+  // bytes are not known until underflow() waits for it.
+  if (body_->ahead_pending_)
+    return 0;
+
+  return boost::asio::buffer_size(body_->read_stream_.data());
+}
+
+std::streambuf::pos_type istreambuf::seekoff(off_type off,
+    std::ios_base::seekdir way, std::ios_base::openmode which)
+{
+  const pos_type failed = pos_type(off_type(-1));
+  if (!(which & std::ios_base::in) || !is_open())
+    return failed;
+
+  boost::uint64_t current = body_->at_end_
+    ? body_->end_ : body_->position_ - (egptr() - gptr());
+  boost::uint64_t base = 0;
+  if (way == std::ios_base::cur)
+    base = current;
+  else if (way == std::ios_base::end)
+    base = body_->end_;
+  if (base == ~boost::uint64_t(0)
+      || (off < 0 && base < static_cast<boost::uint64_t>(-off)))
+    return failed;
+  boost::uint64_t target = base + off;
+  if (body_->end_ != ~boost::uint64_t(0) && target > body_->end_)
+    return failed;
+  if (target == current)
+    return pos_type(off_type(target));
+  body_->at_end_ = false;
+
+  // A position within the data already read is reached without involving the
+  // underlying transport.
+  boost::uint64_t window = egptr() - eback();
+  if (target <= body_->position_ && body_->position_ - target <= window)
+  {
+    setg(eback(), egptr() - (body_->position_ - target), egptr());
+    return pos_type(off_type(target));
+  }
+
+  if (body_->url_.protocol() == "file")
+  {
+    if (body_->ahead_pending_)
+      body_->wait_read_ahead();
+    if (body_->read_stream_.seek(target, body_->error_))
+      return failed;
+  }
+  else if (target == body_->end_)
+  {
+    // A range request for the end of the content would be rejected, so the
+    // stream is simply marked as being at the end.
+    setg(eback(), egptr(), egptr());
+    body_->at_end_ = true;
+    return pos_type(off_type(target));
+  }
+  else
+  {
+    // Reopen the URL, asking for the content from the new position onwards.
+    body_->cancel_read_ahead();
+    body_->read_stream_.close(body_->error_);
+    body_->read_stream_.set_option(
+        http::byte_range(target, body_->range_.last()));
+    body_->open_url(body_->url_);
+    body_->read_stream_.set_option(body_->range_);
+    if (body_->error_ == http::errc::range_not_supported)
+    {
+      // The server has ignored the range and is sending the entire content,
+      // so the data before the new position is read and discarded.
+      body_->error_ = boost::system::error_code();
+      body_->position_ = 0;
+      init_buffers();
+      while (body_->position_ < target)
+      {
+        if (traits_type::eq_int_type(underflow(), traits_type::eof()))
+          return failed;
+        std::size_t excess = body_->position_ > target
+          ? static_cast<std::size_t>(body_->position_ - target) : 0;
+        setg(eback(), egptr() - excess, egptr());
+      }
+      return pos_type(off_type(target));
+    }
+    if (body_->error_)
+      return failed;
+  }
+
+  body_->position_ = target;
+  init_buffers();
+  return pos_type(off_type(target));
+}
+
+std::streambuf::pos_type istreambuf::seekpos(pos_type pos,
+    std::ios_base::openmode which)
+{
+  return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
 const boost::system::error_code& istreambuf::error() const
 {
   return body_->error_;
@@ -239,9 +791,53 @@ const boost::system::error_code& istreambuf::error() const
 
 void istreambuf::init_buffers()
 {
-  setg(body_->get_buffer_.begin(),
-      body_->get_buffer_.begin() + body::putback_max,
-      body_->get_buffer_.begin() + body::putback_max);
+  char* begin = &body_->get_buffer_[0];
+  setg(begin + body::putback_max, begin + body::putback_max,
+      begin + body::putback_max);
+}
+
+std::size_t istreambuf::read_direct(char* data, std::size_t length)
+{
+  body_->waiter_.expect(2);
+
+  detail::istreambuf_timeout_handler th
+    = { body_->read_stream_, body_->waiter_ };
+  body_->timer_.expires_from_now(
+      boost::posix_time::milliseconds(body_->read_timeout_));
+  body_->timer_.async_wait(body_->strand_.wrap(th));
+
+  std::size_t bytes_transferred = 0;
+  detail::istreambuf_read_direct_handler rh = { body_->error_,
+    bytes_transferred, body_->read_stream_, body_->timer_, body_->strand_,
+    body_->waiter_, body_->read_timeout_, data, length };
+  body_->read_stream_.async_read_some(boost::asio::buffer(data, length),
+      body_->strand_.wrap(rh));
+
+  body_->waiter_.wait();
+
+  if (!body_->read_stream_.is_open())
+    body_->error_ = make_error_code(boost::system::errc::timed_out);
+
+  // Keep the tail of the data in the putback area, so that it is still
+  // available to sungetc().
+  body_->position_ += bytes_transferred;
+  std::size_t putback = bytes_transferred < std::size_t(body::putback_max)
+    ? bytes_transferred : std::size_t(body::putback_max);
+  char* begin = &body_->get_buffer_[0];
+  traits_type::copy(begin + body::putback_max - putback,
+      data + bytes_transferred - putback, putback);
+  setg(begin + body::putback_max - putback, begin + body::putback_max,
+      begin + body::putback_max);
+
+  if (body_->error_)
+  {
+    if (body_->error_ == boost::asio::error::eof)
+      body_->error_ = boost::system::error_code();
+    else if (bytes_transferred == 0)
+      boost::throw_exception(boost::system::system_error(body_->error_));
+  }
+
+  return bytes_transferred;
 }
 
 } // namespace urdl
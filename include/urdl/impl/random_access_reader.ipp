@@ -0,0 +1,705 @@
+//
+// random_access_reader.ipp
+// ~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_IMPL_RANDOM_ACCESS_READER_IPP
+#define URDL_IMPL_RANDOM_ACCESS_READER_IPP
+
+#include <cstring>
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/detail/event.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/system/error_code.hpp>
+#include "urdl/http.hpp"
+#include "urdl/read_stream.hpp"
+#include "urdl/detail/parsers.hpp"
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+namespace detail {
+
+// A run of adjacent blocks that is fetched using a single request.
+struct random_access_run
+{
+  boost::uint64_t first_block;
+  boost::uint64_t offset;
+  std::vector<char> data;
+  std::size_t bytes_transferred;
+  boost::uint64_t content_size;
+  boost::system::error_code error;
+};
+
+// Fetches runs of blocks, making up to a given number of requests at once. The
+// streams are kept between fetches so that they need not be constructed again
+// for every read.
+class random_access_fetcher
+{
+public:
+  random_access_fetcher()
+    : runs_(0),
+      next_run_(0),
+      read_timeout_(0)
+  {
+  }
+
+  ~random_access_fetcher()
+  {
+    for (std::size_t i = 0; i < slots_.size(); ++i)
+      delete slots_[i];
+  }
+
+  void fetch(std::vector<random_access_run>& runs, const url& u,
+      const option_set& options, std::size_t parallel,
+      std::size_t read_timeout)
+  {
+    runs_ = &runs;
+    next_run_ = 0;
+    url_ = u;
+    options_ = options;
+    read_timeout_ = read_timeout;
+
+    std::size_t count = parallel < runs.size() ? parallel : runs.size();
+    while (slots_.size() < count)
+      slots_.push_back(new slot(io_service_));
+
+    io_service_.reset();
+    for (std::size_t i = 0; i < count; ++i)
+      start(*slots_[i]);
+    io_service_.run();
+  }
+
+private:
+  struct slot
+  {
+    explicit slot(boost::asio::io_service& io_service)
+      : stream_(io_service),
+        timer_(io_service),
+        run_(0),
+        timed_out_(false)
+    {
+    }
+
+    read_stream stream_;
+    boost::asio::deadline_timer timer_;
+    random_access_run* run_;
+    bool timed_out_;
+  };
+
+  struct open_handler
+  {
+    random_access_fetcher* this_;
+    slot* slot_;
+    void operator()(boost::system::error_code ec)
+    {
+      this_->handle_open(*slot_, ec);
+    }
+  };
+
+  struct read_handler
+  {
+    random_access_fetcher* this_;
+    slot* slot_;
+    void operator()(boost::system::error_code ec,
+        std::size_t bytes_transferred)
+    {
+      this_->handle_read(*slot_, ec, bytes_transferred);
+    }
+  };
+
+  struct timeout_handler
+  {
+    random_access_fetcher* this_;
+    slot* slot_;
+    void operator()(boost::system::error_code ec)
+    {
+      this_->handle_timeout(*slot_, ec);
+    }
+  };
+
+  // Starts the next run that has not yet been fetched, if any.
+  void start(slot& s)
+  {
+    if (next_run_ == runs_->size())
+      return;
+
+    random_access_run& run = (*runs_)[next_run_++];
+    s.run_ = &run;
+    s.timed_out_ = false;
+    s.stream_.set_options(options_);
+    if (url_.protocol() != "file")
+    {
+      s.stream_.set_option(http::byte_range(run.offset,
+            run.offset + run.data.size() - 1));
+    }
+
+    arm_timer(s);
+    open_handler h = { this, &s };
+    s.stream_.async_open(url_, h);
+  }
+
+  void arm_timer(slot& s)
+  {
+    s.timer_.expires_from_now(
+        boost::posix_time::milliseconds(read_timeout_));
+    timeout_handler h = { this, &s };
+    s.timer_.async_wait(h);
+  }
+
+  void handle_open(slot& s, boost::system::error_code ec)
+  {
+    random_access_run& run = *s.run_;
+
+    // Every response to a range request carries the size of the content. A
+    // complete response carries it as the content length.
+    boost::uint64_t size = 0;
+    bool has_content_range
+      = detail::parse_content_range_length(s.stream_.headers(), size);
+    if (has_content_range)
+      run.content_size = size;
+    else if (!ec && (run.offset == 0 || url_.protocol() == "file")
+        && s.stream_.content_length() != ~std::size_t(0))
+      run.content_size = s.stream_.content_length();
+
+    if (s.timed_out_)
+      ec = make_error_code(boost::system::errc::timed_out);
+    else if (ec == http::errc::requested_range_not_satisfiable)
+      ec = boost::asio::error::eof;
+    else if (!ec && url_.protocol() == "file")
+      s.stream_.seek(run.offset, ec);
+    else if (!ec && !has_content_range && run.content_size > run.data.size())
+    {
+      // The server has ignored the range and is sending all of the content.
+      ec = http::errc::range_not_supported;
+    }
+
+    if (ec)
+    {
+      finish(s, ec, 0);
+      return;
+    }
+
+    arm_timer(s);
+    read_handler h = { this, &s };
+    boost::asio::async_read(s.stream_, boost::asio::buffer(run.data), h);
+  }
+
+  void handle_read(slot& s, boost::system::error_code ec,
+      std::size_t bytes_transferred)
+  {
+    // The content may end before the end of the run.
+    if (s.timed_out_)
+      ec = make_error_code(boost::system::errc::timed_out);
+    else if (ec == boost::asio::error::eof)
+      ec = boost::system::error_code();
+    finish(s, ec, bytes_transferred);
+  }
+
+  void handle_timeout(slot& s, boost::system::error_code ec)
+  {
+    // The timer may have been rearmed for a later operation by the time the
+    // handler runs.
+    if (ec != boost::asio::error::operation_aborted
+        && s.timer_.expires_at()
+          <= boost::asio::deadline_timer::traits_type::now())
+    {
+      s.timed_out_ = true;
+      s.stream_.close(ec);
+    }
+  }
+
+  void finish(slot& s, const boost::system::error_code& ec,
+      std::size_t bytes_transferred)
+  {
+    s.timer_.cancel();
+    s.run_->error = ec;
+    s.run_->bytes_transferred = bytes_transferred;
+    boost::system::error_code ignored_ec;
+    s.stream_.close(ignored_ec);
+    start(s);
+  }
+
+  boost::asio::io_service io_service_;
+  std::vector<slot*> slots_;
+  std::vector<random_access_run>* runs_;
+  std::size_t next_run_;
+  url url_;
+  option_set options_;
+  std::size_t read_timeout_;
+};
+
+} // namespace detail
+
+struct random_access_reader::body
+{
+  enum { default_block_size = 65536 };
+  enum { default_cache_blocks = 256 };
+  enum { default_max_read_ahead = 16 };
+  enum { default_max_parallel_requests = 4 };
+
+  body()
+    : block_size_(default_block_size),
+      cache_blocks_(default_cache_blocks),
+      max_read_ahead_(default_max_read_ahead),
+      max_parallel_requests_(default_max_parallel_requests),
+      read_timeout_(300 * 1000),
+      open_(false),
+      size_(~boost::uint64_t(0)),
+      next_offset_(~boost::uint64_t(0)),
+      read_ahead_(0)
+  {
+  }
+
+  ~body()
+  {
+    for (std::size_t i = 0; i < idle_fetchers_.size(); ++i)
+      delete idle_fetchers_[i];
+  }
+
+  typedef std::list<boost::uint64_t> lru_list;
+
+  struct cached_block
+  {
+    std::vector<char> data;
+    lru_list::iterator lru_position;
+  };
+
+  typedef std::map<boost::uint64_t, cached_block> block_map;
+
+  // Fetches the runs, using an idle fetcher if there is one. Called without
+  // the lock held.
+  void fetch(std::vector<detail::random_access_run>& runs);
+
+  // Adds the blocks of a fetched run to the cache.
+  void insert(detail::random_access_run& run);
+
+  // Marks a block as the most recently used.
+  void touch(block_map::iterator iter);
+
+  // Discards the least recently used blocks until the cache is within its
+  // capacity.
+  void evict();
+
+  // Discards all cached blocks.
+  void clear();
+
+  // Wakes the threads that are waiting for other threads' fetches.
+  void notify(boost::asio::detail::mutex::scoped_lock& lock);
+
+  url url_;
+  option_set options_;
+  std::size_t block_size_;
+  std::size_t cache_blocks_;
+  std::size_t max_read_ahead_;
+  std::size_t max_parallel_requests_;
+  std::size_t read_timeout_;
+  bool open_;
+
+  // The following are protected by the mutex once the reader is open.
+  boost::asio::detail::mutex mutex_;
+  block_map blocks_;
+  lru_list lru_;
+  std::set<boost::uint64_t> pending_;
+  std::vector<boost::asio::detail::event*> waiters_;
+  std::vector<detail::random_access_fetcher*> idle_fetchers_;
+  boost::uint64_t size_;
+
+  // The end of the previous read, and the number of blocks to fetch ahead of
+  // the next read if it starts there.
+  boost::uint64_t next_offset_;
+  std::size_t read_ahead_;
+};
+
+inline void random_access_reader::body::fetch(
+    std::vector<detail::random_access_run>& runs)
+{
+  detail::random_access_fetcher* fetcher = 0;
+  {
+    boost::asio::detail::mutex::scoped_lock lock(mutex_);
+    if (!idle_fetchers_.empty())
+    {
+      fetcher = idle_fetchers_.back();
+      idle_fetchers_.pop_back();
+    }
+  }
+
+  if (!fetcher)
+    fetcher = new detail::random_access_fetcher;
+  fetcher->fetch(runs, url_, options_,
+      max_parallel_requests_, read_timeout_);
+
+  boost::asio::detail::mutex::scoped_lock lock(mutex_);
+  idle_fetchers_.push_back(fetcher);
+}
+
+inline void random_access_reader::body::insert(
+    detail::random_access_run& run)
+{
+  std::size_t blocks = (run.data.size() + block_size_ - 1) / block_size_;
+  for (std::size_t i = 0; i < blocks; ++i)
+    pending_.erase(run.first_block + i);
+
+  if (run.content_size != ~boost::uint64_t(0))
+    size_ = run.content_size;
+  if (run.error == boost::asio::error::eof)
+  {
+    // The run starts at or beyond the end of the content.
+    if (size_ > run.offset)
+      size_ = run.offset;
+    return;
+  }
+  if (run.error)
+    return;
+  if (run.bytes_transferred < run.data.size())
+    size_ = run.offset + run.bytes_transferred;
+
+  for (std::size_t i = 0; i < blocks; ++i)
+  {
+    std::size_t start = i * block_size_;
+    if (start >= run.bytes_transferred)
+      break;
+    std::size_t end = start + block_size_;
+    if (end > run.bytes_transferred)
+      end = run.bytes_transferred;
+
+    std::pair<block_map::iterator, bool> result = blocks_.insert(
+        block_map::value_type(run.first_block + i, cached_block()));
+    if (result.second)
+    {
+      lru_.push_front(run.first_block + i);
+      result.first->second.lru_position = lru_.begin();
+    }
+    else
+      touch(result.first);
+    result.first->second.data.assign(
+        run.data.begin() + start, run.data.begin() + end);
+  }
+}
+
+inline void random_access_reader::body::touch(block_map::iterator iter)
+{
+  lru_.splice(lru_.begin(), lru_, iter->second.lru_position);
+}
+
+inline void random_access_reader::body::evict()
+{
+  while (blocks_.size() > cache_blocks_)
+  {
+    blocks_.erase(lru_.back());
+    lru_.pop_back();
+  }
+}
+
+inline void random_access_reader::body::clear()
+{
+  blocks_.clear();
+  lru_.clear();
+}
+
+inline void random_access_reader::body::notify(
+    boost::asio::detail::mutex::scoped_lock& lock)
+{
+  for (std::size_t i = 0; i < waiters_.size(); ++i)
+    waiters_[i]->signal(lock);
+  waiters_.clear();
+}
+
+random_access_reader::random_access_reader()
+  : body_(new body)
+{
+}
+
+random_access_reader::~random_access_reader()
+{
+  delete body_;
+}
+
+void random_access_reader::set_options(const option_set& options)
+{
+  body_->options_.set_options(options);
+}
+
+option_set random_access_reader::get_options() const
+{
+  return body_->options_;
+}
+
+bool random_access_reader::is_open() const
+{
+  return body_->open_;
+}
+
+boost::system::error_code random_access_reader::open(const url& u,
+    boost::system::error_code& ec)
+{
+  close();
+  body_->url_ = u;
+
+  // Fetch the first block, which also gives the size of the content.
+  std::vector<detail::random_access_run> runs(1);
+  runs[0].first_block = 0;
+  runs[0].offset = 0;
+  runs[0].data.resize(body_->block_size_);
+  runs[0].bytes_transferred = 0;
+  runs[0].content_size = ~boost::uint64_t(0);
+  body_->fetch(runs);
+
+  ec = runs[0].error;
+  if (ec == boost::asio::error::eof)
+    ec = boost::system::error_code();
+  if (ec)
+    return ec;
+
+  boost::asio::detail::mutex::scoped_lock lock(body_->mutex_);
+  body_->insert(runs[0]);
+  body_->evict();
+  body_->open_ = true;
+  return ec;
+}
+
+void random_access_reader::close()
+{
+  boost::asio::detail::mutex::scoped_lock lock(body_->mutex_);
+  body_->open_ = false;
+  body_->clear();
+  body_->size_ = ~boost::uint64_t(0);
+  body_->next_offset_ = ~boost::uint64_t(0);
+  body_->read_ahead_ = 0;
+}
+
+boost::uint64_t random_access_reader::size() const
+{
+  boost::asio::detail::mutex::scoped_lock lock(body_->mutex_);
+  return body_->size_;
+}
+
+std::size_t random_access_reader::block_size() const
+{
+  return body_->block_size_;
+}
+
+void random_access_reader::block_size(std::size_t bytes)
+{
+  boost::asio::detail::mutex::scoped_lock lock(body_->mutex_);
+  body_->block_size_ = bytes > 0 ? bytes : 1;
+  body_->clear();
+}
+
+std::size_t random_access_reader::cache_blocks() const
+{
+  return body_->cache_blocks_;
+}
+
+void random_access_reader::cache_blocks(std::size_t blocks)
+{
+  boost::asio::detail::mutex::scoped_lock lock(body_->mutex_);
+  body_->cache_blocks_ = blocks;
+  body_->evict();
+}
+
+std::size_t random_access_reader::max_read_ahead() const
+{
+  return body_->max_read_ahead_;
+}
+
+void random_access_reader::max_read_ahead(std::size_t blocks)
+{
+  body_->max_read_ahead_ = blocks;
+}
+
+std::size_t random_access_reader::max_parallel_requests() const
+{
+  return body_->max_parallel_requests_;
+}
+
+void random_access_reader::max_parallel_requests(std::size_t requests)
+{
+  body_->max_parallel_requests_ = requests > 0 ? requests : 1;
+}
+
+std::size_t random_access_reader::read_timeout() const
+{
+  return body_->read_timeout_;
+}
+
+void random_access_reader::read_timeout(std::size_t milliseconds)
+{
+  body_->read_timeout_ = milliseconds;
+}
+
+std::size_t random_access_reader::read_at(boost::uint64_t offset,
+    char* data, std::size_t length, boost::system::error_code& ec)
+{
+  boost::asio::detail::mutex::scoped_lock lock(body_->mutex_);
+  ec = boost::system::error_code();
+  if (!body_->open_)
+  {
+    ec = boost::asio::error::bad_descriptor;
+    return 0;
+  }
+
+  if (body_->size_ != ~boost::uint64_t(0) && offset >= body_->size_)
+  {
+    ec = boost::asio::error::eof;
+    return 0;
+  }
+  if (length == 0)
+    return 0;
+
+  // A read that starts where the previous one ended causes the blocks after
+  // it to be fetched too. The number of such blocks doubles with each
+  // sequential read, up to the limit.
+  std::size_t read_ahead = 0;
+  if (offset == body_->next_offset_)
+  {
+    read_ahead = body_->read_ahead_ ? body_->read_ahead_ * 2 : 1;
+    if (read_ahead > body_->max_read_ahead_)
+      read_ahead = body_->max_read_ahead_;
+  }
+  body_->read_ahead_ = read_ahead;
+  body_->next_offset_ = offset + length;
+
+  const std::size_t block_size = body_->block_size_;
+  const boost::uint64_t first_block = offset / block_size;
+  std::vector<bool> copied(static_cast<std::size_t>(
+        (offset + length - 1) / block_size - first_block + 1));
+  boost::system::error_code fetch_ec;
+  for (;;)
+  {
+    // The content may turn out to be shorter than the read.
+    if (body_->size_ != ~boost::uint64_t(0))
+    {
+      if (offset >= body_->size_)
+      {
+        ec = boost::asio::error::eof;
+        return 0;
+      }
+      if (length > body_->size_ - offset)
+        length = static_cast<std::size_t>(body_->size_ - offset);
+    }
+    const boost::uint64_t last_block = (offset + length - 1) / block_size;
+
+    // Copy out whatever the cache holds.
+    bool complete = true;
+    for (boost::uint64_t b = first_block; b <= last_block; ++b)
+    {
+      if (copied[static_cast<std::size_t>(b - first_block)])
+        continue;
+      body::block_map::iterator iter = body_->blocks_.find(b);
+      if (iter == body_->blocks_.end())
+      {
+        complete = false;
+        continue;
+      }
+      body_->touch(iter);
+
+      boost::uint64_t block_start = b * block_size;
+      boost::uint64_t from = offset > block_start ? offset : block_start;
+      boost::uint64_t to = block_start + iter->second.data.size();
+      if (to > offset + length)
+        to = offset + length;
+      if (to > from)
+      {
+        std::memcpy(data + (from - offset),
+            &iter->second.data[static_cast<std::size_t>(from - block_start)],
+            static_cast<std::size_t>(to - from));
+      }
+      copied[static_cast<std::size_t>(b - first_block)] = true;
+    }
+    body_->evict();
+
+    if (complete)
+      return length;
+    if (fetch_ec)
+    {
+      ec = fetch_ec;
+      return 0;
+    }
+
+    // Collect the missing blocks that no other thread is fetching, together
+    // with any blocks to be read ahead, merging adjacent blocks into runs.
+    boost::uint64_t end_block = last_block + 1 + read_ahead;
+    if (body_->size_ != ~boost::uint64_t(0))
+    {
+      boost::uint64_t size_blocks
+        = (body_->size_ + block_size - 1) / block_size;
+      if (end_block > size_blocks)
+        end_block = size_blocks;
+    }
+    read_ahead = 0;
+
+    std::vector<detail::random_access_run> runs;
+    for (boost::uint64_t b = first_block; b < end_block; ++b)
+    {
+      if (b <= last_block && copied[static_cast<std::size_t>(b - first_block)])
+        continue;
+      if (body_->blocks_.count(b) || body_->pending_.count(b))
+        continue;
+      body_->pending_.insert(b);
+
+      if (!runs.empty() && runs.back().offset
+          + runs.back().data.size() == b * block_size)
+      {
+        runs.back().data.resize(runs.back().data.size() + block_size);
+      }
+      else
+      {
+        runs.push_back(detail::random_access_run());
+        runs.back().first_block = b;
+        runs.back().offset = b * block_size;
+        runs.back().data.resize(block_size);
+        runs.back().bytes_transferred = 0;
+        runs.back().content_size = ~boost::uint64_t(0);
+      }
+    }
+
+    if (runs.empty())
+    {
+      // The remaining blocks are being fetched by other threads.
+      boost::asio::detail::event event;
+      body_->waiters_.push_back(&event);
+      event.wait(lock);
+      continue;
+    }
+
+    // The final block of the content may be partial.
+    if (body_->size_ != ~boost::uint64_t(0)
+        && runs.back().offset + runs.back().data.size() > body_->size_)
+    {
+      runs.back().data.resize(
+          static_cast<std::size_t>(body_->size_ - runs.back().offset));
+    }
+
+    lock.unlock();
+    body_->fetch(runs);
+    lock.lock();
+
+    // Only a failure to fetch blocks that the read needs is reported.
+    for (std::size_t i = 0; i < runs.size(); ++i)
+    {
+      body_->insert(runs[i]);
+      if (runs[i].error && runs[i].error != boost::asio::error::eof
+          && runs[i].first_block <= last_block && !fetch_ec)
+        fetch_ec = runs[i].error;
+    }
+    body_->notify(lock);
+  }
+}
+
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#endif // URDL_IMPL_RANDOM_ACCESS_READER_IPP
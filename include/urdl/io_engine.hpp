@@ -0,0 +1,89 @@
+//
+// io_engine.hpp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_IO_ENGINE_HPP
+#define URDL_IO_ENGINE_HPP
+
+#include <cstddef>
+#include "urdl/detail/config.hpp"
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+
+class istreambuf;
+
+/// The class @c io_engine runs the I/O for a group of @c istream and
+/// @c istreambuf objects on background threads.
+/**
+ * By default, each @c istreambuf object owns a private @c io_service, and
+ * runs it on the calling thread for the duration of every open and read. An
+ * @c istreambuf constructed with an @c io_engine instead starts its operations
+ * on the engine, and the calling thread simply waits for them to complete.
+ * This avoids the cost of an @c io_service per stream, and of running it for
+ * each operation, when a program uses many streams.
+ *
+ * @par Remarks
+ * The @c io_engine object must outlive every stream that uses it.
+ *
+ * @par Example
+ * To share a single background thread between streams on several worker
+ * threads:
+ * @code
+ * urdl::io_engine engine;
+ * ...
+ * urdl::istream is(engine);
+ * is.open("http://www.boost.org/LICENSE_1_0.txt");
+ * @endcode
+ *
+ * @par Requirements
+ * @e Header: @c <urdl/io_engine.hpp> @n
+ * @e Namespace: @c urdl
+ */
+class io_engine
+{
+public:
+  /// Constructs an object of class @c io_engine.
+  /**
+   * @param threads The number of background threads on which to run the I/O.
+   * At least one thread is always started.
+   */
+  URDL_DECL explicit io_engine(std::size_t threads = 1);
+
+  /// Destroys an object of class @c io_engine.
+  /**
+   * @par Remarks
+   * Stops the background threads and waits for them to exit.
+   */
+  URDL_DECL ~io_engine();
+
+  /// Gets the number of background threads.
+  URDL_DECL std::size_t thread_count() const;
+
+private:
+  friend class istreambuf;
+
+  // Disallow copying and assignment.
+  io_engine(const io_engine&);
+  io_engine& operator=(const io_engine&);
+
+  struct body;
+  body* body_;
+};
+
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#if defined(URDL_HEADER_ONLY)
+# include "urdl/impl/io_engine.ipp"
+#endif
+
+#endif // URDL_IO_ENGINE_HPP
@@ -12,6 +12,8 @@
 #define URDL_ISTREAM_HPP
 
 #include <istream>
+#include <utility>
+#include <boost/ref.hpp>
 #include <boost/utility/base_from_member.hpp>
 #include <boost/system/error_code.hpp>
 #include "urdl/istreambuf.hpp"
@@ -62,6 +64,24 @@ public:
   {
   }
 
+  /// Constructs an object of class @c istream that performs its I/O on an
+  /// @c io_engine.
+  /**
+   * @param engine The engine on whose threads the stream's open and read
+   * operations are to be run. The engine must outlive the stream.
+   *
+   * @par Remarks
+   * Initializes the base class with @c std::basic_istream<char>(sb),
+   * where sb is an object of class @c istreambuf stored within the class and
+   * constructed with @c istreambuf(engine).
+   */
+  explicit istream(io_engine& engine)
+    : boost::base_from_member<istreambuf>(boost::ref(engine)),
+      std::basic_istream<char>(
+        &this->boost::base_from_member<istreambuf>::member)
+  {
+  }
+
   /// Constructs an object of class @c istream.
   /**
    * @param u The URL to open.
@@ -109,6 +129,45 @@ public:
       setstate(std::ios_base::failbit);
   }
 
+#if defined(URDL_HAS_MOVE) || defined(GENERATING_DOCUMENTATION)
+  /// Move-constructs an object of class @c istream from another.
+  /**
+   * @param other The other @c istream object from which the move will occur.
+   *
+   * @par Remarks
+   * Move-constructs the stored @c istreambuf from that of @c other, and the
+   * base class from @c other, so that the stream state and any open
+   * connection are transferred. Following the move, the stored
+   * @c istreambuf of @c other is as if newly constructed, and @c other may be
+   * reopened.
+   */
+  istream(istream&& other)
+    : boost::base_from_member<istreambuf>(
+        std::move(other.boost::base_from_member<istreambuf>::member)),
+      std::basic_istream<char>(std::move(other))
+  {
+    this->set_rdbuf(&this->boost::base_from_member<istreambuf>::member);
+  }
+
+  /// Move-assigns an @c istream from another.
+  /**
+   * @param other The other @c istream object from which the move will occur.
+   *
+   * @par Remarks
+   * Move-assigns the stored @c istreambuf from that of @c other, closing any
+   * connection open on this stream, and exchanges the stream state with that
+   * of @c other. Following the move, the stored @c istreambuf of @c other is
+   * as if newly constructed, and @c other may be reopened.
+   */
+  istream& operator=(istream&& other)
+  {
+    this->boost::base_from_member<istreambuf>::member =
+      std::move(other.boost::base_from_member<istreambuf>::member);
+    std::basic_istream<char>::operator=(std::move(other));
+    return *this;
+  }
+#endif // defined(URDL_HAS_MOVE) || defined(GENERATING_DOCUMENTATION)
+
   /// Sets an option to control the behaviour of the stream.
   /**
    * @param option The option to be set on the stream.
@@ -327,6 +386,83 @@ public:
     rdbuf()->read_timeout(milliseconds);
   }
 
+  /// Gets the buffer size of the stream.
+  /**
+   * @returns The size, in bytes, of the buffer used for the first read from
+   * the underlying transport after a URL is opened.
+   *
+   * @par Remarks
+   * Returns @c rdbuf()->buffer_size().
+   */
+  std::size_t buffer_size() const
+  {
+    return rdbuf()->buffer_size();
+  }
+
+  /// Sets the buffer size of the stream.
+  /**
+   * @param bytes The size, in bytes, of the buffer to be used for reads from
+   * the underlying transport.
+   *
+   * @par Remarks
+   * Performs @c rdbuf()->buffer_size(bytes).
+   */
+  void buffer_size(std::size_t bytes)
+  {
+    rdbuf()->buffer_size(bytes);
+  }
+
+  /// Gets the maximum buffer size of the stream.
+  /**
+   * @returns The size, in bytes, up to which the buffer may grow.
+   *
+   * @par Remarks
+   * Returns @c rdbuf()->max_buffer_size().
+   */
+  std::size_t max_buffer_size() const
+  {
+    return rdbuf()->max_buffer_size();
+  }
+
+  /// Sets the maximum buffer size of the stream.
+  /**
+   * @param bytes The size, in bytes, up to which the buffer may grow while
+   * reads from the underlying transport keep filling it.
+   *
+   * @par Remarks
+   * Performs @c rdbuf()->max_buffer_size(bytes).
+   */
+  void max_buffer_size(std::size_t bytes)
+  {
+    rdbuf()->max_buffer_size(bytes);
+  }
+
+  /// Gets whether the stream reads ahead.
+  /**
+   * @returns @c true if the next read from the underlying transport is started
+   * as soon as the current one completes.
+   *
+   * @par Remarks
+   * Returns @c rdbuf()->read_ahead().
+   */
+  bool read_ahead() const
+  {
+    return rdbuf()->read_ahead();
+  }
+
+  /// Sets whether the stream reads ahead.
+  /**
+   * @param enabled @c true to start each read from the underlying transport as
+   * soon as the previous one completes.
+   *
+   * @par Remarks
+   * Performs @c rdbuf()->read_ahead(enabled).
+   */
+  void read_ahead(bool enabled)
+  {
+    rdbuf()->read_ahead(enabled);
+  }
+
   /// Gets the MIME type of the content obtained from the URL.
   /**
    * @returns A string specifying the MIME type. Examples of possible return
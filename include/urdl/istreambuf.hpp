@@ -14,6 +14,7 @@
 #include <streambuf>
 #include <boost/system/error_code.hpp>
 #include "urdl/detail/config.hpp"
+#include "urdl/io_engine.hpp"
 #include "urdl/option_set.hpp"
 #include "urdl/url.hpp"
 
@@ -35,6 +36,39 @@ public:
   /// Constructs an object of class @c istreambuf.
   URDL_DECL istreambuf();
 
+  /// Constructs an object of class @c istreambuf that performs its I/O on an
+  /// @c io_engine.
+  /**
+   * @param engine The engine on whose threads the stream buffer's open and
+   * read operations are to be run. The engine must outlive the stream buffer.
+   */
+  URDL_DECL explicit istreambuf(io_engine& engine);
+
+#if defined(URDL_HAS_MOVE) || defined(GENERATING_DOCUMENTATION)
+  /// Move-constructs an object of class @c istreambuf from another.
+  /**
+   * @param other The other @c istreambuf object from which the move will
+   * occur. Any open connection, buffered content and options are transferred
+   * to the new object.
+   *
+   * @par Remarks
+   * Following the move, @c other is in the same state as a newly constructed
+   * @c istreambuf that uses the same @c io_engine, if any.
+   */
+  URDL_DECL istreambuf(istreambuf&& other);
+
+  /// Move-assigns an @c istreambuf from another.
+  /**
+   * @param other The other @c istreambuf object from which the move will
+   * occur. Any connection open on this stream buffer is closed first.
+   *
+   * @par Remarks
+   * Following the move, @c other is in the same state as a newly constructed
+   * @c istreambuf that uses the same @c io_engine, if any.
+   */
+  URDL_DECL istreambuf& operator=(istreambuf&& other);
+#endif // defined(URDL_HAS_MOVE) || defined(GENERATING_DOCUMENTATION)
+
   /// Destroys an object of class @c istreambuf.
   URDL_DECL ~istreambuf();
 
@@ -151,6 +185,78 @@ public:
    */
   URDL_DECL void read_timeout(std::size_t milliseconds);
 
+  /// Gets the buffer size of the stream buffer.
+  /**
+   * @returns The size, in bytes, of the buffer used for the first read from
+   * the underlying transport after a URL is opened.
+   */
+  URDL_DECL std::size_t buffer_size() const;
+
+  /// Sets the buffer size of the stream buffer.
+  /**
+   * @param bytes The size, in bytes, of the buffer to be used for reads from
+   * the underlying transport. The default is 512 bytes.
+   *
+   * @par Remarks
+   * Each read from the underlying transport waits for the next chunk of
+   * content to arrive, with a timeout. A larger buffer means fewer such waits
+   * when reading a large amount of content. The new size takes effect the next
+   * time the buffer is empty.
+   */
+  URDL_DECL void buffer_size(std::size_t bytes);
+
+  /// Gets the maximum buffer size of the stream buffer.
+  /**
+   * @returns The size, in bytes, up to which the buffer may grow.
+   */
+  URDL_DECL std::size_t max_buffer_size() const;
+
+  /// Sets the maximum buffer size of the stream buffer.
+  /**
+   * @param bytes The size, in bytes, up to which the buffer may grow. The
+   * default is 512 bytes.
+   *
+   * @par Remarks
+   * When the maximum buffer size is greater than @c buffer_size(), the buffer
+   * size adapts to the content: each read that fills the buffer doubles its
+   * size, up to the maximum. The buffer returns to @c buffer_size() each time
+   * a URL is opened.
+   *
+   * @par Example
+   * To start with a small buffer and grow it to 64KB while the content keeps
+   * arriving faster than it is consumed:
+   * @code
+   * urdl::istreambuf sb;
+   * sb.buffer_size(4096);
+   * sb.max_buffer_size(65536);
+   * sb.open("http://www.boost.org/LICENSE_1_0.txt");
+   * @endcode
+   */
+  URDL_DECL void max_buffer_size(std::size_t bytes);
+
+  /// Gets whether the stream buffer reads ahead.
+  /**
+   * @returns @c true if the next read from the underlying transport is started
+   * as soon as the current one completes.
+   */
+  URDL_DECL bool read_ahead() const;
+
+  /// Sets whether the stream buffer reads ahead.
+  /**
+   * @param enabled @c true to start each read from the underlying transport as
+   * soon as the previous one completes, into a second buffer. The default is
+   * @c false.
+   *
+   * @par Remarks
+   * When reading ahead, the read that refills the get area is already in
+   * progress while the caller processes the current contents. This lets
+   * processing of the content overlap with its transfer, provided that the
+   * stream buffer was constructed with an @c io_engine whose threads can
+   * complete the read in the meantime. The read timeout applies only to the
+   * time spent waiting for a read ahead to complete.
+   */
+  URDL_DECL void read_ahead(bool enabled);
+
   /// Gets the MIME type of the content obtained from the URL.
   /**
    * @returns A string specifying the MIME type. Examples of possible return
@@ -186,6 +292,50 @@ protected:
    */
   URDL_DECL int_type underflow();
 
+  /// Overrides @c std::streambuf behaviour.
+  /**
+   * @par Remarks
+   * Behaves according to the specification of @c std::streambuf::xsgetn().
+   * Once the get area is drained, a request for at least @c buffer_size()
+   * bytes is read from the underlying transport directly into @c s.
+   */
+  URDL_DECL std::streamsize xsgetn(char_type* s, std::streamsize n);
+
+  /// Overrides @c std::streambuf behaviour.
+  /**
+   * @par Remarks
+   * Behaves according to the specification of @c std::streambuf::showmanyc().
+   * Returns the number of bytes that have been received from the underlying
+   * transport but not yet transferred to the get area.
+   */
+  URDL_DECL std::streamsize showmanyc();
+
+  /// Overrides @c std::streambuf behaviour.
+  /**
+   * @par Remarks
+   * Behaves according to the specification of @c std::streambuf::seekoff().
+   * Positions are offsets within the content. Seeking relative to the end
+   * requires the content length to be known.
+   *
+   * A position within the data that has already been read into the stream
+   * buffer is reached without further I/O. Otherwise, the read position of a
+   * @c file URL is moved directly, and an @c http or @c https URL is reopened
+   * with a request for the content from the new position onwards. If the
+   * server does not support byte ranges, the content before the new position
+   * is read and discarded.
+   */
+  URDL_DECL pos_type seekoff(off_type off, std::ios_base::seekdir way,
+      std::ios_base::openmode which = std::ios_base::in);
+
+  /// Overrides @c std::streambuf behaviour.
+  /**
+   * @par Remarks
+   * Behaves according to the specification of @c std::streambuf::seekpos().
+   * Equivalent to <tt>seekoff(off_type(pos), std::ios_base::beg, which)</tt>.
+   */
+  URDL_DECL pos_type seekpos(pos_type pos,
+      std::ios_base::openmode which = std::ios_base::in);
+
   /// Gets the last error associated with the stream.
   /**
    * @returns An @c error_code corresponding to the last error from the stream.
@@ -200,6 +350,11 @@ protected:
 
 private:
   URDL_DECL void init_buffers();
+  URDL_DECL std::size_t read_direct(char* data, std::size_t length);
+
+  // Disallow copying and assignment.
+  istreambuf(const istreambuf&);
+  istreambuf& operator=(const istreambuf&);
 
   struct body;
   body* body_;
@@ -0,0 +1,331 @@
+//
+// random_access_reader.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef URDL_RANDOM_ACCESS_READER_HPP
+#define URDL_RANDOM_ACCESS_READER_HPP
+
+#include <cstddef>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/throw_exception.hpp>
+#include "urdl/detail/config.hpp"
+#include "urdl/option_set.hpp"
+#include "urdl/url.hpp"
+
+#include "urdl/detail/abi_prefix.hpp"
+
+namespace urdl {
+
+/// The class @c random_access_reader reads arbitrary parts of the content
+/// from a specified URL.
+/**
+ * Each read is satisfied from a cache of fixed-size blocks of the content.
+ * Blocks that are not in the cache are fetched from the server using
+ * requests with the @c urdl::http::byte_range option, so that only the parts
+ * of the content that are read are transferred. Adjacent missing blocks are
+ * fetched using a single request, and separate runs of missing blocks are
+ * fetched in parallel. When reads follow one another sequentially, the reader
+ * also fetches the blocks that follow, doubling the number of blocks fetched
+ * ahead with each sequential read up to a limit. The least recently used
+ * blocks are discarded once the cache is full.
+ *
+ * The content of a @c file URL is read by moving the read position of the
+ * file. An @c http or @c https server must support byte ranges.
+ *
+ * The class @c random_access_reader meets the type requirements for
+ * @c SyncRandomAccessReadDevice, as defined in the Boost.Asio documentation,
+ * and so may be used with @c boost::asio::read_at.
+ *
+ * @par Thread Safety
+ * Once the reader is open, @c read_some_at may be called concurrently from
+ * several threads. All other member functions must not be called
+ * concurrently with any other member function.
+ *
+ * @par Example
+ * To read the last 1024 bytes of a resource:
+ * @code
+ * urdl::random_access_reader reader;
+ * reader.open("http://www.example.com/data.bin");
+ * std::vector<char> data(1024);
+ * boost::asio::read_at(reader, reader.size() - data.size(),
+ *     boost::asio::buffer(data));
+ * @endcode
+ *
+ * @par Requirements
+ * @e Header: @c <urdl/random_access_reader.hpp> @n
+ * @e Namespace: @c urdl
+ */
+class random_access_reader
+{
+public:
+  /// Constructs an object of class @c random_access_reader.
+  URDL_DECL random_access_reader();
+
+  /// Destroys an object of class @c random_access_reader.
+  URDL_DECL ~random_access_reader();
+
+  /// Sets an option to control the behaviour of the reader.
+  /**
+   * @param option The option to be set on the reader.
+   *
+   * @par Remarks
+   * Options are uniquely identified by type. The options are applied to every
+   * request made to fetch the content, except that any
+   * @c urdl::http::byte_range option is replaced.
+   */
+  template <typename Option>
+  void set_option(const Option& option)
+  {
+    option_set options;
+    options.set_option(option);
+    set_options(options);
+  }
+
+  /// Sets options to control the behaviour of the reader.
+  /**
+   * @param options The options to be set on the reader.
+   */
+  URDL_DECL void set_options(const option_set& options);
+
+  /// Gets the current value of an option that controls the behaviour of the
+  /// reader.
+  /**
+   * @returns The current value of the option.
+   *
+   * @par Remarks
+   * Options are uniquely identified by type.
+   */
+  template <typename Option>
+  Option get_option() const
+  {
+    option_set options(get_options());
+    return options.get_option<Option>();
+  }
+
+  /// Gets the values of all options set on the reader.
+  /**
+   * @returns An option set containing all options from the reader.
+   */
+  URDL_DECL option_set get_options() const;
+
+  /// Determines whether the reader is open.
+  /**
+   * @returns @c true if the reader is open, @c false otherwise.
+   */
+  URDL_DECL bool is_open() const;
+
+  /// Opens the specified URL.
+  /**
+   * @param u The URL to open.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   *
+   * @par Remarks
+   * Fetches the first block of the content, which also determines the size of
+   * the content.
+   */
+  void open(const url& u)
+  {
+    boost::system::error_code ec;
+    if (open(u, ec))
+    {
+      boost::system::system_error ex(ec);
+      boost::throw_exception(ex);
+    }
+  }
+
+  /// Opens the specified URL.
+  /**
+   * @param u The URL to open.
+   *
+   * @param ec Set to indicate what error occurred, if any. Fails with
+   * @c urdl::http::errc::range_not_supported if the server does not support
+   * byte ranges.
+   *
+   * @returns @c ec.
+   *
+   * @par Remarks
+   * Fetches the first block of the content, which also determines the size of
+   * the content.
+   */
+  URDL_DECL boost::system::error_code open(const url& u,
+      boost::system::error_code& ec);
+
+  /// Closes the reader.
+  /**
+   * @par Remarks
+   * Discards all cached blocks.
+   */
+  URDL_DECL void close();
+
+  /// Gets the size of the content.
+  /**
+   * @returns The size of the content, in bytes. If the size is not known,
+   * returns @c std::numeric_limits<boost::uint64_t>::max().
+   */
+  URDL_DECL boost::uint64_t size() const;
+
+  /// Reads data from the content at the specified offset.
+  /**
+   * @param offset The offset within the content at which the read starts.
+   *
+   * @param buffers The buffers into which the data will be read.
+   *
+   * @returns The number of bytes read. This is less than the size of the
+   * buffers only if the end of the content is reached.
+   *
+   * @throws boost::system::system_error Thrown on failure. Fails with
+   * @c boost::asio::error::eof if @c offset is at or beyond the end of the
+   * content.
+   */
+  template <typename MutableBufferSequence>
+  std::size_t read_some_at(boost::uint64_t offset,
+      const MutableBufferSequence& buffers)
+  {
+    boost::system::error_code ec;
+    std::size_t bytes_transferred = read_some_at(offset, buffers, ec);
+    if (ec)
+    {
+      boost::system::system_error ex(ec);
+      boost::throw_exception(ex);
+    }
+    return bytes_transferred;
+  }
+
+  /// Reads data from the content at the specified offset.
+  /**
+   * @param offset The offset within the content at which the read starts.
+   *
+   * @param buffers The buffers into which the data will be read.
+   *
+   * @param ec Set to indicate what error occurred, if any. Fails with
+   * @c boost::asio::error::eof if @c offset is at or beyond the end of the
+   * content.
+   *
+   * @returns The number of bytes read. This is less than the size of the
+   * buffers only if the end of the content is reached, or if an error
+   * occurs.
+   */
+  template <typename MutableBufferSequence>
+  std::size_t read_some_at(boost::uint64_t offset,
+      const MutableBufferSequence& buffers, boost::system::error_code& ec)
+  {
+    ec = boost::system::error_code();
+    std::size_t total = 0;
+    typename MutableBufferSequence::const_iterator iter = buffers.begin();
+    typename MutableBufferSequence::const_iterator end = buffers.end();
+    for (; iter != end; ++iter)
+    {
+      boost::asio::mutable_buffer buffer(*iter);
+      std::size_t length = boost::asio::buffer_size(buffer);
+      if (length == 0)
+        continue;
+      std::size_t bytes_transferred = read_at(offset + total,
+          boost::asio::buffer_cast<char*>(buffer), length, ec);
+      total += bytes_transferred;
+      if (ec || bytes_transferred < length)
+        break;
+    }
+    if (total > 0 && ec == boost::asio::error::eof)
+      ec = boost::system::error_code();
+    return total;
+  }
+
+  /// Gets the size of the blocks in which the content is fetched and cached.
+  /**
+   * @returns The block size, in bytes. The default is 65536.
+   */
+  URDL_DECL std::size_t block_size() const;
+
+  /// Sets the size of the blocks in which the content is fetched and cached.
+  /**
+   * @param bytes The block size, in bytes. A value of zero is treated as one.
+   *
+   * @par Remarks
+   * Discards all cached blocks.
+   */
+  URDL_DECL void block_size(std::size_t bytes);
+
+  /// Gets the maximum number of blocks held in the cache.
+  /**
+   * @returns The cache capacity, in blocks. The default is 256.
+   */
+  URDL_DECL std::size_t cache_blocks() const;
+
+  /// Sets the maximum number of blocks held in the cache.
+  /**
+   * @param blocks The cache capacity, in blocks. A read may temporarily hold
+   * more blocks than this while it copies them out.
+   */
+  URDL_DECL void cache_blocks(std::size_t blocks);
+
+  /// Gets the maximum number of blocks fetched ahead of sequential reads.
+  /**
+   * @returns The read-ahead limit, in blocks. The default is 16.
+   */
+  URDL_DECL std::size_t max_read_ahead() const;
+
+  /// Sets the maximum number of blocks fetched ahead of sequential reads.
+  /**
+   * @param blocks The read-ahead limit, in blocks. A value of zero disables
+   * read-ahead.
+   */
+  URDL_DECL void max_read_ahead(std::size_t blocks);
+
+  /// Gets the maximum number of requests that a read makes in parallel.
+  /**
+   * @returns The number of requests. The default is 4.
+   */
+  URDL_DECL std::size_t max_parallel_requests() const;
+
+  /// Sets the maximum number of requests that a read makes in parallel.
+  /**
+   * @param requests The number of requests. A value of zero is treated as one.
+   */
+  URDL_DECL void max_parallel_requests(std::size_t requests);
+
+  /// Gets the read timeout of the reader.
+  /**
+   * @returns The timeout, in milliseconds, that applies to opening and to
+   * reading the content of each request.
+   */
+  URDL_DECL std::size_t read_timeout() const;
+
+  /// Sets the read timeout of the reader.
+  /**
+   * @param milliseconds The timeout, in milliseconds, that applies to opening
+   * and to reading the content of each request.
+   */
+  URDL_DECL void read_timeout(std::size_t milliseconds);
+
+private:
+  URDL_DECL std::size_t read_at(boost::uint64_t offset, char* data,
+      std::size_t length, boost::system::error_code& ec);
+
+  // Disallow copying and assignment.
+  random_access_reader(const random_access_reader&);
+  random_access_reader& operator=(const random_access_reader&);
+
+  struct body;
+  body* body_;
+};
+
+} // namespace urdl
+
+#include "urdl/detail/abi_suffix.hpp"
+
+#if defined(URDL_HEADER_ONLY)
+# include "urdl/impl/random_access_reader.ipp"
+#endif
+
+#endif // URDL_RANDOM_ACCESS_READER_HPP
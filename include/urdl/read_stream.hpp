@@ -11,16 +11,25 @@
 #ifndef URDL_READ_STREAM_HPP
 #define URDL_READ_STREAM_HPP
 
+#include <boost/asio/buffer.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/detail/bind_handler.hpp>
 #include <boost/throw_exception.hpp>
+#include "urdl/detail/config.hpp"
+#include "urdl/file.hpp"
+#include "urdl/flight_recorder.hpp"
 #include "urdl/http.hpp"
 #include "urdl/option_set.hpp"
 #include "urdl/url.hpp"
 #include "urdl/detail/coroutine.hpp"
 #include "urdl/detail/file_read_stream.hpp"
 #include "urdl/detail/http_read_stream.hpp"
+#include "urdl/detail/mapped_file.hpp"
+#include "urdl/detail/read_body.hpp"
+#include "urdl/detail/read_to_file.hpp"
+#include "urdl/detail/scoped_ptr.hpp"
+#include "urdl/detail/splice.hpp"
 
 #if !defined(URDL_DISABLE_SSL)
 # include <boost/asio/ssl.hpp>
@@ -107,21 +116,83 @@ public:
   /**
    * @param io_service The @c io_service object that the stream will use to
    * dispatch handlers for any asynchronous operations performed on the stream.
+   *
+   * @par Remarks
+   * No memory is allocated until an option is set or a URL is opened. The
+   * backend for each protocol is created when a URL using that protocol is
+   * first opened, and is reused by later opens.
    */
   explicit read_stream(boost::asio::io_service& io_service)
-    : io_service_(io_service),
-      file_(io_service, options_),
-      http_(io_service, options_),
-#if !defined(URDL_DISABLE_SSL)
-      ssl_context_(io_service, boost::asio::ssl::context::sslv23),
-      https_(io_service, options_, ssl_context_),
-#endif // !defined(URDL_DISABLE_SSL)
-      protocol_(unknown)
+    : io_service_(&io_service),
+      body_(0),
+      protocol_(unknown),
+      content_read_(false),
+      max_immediate_depth_(0),
+      immediate_depth_(0)
   {
-#if !defined(URDL_DISABLE_SSL)
-    ssl_context_.set_verify_mode(boost::asio::ssl::context::verify_peer);
-    SSL_CTX_set_default_verify_paths(ssl_context_.impl());
-#endif // !defined(URDL_DISABLE_SSL)
+  }
+
+#if defined(URDL_HAS_MOVE) || defined(GENERATING_DOCUMENTATION)
+  /// Move-constructs an object of class @c read_stream from another.
+  /**
+   * @param other The other @c read_stream object from which the move will
+   * occur. Any open connection, buffered content and options are transferred
+   * to the new object.
+   *
+   * @par Remarks
+   * The stream must not be moved while it has asynchronous operations
+   * outstanding. Following the move, @c other is in the same state as if it
+   * had been constructed using the @c read_stream(io_service&) constructor.
+   */
+  read_stream(read_stream&& other)
+    : io_service_(other.io_service_),
+      body_(other.body_),
+      protocol_(other.protocol_),
+      content_read_(other.content_read_),
+      max_immediate_depth_(other.max_immediate_depth_),
+      immediate_depth_(0)
+  {
+    other.body_ = 0;
+    other.protocol_ = unknown;
+  }
+
+  /// Move-assigns a @c read_stream from another.
+  /**
+   * @param other The other @c read_stream object from which the move will
+   * occur. Any connection open on this stream is closed first.
+   *
+   * @par Remarks
+   * Neither stream may have asynchronous operations outstanding. Following
+   * the move, @c other is in the same state as if it had been constructed
+   * using the @c read_stream(io_service&) constructor.
+   */
+  read_stream& operator=(read_stream&& other)
+  {
+    if (this != &other)
+    {
+      delete body_;
+      io_service_ = other.io_service_;
+      body_ = other.body_;
+      protocol_ = other.protocol_;
+      content_read_ = other.content_read_;
+      max_immediate_depth_ = other.max_immediate_depth_;
+      immediate_depth_ = 0;
+      other.body_ = 0;
+      other.protocol_ = unknown;
+    }
+    return *this;
+  }
+#endif // defined(URDL_HAS_MOVE) || defined(GENERATING_DOCUMENTATION)
+
+  /// Destroys an object of class @c read_stream.
+  /**
+   * @par Remarks
+   * Closes any open connection. Outstanding asynchronous operations are
+   * cancelled.
+   */
+  ~read_stream()
+  {
+    delete body_;
   }
 
   /// Gets the @c io_service associated with the stream.
@@ -131,7 +202,7 @@ public:
    */
   boost::asio::io_service& get_io_service()
   {
-    return io_service_;
+    return *io_service_;
   }
 
   /// Sets an option to control the behaviour of the stream.
@@ -150,7 +221,7 @@ public:
   template <typename Option>
   void set_option(const Option& option)
   {
-    options_.set_option(option);
+    get_body().options_.set_option(option);
   }
 
   /// Sets options to control the behaviour of the stream.
@@ -169,7 +240,7 @@ public:
    */
   void set_options(const option_set& options)
   {
-    options_.set_options(options);
+    get_body().options_.set_options(options);
   }
 
   /// Gets the current value of an option that controls the behaviour of the
@@ -191,7 +262,7 @@ public:
   template <typename Option>
   Option get_option() const
   {
-    return options_.get_option<Option>();
+    return body_ ? body_->options_.get_option<Option>() : Option();
   }
 
   /// Gets the values of all options set on the stream.
@@ -210,7 +281,47 @@ public:
    */
   option_set get_options() const
   {
-    return options_;
+    return body_ ? body_->options_ : option_set();
+  }
+
+  /// Gets the limit on immediate completion of asynchronous read operations.
+  /**
+   * @returns The maximum depth to which handlers may be invoked from within
+   * @c async_read_some or @c async_fill. A value of 0 means that handlers are
+   * never invoked immediately.
+   */
+  std::size_t immediate_completion() const
+  {
+    return max_immediate_depth_;
+  }
+
+  /// Allows asynchronous read operations that can complete at once to invoke
+  /// their handlers immediately.
+  /**
+   * @param max_depth The maximum depth to which handlers may be invoked from
+   * within @c async_read_some or @c async_fill. A value of 0, the default,
+   * means that handlers are never invoked immediately.
+   *
+   * @par Remarks
+   * When enabled, an @c async_read_some or @c async_fill operation whose data
+   * is already available, because it is held in the stream's internal storage
+   * or comes from a local file, invokes its handler from within the initiating
+   * function rather than via @c boost::asio::io_service::post(). This avoids a
+   * trip through the @c io_service for each read of small records.
+   *
+   * A handler that starts another read may cause a further immediate
+   * invocation. Once @c max_depth handlers are active on the call stack, the
+   * next completion is posted instead, allowing the stack to unwind.
+   *
+   * @par Example
+   * @code
+   * urdl::read_stream stream(io_service);
+   * stream.immediate_completion(16);
+   * @endcode
+   */
+  void immediate_completion(std::size_t max_depth)
+  {
+    max_immediate_depth_ = max_depth;
   }
 
   /// Determines whether the stream is open.
@@ -222,12 +333,12 @@ public:
     switch (protocol_)
     {
     case file:
-      return file_.is_open();
+      return body_->file_->is_open();
     case http:
-      return http_.is_open();
+      return body_->http_->is_open();
 #if !defined(URDL_DISABLE_SSL)
     case https:
-      return https_.is_open();
+      return body_->https_->stream_.is_open();
 #endif // !defined(URDL_DISABLE_SSL)
     default:
       return false;
@@ -292,22 +403,22 @@ public:
     {
       if (tmp_url.protocol() == "file")
       {
-        protocol_ = file;
-        return file_.open(tmp_url, ec);
+        return select_file().open(tmp_url, ec);
       }
       else if (tmp_url.protocol() == "http")
       {
-        protocol_ = http;
-        http_.open(tmp_url, ec);
+        select_http().open(tmp_url, ec);
         if (ec == http::errc::moved_permanently || ec == http::errc::found)
         {
-          std::size_t max_redirects = options_.get_option<
+          std::size_t max_redirects = body_->options_.get_option<
               urdl::http::max_redirects>().value();
           if (redirects < max_redirects)
           {
             ++redirects;
-            tmp_url = http_.location();
-            http_.close(ec);
+            URDL_FLIGHT_RECORD(body_->http_->flight_recorder_id(),
+                redirect, redirects, ec);
+            tmp_url = body_->http_->location();
+            body_->http_->close(ec);
             continue;
           }
         }
@@ -316,17 +427,18 @@ public:
 #if !defined(URDL_DISABLE_SSL)
       else if (tmp_url.protocol() == "https")
       {
-        protocol_ = https;
-        https_.open(tmp_url, ec);
+        select_https().open(tmp_url, ec);
         if (ec == http::errc::moved_permanently || ec == http::errc::found)
         {
-          std::size_t max_redirects = options_.get_option<
+          std::size_t max_redirects = body_->options_.get_option<
               urdl::http::max_redirects>().value();
           if (redirects < max_redirects)
           {
             ++redirects;
-            tmp_url = https_.location();
-            https_.close(ec);
+            URDL_FLIGHT_RECORD(body_->https_->stream_.flight_recorder_id(),
+                redirect, redirects, ec);
+            tmp_url = body_->https_->stream_.location();
+            body_->https_->stream_.close(ec);
             continue;
           }
         }
@@ -428,12 +540,12 @@ public:
     switch (protocol_)
     {
     case file:
-      return file_.close(ec);
+      return body_->file_->close(ec);
     case http:
-      return http_.close(ec);
+      return body_->http_->close(ec);
 #if !defined(URDL_DISABLE_SSL)
     case https:
-      return https_.close(ec);
+      return body_->https_->stream_.close(ec);
 #endif // !defined(URDL_DISABLE_SSL)
     default:
       ec = boost::system::error_code();
@@ -443,6 +555,62 @@ public:
     return ec;
   }
 
+  /// Moves the position from which the content is read.
+  /**
+   * @param offset The offset within the content from which the next read is to
+   * start.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   *
+   * @par Remarks
+   * Only the content of a @c file URL may be repositioned. Any data that has
+   * been read into the stream's internal storage is discarded. There must be
+   * no asynchronous operation outstanding on the stream.
+   *
+   * To read part of the content of an @c http or @c https URL, open the URL
+   * with the @c urdl::http::byte_range option.
+   */
+  void seek(boost::uint64_t offset)
+  {
+    boost::system::error_code ec;
+    if (seek(offset, ec))
+    {
+      boost::system::system_error ex(ec);
+      boost::throw_exception(ex);
+    }
+  }
+
+  /// Moves the position from which the content is read.
+  /**
+   * @param offset The offset within the content from which the next read is to
+   * start.
+   *
+   * @param ec Set to indicate what error occurred, if any. Fails with
+   * @c boost::asio::error::operation_not_supported if the stream's URL does
+   * not have the @c file protocol.
+   *
+   * @returns @c ec.
+   *
+   * @par Remarks
+   * Only the content of a @c file URL may be repositioned. Any data that has
+   * been read into the stream's internal storage is discarded. There must be
+   * no asynchronous operation outstanding on the stream.
+   */
+  boost::system::error_code seek(boost::uint64_t offset,
+      boost::system::error_code& ec)
+  {
+    switch (protocol_)
+    {
+    case file:
+      if (!body_->file_->seek(offset, ec))
+        content_read_ = (offset != 0);
+      return ec;
+    default:
+      ec = boost::asio::error::operation_not_supported;
+      return ec;
+    }
+  }
+
   /// Gets the MIME type of the content obtained from the URL.
   /**
    * @returns A string specifying the MIME type. Examples of possible return
@@ -450,19 +618,20 @@ public:
    *
    * @par Remarks
    * Not all URL protocols support a content type. For these protocols, this
-   * function returns an empty string.
+   * function returns an empty string. The content type of a file is guessed
+   * from its extension if the @c urdl::file::guess_content_type option is set.
    */
   std::string content_type() const
   {
     switch (protocol_)
     {
     case file:
-      return std::string();
+      return body_->file_->content_type();
     case http:
-      return http_.content_type();
+      return body_->http_->content_type();
 #if !defined(URDL_DISABLE_SSL)
     case https:
-      return https_.content_type();
+      return body_->https_->stream_.content_type();
 #endif // !defined(URDL_DISABLE_SSL)
     default:
       return std::string();
@@ -474,18 +643,21 @@ public:
    * @returns The length, in bytes, of the content. If the content associated
    * with the URL does not specify a length,
    * @c std::numeric_limits<std::size_t>::max().
+   *
+   * @par Remarks
+   * The length of a file is its size when it was opened.
    */
   std::size_t content_length() const
   {
     switch (protocol_)
     {
     case file:
-      return ~std::size_t(0);
+      return body_->file_->content_length();
     case http:
-      return http_.content_length();
+      return body_->http_->content_length();
 #if !defined(URDL_DISABLE_SSL)
     case https:
-      return https_.content_length();
+      return body_->https_->stream_.content_length();
 #endif // !defined(URDL_DISABLE_SSL)
     default:
       return ~std::size_t(0);
@@ -497,18 +669,22 @@ public:
    * @returns A string containing the headers returned with the content from the
    * URL. The format and interpretation of these headers is specific to the
    * protocol associated with the URL.
+   *
+   * @par Remarks
+   * For a file, the headers give its @c Content-Length, @c Last-Modified time
+   * and, if known, @c Content-Type, in the same form as an HTTP response.
    */
   std::string headers() const
   {
     switch (protocol_)
     {
     case file:
-      return std::string();
+      return body_->file_->headers();
     case http:
-      return http_.headers();
+      return body_->http_->headers();
 #if !defined(URDL_DISABLE_SSL)
     case https:
-      return https_.headers();
+      return body_->https_->stream_.headers();
 #endif // !defined(URDL_DISABLE_SSL)
     default:
       return std::string();
@@ -595,15 +771,16 @@ public:
   std::size_t read_some(const MutableBufferSequence& buffers,
       boost::system::error_code& ec)
   {
+    content_read_ = true;
     switch (protocol_)
     {
     case file:
-      return file_.read_some(buffers, ec);
+      return body_->file_->read_some(buffers, ec);
     case http:
-      return http_.read_some(buffers, ec);
+      return body_->http_->read_some(buffers, ec);
 #if !defined(URDL_DISABLE_SSL)
     case https:
-      return https_.read_some(buffers, ec);
+      return body_->https_->stream_.read_some(buffers, ec);
 #endif // !defined(URDL_DISABLE_SSL)
     default:
       ec = boost::asio::error::operation_not_supported;
@@ -629,9 +806,10 @@ public:
    *   std::size_t bytes_transferred        // Number of bytes read.
    * );
    * @endcode
-   * Regardless of whether the asynchronous operation completes immediately or
-   * not, the handler will not be invoked from within this function. Invocation
-   * of the handler will be performed in a manner equivalent to using
+   * Unless enabled by @c immediate_completion, the handler will not be invoked
+   * from within this function, regardless of whether the asynchronous
+   * operation completes immediately or not. Invocation of the handler will be
+   * performed in a manner equivalent to using
    * @c boost::asio::io_service::post().
    *
    * @par Remarks
@@ -667,25 +845,644 @@ public:
     Handler real_handler(handler);
 #endif // (BOOST_VERSION >= 105400)
 
+    content_read_ = true;
+    if (immediate_depth_ < max_immediate_depth_ && data_is_available())
+    {
+      boost::system::error_code ec;
+      std::size_t bytes_transferred = read_some(buffers, ec);
+      immediate_depth_guard guard(immediate_depth_);
+      real_handler(ec, bytes_transferred);
+    }
+    else
+    {
+      switch (protocol_)
+      {
+      case file:
+        body_->file_->async_read_some(buffers, real_handler);
+        break;
+      case http:
+        body_->http_->async_read_some(buffers, real_handler);
+        break;
+#if !defined(URDL_DISABLE_SSL)
+      case https:
+        body_->https_->stream_.async_read_some(buffers, real_handler);
+        break;
+#endif // !defined(URDL_DISABLE_SSL)
+      default:
+        boost::system::error_code ec
+          = boost::asio::error::operation_not_supported;
+        io_service_->post(
+            boost::asio::detail::bind_handler(real_handler, ec, 0));
+        break;
+      }
+    }
+
+#if (BOOST_VERSION >= 105400)
+    return result.get();
+#endif // (BOOST_VERSION >= 105400)
+  }
+
+  /// Reads the remaining content into a container.
+  /**
+   * @param body The container into which the content will be read. It must
+   * be a @c std::string, a @c std::vector<char>, or a similar container of
+   * @c char with contiguous storage. Any existing contents are replaced.
+   *
+   * @param max_size The maximum number of bytes to read. If the content is
+   * larger, the operation fails with @c boost::asio::error::message_size.
+   *
+   * @returns The number of bytes read, which is also @c body.size().
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   *
+   * @par Remarks
+   * If the length of the content is known, the container is resized once to
+   * hold it. Otherwise the container grows geometrically as data arrives. In
+   * either case, data is read directly into the container's storage using
+   * reads that are as large as possible. Once any content has been read,
+   * consumed or skipped, the length of the remainder is treated as unknown.
+   *
+   * @par Example
+   * @code
+   * urdl::read_stream stream(io_service);
+   * stream.open("http://www.boost.org/LICENSE_1_0.txt");
+   * std::string body;
+   * stream.read_body(body);
+   * @endcode
+   */
+  template <typename Container>
+  std::size_t read_body(Container& body,
+      std::size_t max_size = ~std::size_t(0))
+  {
+    boost::system::error_code ec;
+    std::size_t bytes_transferred = read_body(body, max_size, ec);
+    if (ec)
+    {
+      boost::system::system_error ex(ec);
+      boost::throw_exception(ex);
+    }
+    return bytes_transferred;
+  }
+
+  /// Reads the remaining content into a container.
+  /**
+   * @param body The container into which the content will be read. It must
+   * be a @c std::string, a @c std::vector<char>, or a similar container of
+   * @c char with contiguous storage. Any existing contents are replaced.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   *
+   * @returns The number of bytes read, which is also @c body.size().
+   *
+   * @par Remarks
+   * Equivalent to <tt>read_body(body, ~std::size_t(0), ec)</tt>.
+   */
+  template <typename Container>
+  std::size_t read_body(Container& body, boost::system::error_code& ec)
+  {
+    return read_body(body, ~std::size_t(0), ec);
+  }
+
+  /// Reads the remaining content into a container.
+  /**
+   * @param body The container into which the content will be read. It must
+   * be a @c std::string, a @c std::vector<char>, or a similar container of
+   * @c char with contiguous storage. Any existing contents are replaced.
+   *
+   * @param max_size The maximum number of bytes to read. If the content is
+   * larger, the operation fails with @c boost::asio::error::message_size.
+   *
+   * @param ec Set to indicate what error occurred, if any. An error code of
+   * @c boost::asio::error::eof indicates that the content was shorter than
+   * the length given by @c content_length().
+   *
+   * @returns The number of bytes read, which is also @c body.size().
+   */
+  template <typename Container>
+  std::size_t read_body(Container& body, std::size_t max_size,
+      boost::system::error_code& ec)
+  {
+    return detail::read_body(*this, detail::container_body<Container>(body),
+        remaining_length(), max_size, ec);
+  }
+
+  /// Reads the remaining content into memory provided by the caller.
+  /**
+   * @param arena The memory into which the content will be read. Its size is
+   * the maximum number of bytes that may be read. If the content is larger,
+   * the operation fails with @c boost::asio::error::message_size.
+   *
+   * @returns The number of bytes read.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   *
+   * @par Example
+   * @code
+   * char arena[65536];
+   * std::size_t length = stream.read_body(boost::asio::buffer(arena));
+   * @endcode
+   */
+  std::size_t read_body(boost::asio::mutable_buffer arena)
+  {
+    boost::system::error_code ec;
+    std::size_t bytes_transferred = read_body(arena, ec);
+    if (ec)
+    {
+      boost::system::system_error ex(ec);
+      boost::throw_exception(ex);
+    }
+    return bytes_transferred;
+  }
+
+  /// Reads the remaining content into memory provided by the caller.
+  /**
+   * @param arena The memory into which the content will be read. Its size is
+   * the maximum number of bytes that may be read. If the content is larger,
+   * the operation fails with @c boost::asio::error::message_size.
+   *
+   * @param ec Set to indicate what error occurred, if any. An error code of
+   * @c boost::asio::error::eof indicates that the content was shorter than
+   * the length given by @c content_length().
+   *
+   * @returns The number of bytes read.
+   */
+  std::size_t read_body(boost::asio::mutable_buffer arena,
+      boost::system::error_code& ec)
+  {
+    return detail::read_body(*this, detail::arena_body(arena),
+        remaining_length(), ~std::size_t(0), ec);
+  }
+
+  /// Asynchronously reads the remaining content into a container.
+  /**
+   * @param body The container into which the content will be read. It must
+   * be a @c std::string, a @c std::vector<char>, or a similar container of
+   * @c char with contiguous storage. Any existing contents are replaced.
+   * Ownership of the container is retained by the caller, which must
+   * guarantee that it remains valid until the handler is called.
+   *
+   * @param handler The handler to be called when the read operation completes.
+   * Copies will be made of the handler as required. The function signature of
+   * the handler must be:
+   * @code
+   * void handler(
+   *   const boost::system::error_code& ec, // Result of operation.
+   *   std::size_t bytes_transferred        // Number of bytes read.
+   * );
+   * @endcode
+   *
+   * @par Remarks
+   * Equivalent to <tt>async_read_body(body, ~std::size_t(0), handler)</tt>.
+   */
+  template <typename Container, typename Handler>
+  URDL_INITFN_RESULT_TYPE(Handler,
+      void (boost::system::error_code, std::size_t))
+  async_read_body(Container& body, Handler handler)
+  {
+    return async_read_body(body, ~std::size_t(0), handler);
+  }
+
+  /// Asynchronously reads the remaining content into a container.
+  /**
+   * @param body The container into which the content will be read. It must
+   * be a @c std::string, a @c std::vector<char>, or a similar container of
+   * @c char with contiguous storage. Any existing contents are replaced.
+   * Ownership of the container is retained by the caller, which must
+   * guarantee that it remains valid until the handler is called.
+   *
+   * @param max_size The maximum number of bytes to read. If the content is
+   * larger, the operation fails with @c boost::asio::error::message_size.
+   *
+   * @param handler The handler to be called when the read operation completes.
+   * Copies will be made of the handler as required. The function signature of
+   * the handler must be:
+   * @code
+   * void handler(
+   *   const boost::system::error_code& ec, // Result of operation.
+   *   std::size_t bytes_transferred        // Number of bytes read.
+   * );
+   * @endcode
+   * Unless enabled by @c immediate_completion, the handler will not be invoked
+   * from within this function. Invocation of the handler will be performed in
+   * a manner equivalent to using @c boost::asio::io_service::post().
+   *
+   * @par Remarks
+   * If the length of the content is known, the container is resized once to
+   * hold it. Otherwise the container grows geometrically as data arrives.
+   * Once any content has been read, consumed or skipped, the length of the
+   * remainder is treated as unknown.
+   */
+  template <typename Container, typename Handler>
+  URDL_INITFN_RESULT_TYPE(Handler,
+      void (boost::system::error_code, std::size_t))
+  async_read_body(Container& body, std::size_t max_size, Handler handler)
+  {
+#if (BOOST_VERSION >= 105400)
+    typedef typename boost::asio::handler_type<Handler,
+      void (boost::system::error_code, std::size_t)>::type real_handler_type;
+    real_handler_type real_handler(handler);
+    boost::asio::async_result<real_handler_type> result(real_handler);
+#else // (BOOST_VERSION >= 105400)
+    Handler real_handler(handler);
+#endif // (BOOST_VERSION >= 105400)
+
+    detail::async_read_body(*this, detail::container_body<Container>(body),
+        remaining_length(), max_size, real_handler);
+
+#if (BOOST_VERSION >= 105400)
+    return result.get();
+#endif // (BOOST_VERSION >= 105400)
+  }
+
+  /// Asynchronously reads the remaining content into memory provided by the
+  /// caller.
+  /**
+   * @param arena The memory into which the content will be read. Its size is
+   * the maximum number of bytes that may be read. If the content is larger,
+   * the operation fails with @c boost::asio::error::message_size. Ownership
+   * of the memory is retained by the caller, which must guarantee that it
+   * remains valid until the handler is called.
+   *
+   * @param handler The handler to be called when the read operation completes.
+   * Copies will be made of the handler as required. The function signature of
+   * the handler must be:
+   * @code
+   * void handler(
+   *   const boost::system::error_code& ec, // Result of operation.
+   *   std::size_t bytes_transferred        // Number of bytes read.
+   * );
+   * @endcode
+   * Unless enabled by @c immediate_completion, the handler will not be invoked
+   * from within this function. Invocation of the handler will be performed in
+   * a manner equivalent to using @c boost::asio::io_service::post().
+   */
+  template <typename Handler>
+  URDL_INITFN_RESULT_TYPE(Handler,
+      void (boost::system::error_code, std::size_t))
+  async_read_body(boost::asio::mutable_buffer arena, Handler handler)
+  {
+#if (BOOST_VERSION >= 105400)
+    typedef typename boost::asio::handler_type<Handler,
+      void (boost::system::error_code, std::size_t)>::type real_handler_type;
+    real_handler_type real_handler(handler);
+    boost::asio::async_result<real_handler_type> result(real_handler);
+#else // (BOOST_VERSION >= 105400)
+    Handler real_handler(handler);
+#endif // (BOOST_VERSION >= 105400)
+
+    detail::async_read_body(*this, detail::arena_body(arena),
+        remaining_length(), ~std::size_t(0), real_handler);
+
+#if (BOOST_VERSION >= 105400)
+    return result.get();
+#endif // (BOOST_VERSION >= 105400)
+  }
+
+  /// Reads the remaining content into a file.
+  /**
+   * @param path The name of the file to write. The file is created if it does
+   * not exist, and truncated if it does.
+   *
+   * @returns The number of bytes written to the file.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   *
+   * @par Remarks
+   * If the length of the content is known, and none of it has yet been read,
+   * consumed or skipped, the file's space is allocated in one go and the file
+   * is mapped into memory, so that the content is read directly into the
+   * file's pages. Otherwise, on Linux, content retrieved
+   * using plain HTTP is moved from the socket to the file using @c splice(),
+   * so that it is not copied through user space. Other content is copied
+   * through the stream's internal buffer. These optimisations may be disabled
+   * by defining @c URDL_DISABLE_MAPPED_FILE and @c URDL_DISABLE_SPLICE
+   * respectively.
+   *
+   * @par Example
+   * @code
+   * urdl::read_stream stream(io_service);
+   * stream.open("http://www.boost.org/LICENSE_1_0.txt");
+   * stream.read_to_file("LICENSE_1_0.txt");
+   * @endcode
+   */
+  std::size_t read_to_file(const std::string& path)
+  {
+    boost::system::error_code ec;
+    std::size_t bytes_transferred = read_to_file(path, ec);
+    if (ec)
+    {
+      boost::system::system_error ex(ec);
+      boost::throw_exception(ex);
+    }
+    return bytes_transferred;
+  }
+
+  /// Reads the remaining content into a file.
+  /**
+   * @param path The name of the file to write. The file is created if it does
+   * not exist, and truncated if it does.
+   *
+   * @param ec Set to indicate what error occurred, if any. An error code of
+   * @c boost::asio::error::eof indicates that the content was shorter than
+   * the length given by @c content_length().
+   *
+   * @returns The number of bytes written to the file.
+   */
+  std::size_t read_to_file(const std::string& path,
+      boost::system::error_code& ec)
+  {
+#if defined(URDL_HAS_MAPPED_FILE)
+    std::size_t length = remaining_length();
+    if (length != 0 && length != ~std::size_t(0))
+    {
+      detail::mapped_file file;
+      if (file.open(path, length, ec))
+        return 0;
+      return detail::read_to_mapped_file(*this, file, ec);
+    }
+#endif // defined(URDL_HAS_MAPPED_FILE)
+#if defined(URDL_HAS_SPLICE)
+    if (protocol_ == http)
+    {
+      detail::splice_file file;
+      if (file.open(path, ec))
+        return 0;
+      return body_->http_->splice_to_file(file, ec);
+    }
+#endif // defined(URDL_HAS_SPLICE)
+    return detail::read_to_file(*this, path, ec);
+  }
+
+  /// Asynchronously reads the remaining content into a file.
+  /**
+   * @param path The name of the file to write. The file is created if it does
+   * not exist, and truncated if it does.
+   *
+   * @param handler The handler to be called when the read operation completes.
+   * Copies will be made of the handler as required. The function signature of
+   * the handler must be:
+   * @code
+   * void handler(
+   *   const boost::system::error_code& ec, // Result of operation.
+   *   std::size_t bytes_transferred        // Number of bytes written.
+   * );
+   * @endcode
+   * Unless enabled by @c immediate_completion, the handler will not be invoked
+   * from within this function. Invocation of the handler will be performed in
+   * a manner equivalent to using @c boost::asio::io_service::post().
+   *
+   * @par Remarks
+   * See @c read_to_file for when the content is moved using @c splice().
+   */
+  template <typename Handler>
+  URDL_INITFN_RESULT_TYPE(Handler,
+      void (boost::system::error_code, std::size_t))
+  async_read_to_file(const std::string& path, Handler handler)
+  {
+#if (BOOST_VERSION >= 105400)
+    typedef typename boost::asio::handler_type<Handler,
+      void (boost::system::error_code, std::size_t)>::type real_handler_type;
+    real_handler_type real_handler(handler);
+    boost::asio::async_result<real_handler_type> result(real_handler);
+#else // (BOOST_VERSION >= 105400)
+    Handler real_handler(handler);
+#endif // (BOOST_VERSION >= 105400)
+
+#if defined(URDL_HAS_MAPPED_FILE)
+    std::size_t length = remaining_length();
+    if (length != 0 && length != ~std::size_t(0))
+    {
+      boost::shared_ptr<detail::mapped_file> file(new detail::mapped_file);
+      boost::system::error_code ec;
+      if (file->open(path, length, ec))
+      {
+        io_service_->post(boost::asio::detail::bind_handler(
+              real_handler, ec, std::size_t(0)));
+      }
+      else
+      {
+        detail::async_read_to_mapped_file(*this, file, real_handler);
+      }
+    }
+    else
+#endif // defined(URDL_HAS_MAPPED_FILE)
+#if defined(URDL_HAS_SPLICE)
+    if (protocol_ == http)
+    {
+      boost::shared_ptr<detail::splice_file> file(new detail::splice_file);
+      boost::system::error_code ec;
+      if (file->open(path, ec))
+      {
+        io_service_->post(boost::asio::detail::bind_handler(
+              real_handler, ec, std::size_t(0)));
+      }
+      else
+      {
+        body_->http_->async_splice_to_file(file, real_handler);
+      }
+    }
+    else
+#endif // defined(URDL_HAS_SPLICE)
+    {
+      detail::async_read_to_file(*this, path, real_handler);
+    }
+
+#if (BOOST_VERSION >= 105400)
+    return result.get();
+#endif // (BOOST_VERSION >= 105400)
+  }
+
+  /// Gets the data that has been read from the URL but not yet consumed.
+  /**
+   * @returns A buffer referring to the stream's internal storage. The buffer
+   * is invalidated by any subsequent operation on the stream, other than
+   * @c data.
+   *
+   * @par Remarks
+   * Together with @c fill and @c consume, this allows the content to be
+   * inspected in place, without copying it into a buffer owned by the caller.
+   * Data that is buffered by the stream is also returned by @c read_some and
+   * @c async_read_some, ahead of any new data.
+   *
+   * @par Example
+   * @code
+   * boost::system::error_code ec;
+   * while (read_stream.fill(ec) > 0)
+   * {
+   *   boost::asio::const_buffers_1 b = read_stream.data();
+   *   parser.parse(boost::asio::buffer_cast<const char*>(b),
+   *       boost::asio::buffer_size(b));
+   *   read_stream.consume(boost::asio::buffer_size(b));
+   * }
+   * @endcode
+   */
+  boost::asio::const_buffers_1 data() const
+  {
     switch (protocol_)
     {
     case file:
-      file_.async_read_some(buffers, real_handler);
+      return body_->file_->data();
+    case http:
+      return body_->http_->data();
+#if !defined(URDL_DISABLE_SSL)
+    case https:
+      return body_->https_->stream_.data();
+#endif // !defined(URDL_DISABLE_SSL)
+    default:
+      return boost::asio::const_buffers_1(0, 0);
+    }
+  }
+
+  /// Removes data from the front of the stream's internal storage.
+  /**
+   * @param n The number of bytes to remove. If greater than the size of
+   * @c data(), all of the buffered data is removed.
+   */
+  void consume(std::size_t n)
+  {
+    if (n > 0)
+      content_read_ = true;
+    switch (protocol_)
+    {
+    case file:
+      body_->file_->consume(n);
       break;
     case http:
-      http_.async_read_some(buffers, real_handler);
+      body_->http_->consume(n);
       break;
 #if !defined(URDL_DISABLE_SSL)
     case https:
-      https_.async_read_some(buffers, real_handler);
+      body_->https_->stream_.consume(n);
       break;
 #endif // !defined(URDL_DISABLE_SSL)
     default:
-      boost::system::error_code ec
-        = boost::asio::error::operation_not_supported;
-      io_service_.post(boost::asio::detail::bind_handler(real_handler, ec, 0));
       break;
     }
+  }
+
+  /// Ensures that the stream's internal storage contains some data.
+  /**
+   * @returns The size of @c data() after the operation.
+   *
+   * @throws boost::system::system_error Thrown on failure. An error code of
+   * @c boost::asio::error::eof indicates that the end of the URL content has
+   * been reached.
+   *
+   * @par Remarks
+   * If @c data() is not empty, the function returns immediately. Otherwise it
+   * blocks until one or more bytes have been read into the stream's internal
+   * storage, or until an error occurs.
+   */
+  std::size_t fill()
+  {
+    boost::system::error_code ec;
+    std::size_t bytes_available = fill(ec);
+    if (ec)
+    {
+      boost::system::system_error ex(ec);
+      boost::throw_exception(ex);
+    }
+    return bytes_available;
+  }
+
+  /// Ensures that the stream's internal storage contains some data.
+  /**
+   * @param ec Set to indicate what error occurred, if any. An error code of
+   * @c boost::asio::error::eof indicates that the end of the URL content has
+   * been reached.
+   *
+   * @returns The size of @c data() after the operation.
+   *
+   * @par Remarks
+   * If @c data() is not empty, the function returns immediately. Otherwise it
+   * blocks until one or more bytes have been read into the stream's internal
+   * storage, or until an error occurs.
+   */
+  std::size_t fill(boost::system::error_code& ec)
+  {
+    switch (protocol_)
+    {
+    case file:
+      return body_->file_->fill(ec);
+    case http:
+      return body_->http_->fill(ec);
+#if !defined(URDL_DISABLE_SSL)
+    case https:
+      return body_->https_->stream_.fill(ec);
+#endif // !defined(URDL_DISABLE_SSL)
+    default:
+      ec = boost::asio::error::operation_not_supported;
+      return 0;
+    }
+  }
+
+  /// Asynchronously ensures that the stream's internal storage contains some
+  /// data.
+  /**
+   * @param handler The handler to be called when the fill operation completes.
+   * Copies will be made of the handler as required. The function signature of
+   * the handler must be:
+   * @code
+   * void handler(
+   *   const boost::system::error_code& ec, // Result of operation.
+   *   std::size_t bytes_available          // The size of data().
+   * );
+   * @endcode
+   * Unless enabled by @c immediate_completion, the handler will not be invoked
+   * from within this function, regardless of whether the asynchronous
+   * operation completes immediately or not. Invocation of the handler will be
+   * performed in a manner equivalent to using
+   * @c boost::asio::io_service::post().
+   *
+   * @par Remarks
+   * If @c data() is not empty, the operation completes immediately. Otherwise
+   * it continues until one or more bytes have been read into the stream's
+   * internal storage, or until an error occurs.
+   */
+  template <typename Handler>
+  URDL_INITFN_RESULT_TYPE(Handler,
+      void (boost::system::error_code, std::size_t))
+  async_fill(Handler handler)
+  {
+#if (BOOST_VERSION >= 105400)
+    typedef typename boost::asio::handler_type<Handler,
+      void (boost::system::error_code, std::size_t)>::type real_handler_type;
+    real_handler_type real_handler(handler);
+    boost::asio::async_result<real_handler_type> result(real_handler);
+#else // (BOOST_VERSION >= 105400)
+    Handler real_handler(handler);
+#endif // (BOOST_VERSION >= 105400)
+
+    if (immediate_depth_ < max_immediate_depth_ && data_is_available())
+    {
+      boost::system::error_code ec;
+      std::size_t bytes_available = fill(ec);
+      immediate_depth_guard guard(immediate_depth_);
+      real_handler(ec, bytes_available);
+    }
+    else
+    {
+      switch (protocol_)
+      {
+      case file:
+        body_->file_->async_fill(real_handler);
+        break;
+      case http:
+        body_->http_->async_fill(real_handler);
+        break;
+#if !defined(URDL_DISABLE_SSL)
+      case https:
+        body_->https_->stream_.async_fill(real_handler);
+        break;
+#endif // !defined(URDL_DISABLE_SSL)
+      default:
+        boost::system::error_code ec
+          = boost::asio::error::operation_not_supported;
+        io_service_->post(
+            boost::asio::detail::bind_handler(real_handler, ec, 0));
+        break;
+      }
+    }
 
 #if (BOOST_VERSION >= 105400)
     return result.get();
@@ -693,6 +1490,41 @@ public:
   }
 
 private:
+  // Determines whether a read can complete without waiting for the network.
+  bool data_is_available() const
+  {
+    switch (protocol_)
+    {
+    case file:
+      return body_->file_->data_is_available();
+    case http:
+      return boost::asio::buffer_size(body_->http_->data()) > 0;
+#if !defined(URDL_DISABLE_SSL)
+    case https:
+      return boost::asio::buffer_size(body_->https_->stream_.data()) > 0;
+#endif // !defined(URDL_DISABLE_SSL)
+    default:
+      return false;
+    }
+  }
+
+  // Tracks the number of handlers being invoked immediately on the stack.
+  struct immediate_depth_guard
+  {
+    explicit immediate_depth_guard(std::size_t& depth)
+      : depth_(depth)
+    {
+      ++depth_;
+    }
+
+    ~immediate_depth_guard()
+    {
+      --depth_;
+    }
+
+    std::size_t& depth_;
+  };
+
   template <typename Handler>
   class open_coro : detail::coroutine
   {
@@ -700,6 +1532,7 @@ private:
     open_coro(read_stream* this_ptr, const url& u, Handler handler)
       : this_(this_ptr),
         url_(u),
+        redirects_(0),
         handler_(handler)
     {
     }
@@ -712,19 +1545,20 @@ private:
       {
         if (url_.protocol() == "file")
         {
-          this_->protocol_ = file;
-          URDL_CORO_YIELD(this_->file_.async_open(url_, *this));
+          URDL_CORO_YIELD(this_->select_file().async_open(url_, *this));
           handler_(ec);
           return;
         }
         else if (url_.protocol() == "http")
         {
-          this_->protocol_ = http;
-          URDL_CORO_YIELD(this_->http_.async_open(url_, *this));
+          URDL_CORO_YIELD(this_->select_http().async_open(url_, *this));
           if (ec == http::errc::moved_permanently || ec == http::errc::found)
           {
-            url_ = this_->http_.location();
-            this_->http_.close(ec);
+            ++redirects_;
+            URDL_FLIGHT_RECORD(this_->body_->http_->flight_recorder_id(),
+                redirect, redirects_, ec);
+            url_ = this_->body_->http_->location();
+            this_->body_->http_->close(ec);
             continue;
           }
           handler_(ec);
@@ -733,12 +1567,15 @@ private:
 #if !defined(URDL_DISABLE_SSL)
         else if (url_.protocol() == "https")
         {
-          this_->protocol_ = https;
-          URDL_CORO_YIELD(this_->https_.async_open(url_, *this));
+          URDL_CORO_YIELD(this_->select_https().async_open(url_, *this));
           if (ec == http::errc::moved_permanently || ec == http::errc::found)
           {
-            url_ = this_->https_.location();
-            this_->https_.close(ec);
+            ++redirects_;
+            URDL_FLIGHT_RECORD(
+                this_->body_->https_->stream_.flight_recorder_id(),
+                redirect, redirects_, ec);
+            url_ = this_->body_->https_->stream_.location();
+            this_->body_->https_->stream_.close(ec);
             continue;
           }
           handler_(ec);
@@ -748,7 +1585,7 @@ private:
         else
         {
           ec = boost::asio::error::operation_not_supported;
-          this_->io_service_.post(
+          this_->io_service_->post(
               boost::asio::detail::bind_handler(handler_, ec));
           return;
         }
@@ -790,22 +1627,114 @@ private:
   private:
     read_stream* this_;
     url url_;
+    std::size_t redirects_;
     Handler handler_;
   };
 
   template <typename Handler> friend class open_coro;
 
-  boost::asio::io_service& io_service_;
-  option_set options_;
-  detail::file_read_stream file_;
-  detail::http_read_stream<boost::asio::ip::tcp::socket> http_;
+  // Disallow copying and assignment.
+  read_stream(const read_stream&);
+  read_stream& operator=(const read_stream&);
+
+#if !defined(URDL_DISABLE_SSL)
+  // The backend for https, together with the SSL context that it uses.
+  struct https_stream
+  {
+    https_stream(boost::asio::io_service& io_service, option_set& options)
+      : ssl_context_(io_service, boost::asio::ssl::context::sslv23),
+        stream_(io_service, options, ssl_context_)
+    {
+      ssl_context_.set_verify_mode(boost::asio::ssl::context::verify_peer);
+      SSL_CTX_set_default_verify_paths(ssl_context_.impl());
+    }
+
+    boost::asio::ssl::context ssl_context_;
+    detail::http_read_stream<
+        boost::asio::ssl::stream<
+          boost::asio::ip::tcp::socket> > stream_;
+  };
+#endif // !defined(URDL_DISABLE_SSL)
+
+  // The options, and the protocol backends that refer to them. The body is
+  // created when first needed, and each backend when a URL using its protocol
+  // is first opened. Holding them on the heap also allows the stream to be
+  // moved without moving them.
+  struct body
+  {
+    option_set options_;
+    detail::scoped_ptr<detail::file_read_stream> file_;
+    detail::scoped_ptr<
+        detail::http_read_stream<boost::asio::ip::tcp::socket> > http_;
+#if !defined(URDL_DISABLE_SSL)
+    detail::scoped_ptr<https_stream> https_;
+#endif // !defined(URDL_DISABLE_SSL)
+  };
+
+  body& get_body()
+  {
+    if (!body_)
+      body_ = new body;
+    return *body_;
+  }
+
+  // Gets the number of bytes of content that remain to be read, if known.
+  std::size_t remaining_length() const
+  {
+    return content_read_ ? ~std::size_t(0) : content_length();
+  }
+
+  // Make the backend for a protocol the current one, creating it if this is
+  // the first URL opened using that protocol.
+
+  detail::file_read_stream& select_file()
+  {
+    body& b = get_body();
+    if (!b.file_.get())
+      b.file_.reset(new detail::file_read_stream(*io_service_, b.options_));
+    protocol_ = file;
+    content_read_ = false;
+    return *b.file_;
+  }
+
+  detail::http_read_stream<boost::asio::ip::tcp::socket>& select_http()
+  {
+    body& b = get_body();
+    if (!b.http_.get())
+    {
+      b.http_.reset(new detail::http_read_stream<
+          boost::asio::ip::tcp::socket>(*io_service_, b.options_));
+    }
+    protocol_ = http;
+    content_read_ = false;
+    return *b.http_;
+  }
+
 #if !defined(URDL_DISABLE_SSL)
-  boost::asio::ssl::context ssl_context_;
   detail::http_read_stream<
       boost::asio::ssl::stream<
-        boost::asio::ip::tcp::socket> > https_;
+        boost::asio::ip::tcp::socket> >& select_https()
+  {
+    body& b = get_body();
+    if (!b.https_.get())
+      b.https_.reset(new https_stream(*io_service_, b.options_));
+    protocol_ = https;
+    content_read_ = false;
+    return b.https_->stream_;
+  }
 #endif // !defined(URDL_DISABLE_SSL)
+
+  boost::asio::io_service* io_service_;
+  body* body_;
   enum { unknown, file, http, https } protocol_;
+
+  // Whether any content has been read, consumed or skipped since the URL was
+  // opened, in which case content_length() no longer gives the number of
+  // bytes that remain.
+  bool content_read_;
+
+  std::size_t max_immediate_depth_;
+  std::size_t immediate_depth_;
 };
 
 } // namespace urdl
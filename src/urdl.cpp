@@ -4,6 +4,12 @@
 
 #define URDL_SOURCE
 
+#include "urdl/flight_recorder.hpp"
+#include "urdl/impl/flight_recorder.ipp"
+
+#include "urdl/io_engine.hpp"
+#include "urdl/impl/io_engine.ipp"
+
 #include "urdl/istreambuf.hpp"
 #include "urdl/impl/istreambuf.ipp"
 
@@ -13,5 +19,8 @@
 #include "urdl/option_set.hpp"
 #include "urdl/impl/option_set.ipp"
 
+#include "urdl/random_access_reader.hpp"
+#include "urdl/impl/random_access_reader.ipp"
+
 #include "urdl/url.hpp"
 #include "urdl/impl/url.ipp"
@@ -0,0 +1,178 @@
+//
+// flight_recorder.cpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Disable autolinking for unit tests.
+#if !defined(BOOST_ALL_NO_LIB)
+#define BOOST_ALL_NO_LIB 1
+#endif // !defined(BOOST_ALL_NO_LIB)
+
+// Test that header file is self-contained.
+#include "urdl/flight_recorder.hpp"
+
+#include "unit_test.hpp"
+#include "urdl/http.hpp"
+#include <boost/thread.hpp>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+// Ensure all functions compile correctly.
+void flight_recorder_compile_test()
+{
+  boost::system::error_code ec;
+  std::ostringstream os;
+
+  // record()
+
+  urdl::flight_recorder::record(0, urdl::flight_recorder::open_start, 0, ec);
+
+  // enabled()
+
+  want<bool>(urdl::flight_recorder::enabled());
+  urdl::flight_recorder::enabled(true);
+
+  // dump()
+
+  urdl::flight_recorder::dump(os);
+
+  // stage_name()
+
+  want<const char*>(urdl::flight_recorder::stage_name(0));
+}
+
+// Test that recorded events can be read back from a dump.
+void flight_recorder_runtime_test()
+{
+  int stream = 0;
+  urdl::flight_recorder::record(&stream,
+      urdl::flight_recorder::read_complete, 1234,
+      boost::system::error_code());
+  urdl::flight_recorder::record(&stream,
+      urdl::flight_recorder::open_complete, 0,
+      urdl::http::errc::not_found);
+
+  std::ostringstream os;
+  urdl::flight_recorder::dump(os);
+  std::string data = os.str();
+  const char* p = data.data();
+
+  urdl::flight_recorder::file_header header;
+  BOOST_REQUIRE(data.size() >= sizeof(header));
+  std::memcpy(&header, p, sizeof(header));
+  p += sizeof(header);
+  BOOST_CHECK(std::memcmp(header.magic, "URDLFR1", 8) == 0);
+  BOOST_CHECK(header.event_size == sizeof(urdl::flight_recorder::event));
+  BOOST_CHECK(header.ticks_per_second > 0);
+  BOOST_REQUIRE(header.threads >= 1);
+
+  urdl::flight_recorder::thread_header th;
+  std::memcpy(&th, p, sizeof(th));
+  p += sizeof(th);
+  BOOST_REQUIRE(th.events >= 2);
+
+  urdl::flight_recorder::event e1, e2;
+  p += (th.events - 2) * sizeof(urdl::flight_recorder::event);
+  std::memcpy(&e1, p, sizeof(e1));
+  std::memcpy(&e2, p + sizeof(e1), sizeof(e2));
+
+  BOOST_CHECK(e1.stage == urdl::flight_recorder::read_complete);
+  BOOST_CHECK(e1.bytes == 1234);
+  BOOST_CHECK(e1.category == urdl::flight_recorder::no_error);
+  BOOST_CHECK(e2.stage == urdl::flight_recorder::open_complete);
+  BOOST_CHECK(e2.category == urdl::flight_recorder::http_error);
+  BOOST_CHECK(e2.error == urdl::http::errc::not_found);
+  BOOST_CHECK(e1.stream == e2.stream);
+  BOOST_CHECK(e1.timestamp <= e2.timestamp);
+  BOOST_CHECK(std::strcmp(urdl::flight_recorder::stage_name(e1.stage),
+        "read_complete") == 0);
+}
+
+// Counts the events in a dump, and the thread blocks that contain them.
+void count_dumped_events(std::size_t& threads, std::size_t& events)
+{
+  std::ostringstream os;
+  urdl::flight_recorder::dump(os);
+  std::string data = os.str();
+  const char* p = data.data();
+
+  urdl::flight_recorder::file_header header;
+  std::memcpy(&header, p, sizeof(header));
+  p += sizeof(header);
+
+  threads = header.threads;
+  events = 0;
+  for (std::size_t i = 0; i < header.threads; ++i)
+  {
+    urdl::flight_recorder::thread_header th;
+    std::memcpy(&th, p, sizeof(th));
+    p += sizeof(th) + th.events * sizeof(urdl::flight_recorder::event);
+    events += th.events;
+  }
+}
+
+// Test that no events are recorded while recording is switched off.
+void flight_recorder_disabled_test()
+{
+  int stream = 0;
+  urdl::flight_recorder::record(&stream,
+      urdl::flight_recorder::read_complete, 1, boost::system::error_code());
+
+  std::size_t threads = 0, events = 0;
+  count_dumped_events(threads, events);
+
+  urdl::flight_recorder::enabled(false);
+  BOOST_CHECK(!urdl::flight_recorder::enabled());
+  urdl::flight_recorder::record(&stream,
+      urdl::flight_recorder::read_complete, 2, boost::system::error_code());
+  urdl::flight_recorder::enabled(true);
+
+  std::size_t new_threads = 0, new_events = 0;
+  count_dumped_events(new_threads, new_events);
+  BOOST_CHECK(new_threads == threads);
+  BOOST_CHECK(new_events == events);
+}
+
+void record_one_event()
+{
+  int stream = 0;
+  urdl::flight_recorder::record(&stream,
+      urdl::flight_recorder::read_complete, 1, boost::system::error_code());
+}
+
+// Test that the buffers of threads that have exited are reused.
+void flight_recorder_thread_reuse_test()
+{
+  boost::thread(record_one_event).join();
+
+  std::size_t threads = 0, events = 0;
+  count_dumped_events(threads, events);
+
+  for (int i = 0; i < 10; ++i)
+    boost::thread(record_one_event).join();
+
+  std::size_t new_threads = 0, new_events = 0;
+  count_dumped_events(new_threads, new_events);
+#if defined(BOOST_WINDOWS)
+  BOOST_CHECK(new_threads == threads + 10);
+#else // defined(BOOST_WINDOWS)
+  BOOST_CHECK(new_threads == threads);
+  BOOST_CHECK(new_events == events);
+#endif // defined(BOOST_WINDOWS)
+}
+
+test_suite* init_unit_test_suite(int, char*[])
+{
+  test_suite* test = BOOST_TEST_SUITE("flight_recorder");
+  test->add(BOOST_TEST_CASE(&flight_recorder_compile_test));
+  test->add(BOOST_TEST_CASE(&flight_recorder_runtime_test));
+  test->add(BOOST_TEST_CASE(&flight_recorder_disabled_test));
+  test->add(BOOST_TEST_CASE(&flight_recorder_thread_reuse_test));
+  return test;
+}
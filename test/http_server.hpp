@@ -22,6 +22,7 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
+#include <string>
 
 // Helper class to test HTTP client functionality.
 class http_server
@@ -115,4 +116,37 @@ private:
   bool success_;
 };
 
+// Returns content of the given size in which each byte depends on its offset.
+inline std::string make_content(std::size_t size)
+{
+  std::string content(size, 0);
+  for (std::size_t i = 0; i < content.size(); ++i)
+    content[i] = static_cast<char>('a' + (i * 7 + i / 26) % 26);
+  return content;
+}
+
+// Returns the request sent by urdl for the root of a server on the given port.
+// Any extra headers, each terminated by CRLF, are inserted before the
+// Connection header.
+inline std::string make_request(const std::string& port,
+    const std::string& extra_headers = std::string())
+{
+  return "GET / HTTP/1.0\r\n"
+    "Host: localhost:" + port + "\r\n"
+    "Accept: */*\r\n"
+    + extra_headers +
+    "Connection: close\r\n\r\n";
+}
+
+// Returns the status line and headers of a response with plain text content of
+// the given length.
+inline std::string make_response(std::size_t content_length,
+    const std::string& status = "200 OK")
+{
+  return "HTTP/1.0 " + status + "\r\n"
+    "Content-Length: " + boost::lexical_cast<std::string>(content_length)
+    + "\r\n"
+    "Content-Type: text/plain\r\n\r\n";
+}
+
 #endif // HTTP_SERVER_HPP
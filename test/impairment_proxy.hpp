@@ -0,0 +1,433 @@
+//
+// impairment_proxy.hpp
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef IMPAIRMENT_PROXY_HPP
+#define IMPAIRMENT_PROXY_HPP
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <deque>
+#include <vector>
+
+// Describes the network conditions simulated by an impairment_proxy. Times are
+// in milliseconds and a value of zero disables the corresponding impairment.
+struct impairment
+{
+  impairment()
+    : rtt(0),
+      jitter(0),
+      bandwidth(0),
+      stall_after(0),
+      stall_duration(0),
+      drip_size(0),
+      drip_interval(0),
+      reset_after(0),
+      seed(1)
+  {
+  }
+
+  // Round trip time. Half is added to the data in each direction.
+  std::size_t rtt;
+
+  // The maximum random delay added to each segment, in each direction. Data
+  // is never reordered, so jitter only ever makes a segment later.
+  std::size_t jitter;
+
+  // The link capacity in each direction, in bytes per second.
+  std::size_t bandwidth;
+
+  // Once this many bytes have been sent to the client, pause for
+  // stall_duration before sending any more.
+  std::size_t stall_after;
+  std::size_t stall_duration;
+
+  // Send data to the client in pieces of at most drip_size bytes, waiting
+  // drip_interval between pieces.
+  std::size_t drip_size;
+  std::size_t drip_interval;
+
+  // Once this many bytes have been sent to the client, abort both connections
+  // with a TCP reset.
+  std::size_t reset_after;
+
+  // Seed for the jitter, so that a run can be reproduced.
+  boost::uint32_t seed;
+};
+
+// A TCP proxy that forwards connections to a port on the loopback interface,
+// simulating a slow or unreliable network between the client and the server.
+// The stall, drip and reset impairments apply only to data sent to the client,
+// and count every byte of the response, including the headers.
+class impairment_proxy
+{
+public:
+  typedef boost::asio::ip::tcp tcp;
+
+  explicit impairment_proxy(unsigned short target_port,
+      const impairment& i = impairment())
+    : acceptor_(io_service_, tcp::endpoint(
+          boost::asio::ip::address_v4::loopback(), 0)),
+      target_(boost::asio::ip::address_v4::loopback(), target_port),
+      impairment_(i),
+      random_(i.seed)
+  {
+    start_accept();
+    thread_.reset(new boost::thread(
+          boost::bind(&boost::asio::io_service::run, &io_service_)));
+  }
+
+  ~impairment_proxy()
+  {
+    io_service_.stop();
+    thread_->join();
+  }
+
+  unsigned short port() const
+  {
+    return acceptor_.local_endpoint().port();
+  }
+
+private:
+  typedef boost::posix_time::ptime time_type;
+
+  static time_type now()
+  {
+    return boost::posix_time::microsec_clock::universal_time();
+  }
+
+  static boost::posix_time::time_duration milliseconds(std::size_t ms)
+  {
+    return boost::posix_time::milliseconds(static_cast<long>(ms));
+  }
+
+  class connection;
+
+  // Copies data in one direction, holding each segment until the simulated
+  // network would have delivered it.
+  class pump
+  {
+  public:
+    pump(connection& c, tcp::socket& from, tcp::socket& to, bool downstream)
+      : connection_(c),
+        from_(from),
+        to_(to),
+        timer_(c.owner_.io_service_),
+        downstream_(downstream),
+        reading_(false),
+        writing_(false),
+        eof_(false),
+        queued_bytes_(0),
+        sent_bytes_(0),
+        stalled_(false),
+        read_buffer_(16384)
+    {
+    }
+
+    void start()
+    {
+      link_free_ = now();
+      last_delivery_ = link_free_;
+      start_read();
+    }
+
+  private:
+    struct segment
+    {
+      time_type delivery;
+      std::vector<char> data;
+      std::size_t offset;
+    };
+
+    // Reading stops while too much data is queued, so that the sender sees
+    // backpressure much as it would on a real link.
+    enum { max_queued_bytes = 1024 * 1024 };
+
+    void start_read()
+    {
+      if (reading_ || eof_ || queued_bytes_ >= max_queued_bytes)
+        return;
+      reading_ = true;
+      from_.async_read_some(boost::asio::buffer(read_buffer_),
+          boost::bind(&pump::handle_read, this,
+            connection_.shared_from_this(), _1, _2));
+    }
+
+    void handle_read(boost::shared_ptr<connection>,
+        const boost::system::error_code& ec, std::size_t length)
+    {
+      reading_ = false;
+      if (ec)
+      {
+        eof_ = true;
+        if (!writing_)
+          start_write();
+        return;
+      }
+
+      const impairment& i = connection_.owner_.impairment_;
+      time_type delivery = now() + milliseconds(i.rtt / 2);
+      if (i.jitter)
+        delivery += milliseconds(connection_.owner_.random_() % (i.jitter + 1));
+      if (i.bandwidth)
+      {
+        if (link_free_ > delivery)
+          delivery = link_free_;
+        link_free_ = delivery + boost::posix_time::microseconds(
+            static_cast<long>(length * 1000000.0 / i.bandwidth));
+        delivery = link_free_;
+      }
+      if (delivery < last_delivery_)
+        delivery = last_delivery_;
+      last_delivery_ = delivery;
+
+      segment s;
+      s.delivery = delivery;
+      s.data.assign(read_buffer_.begin(), read_buffer_.begin() + length);
+      s.offset = 0;
+      queue_.push_back(s);
+      queued_bytes_ += length;
+
+      if (!writing_)
+        start_write();
+      start_read();
+    }
+
+    void start_write()
+    {
+      if (queue_.empty())
+      {
+        if (eof_)
+        {
+          boost::system::error_code ignored_ec;
+          to_.shutdown(tcp::socket::shutdown_send, ignored_ec);
+        }
+        return;
+      }
+
+      writing_ = true;
+      time_type delivery = queue_.front().delivery;
+      const impairment& i = connection_.owner_.impairment_;
+      if (downstream_ && i.stall_duration && !stalled_
+          && sent_bytes_ >= i.stall_after)
+      {
+        stalled_ = true;
+        time_type resume = now() + milliseconds(i.stall_duration);
+        if (resume > delivery)
+          delivery = resume;
+      }
+
+      timer_.expires_at(delivery);
+      timer_.async_wait(boost::bind(&pump::handle_timer, this,
+            connection_.shared_from_this(), _1));
+    }
+
+    void handle_timer(boost::shared_ptr<connection>,
+        const boost::system::error_code& ec)
+    {
+      if (ec)
+        return;
+
+      const impairment& i = connection_.owner_.impairment_;
+      segment& s = queue_.front();
+      std::size_t length = s.data.size() - s.offset;
+      if (downstream_)
+      {
+        if (i.reset_after && sent_bytes_ + length > i.reset_after)
+          length = i.reset_after - sent_bytes_;
+        if (i.stall_duration && !stalled_ && sent_bytes_ < i.stall_after
+            && sent_bytes_ + length > i.stall_after)
+          length = i.stall_after - sent_bytes_;
+        if (i.drip_size && length > i.drip_size)
+          length = i.drip_size;
+      }
+
+      if (length == 0)
+      {
+        connection_.reset();
+        return;
+      }
+
+      boost::asio::async_write(to_,
+          boost::asio::buffer(&s.data[s.offset], length),
+          boost::bind(&pump::handle_write, this,
+            connection_.shared_from_this(), _1, _2));
+    }
+
+    void handle_write(boost::shared_ptr<connection>,
+        const boost::system::error_code& ec, std::size_t length)
+    {
+      if (ec)
+      {
+        connection_.close();
+        return;
+      }
+
+      sent_bytes_ += length;
+      queued_bytes_ -= length;
+      segment& s = queue_.front();
+      s.offset += length;
+      if (s.offset == s.data.size())
+        queue_.pop_front();
+      else
+        s.delivery = now();
+
+      const impairment& i = connection_.owner_.impairment_;
+      if (downstream_ && i.reset_after && sent_bytes_ >= i.reset_after)
+      {
+        connection_.reset();
+        return;
+      }
+
+      if (downstream_ && i.drip_interval && !queue_.empty())
+      {
+        time_type next = now() + milliseconds(i.drip_interval);
+        if (queue_.front().delivery < next)
+          queue_.front().delivery = next;
+      }
+
+      writing_ = false;
+      start_write();
+      start_read();
+    }
+
+    connection& connection_;
+    tcp::socket& from_;
+    tcp::socket& to_;
+    boost::asio::deadline_timer timer_;
+    bool downstream_;
+    bool reading_;
+    bool writing_;
+    bool eof_;
+    std::deque<segment> queue_;
+    std::size_t queued_bytes_;
+    std::size_t sent_bytes_;
+    bool stalled_;
+    time_type link_free_;
+    time_type last_delivery_;
+    std::vector<char> read_buffer_;
+  };
+
+  class connection
+    : public boost::enable_shared_from_this<connection>
+  {
+  public:
+    explicit connection(impairment_proxy& owner)
+      : owner_(owner),
+        client_(owner.io_service_),
+        server_(owner.io_service_),
+        upstream_(*this, client_, server_, false),
+        downstream_(*this, server_, client_, true)
+    {
+    }
+
+    tcp::socket& client()
+    {
+      return client_;
+    }
+
+    void start()
+    {
+      server_.async_connect(owner_.target_,
+          boost::bind(&connection::handle_connect, shared_from_this(), _1));
+    }
+
+    void close()
+    {
+      boost::system::error_code ignored_ec;
+      client_.close(ignored_ec);
+      server_.close(ignored_ec);
+    }
+
+    // Discards any unsent data and sends a TCP reset to both peers.
+    void reset()
+    {
+      boost::system::error_code ignored_ec;
+      client_.set_option(boost::asio::socket_base::linger(true, 0), ignored_ec);
+      server_.set_option(boost::asio::socket_base::linger(true, 0), ignored_ec);
+      close();
+    }
+
+  private:
+    friend class pump;
+
+    void handle_connect(const boost::system::error_code& ec)
+    {
+      if (ec)
+      {
+        close();
+        return;
+      }
+
+      upstream_.start();
+      downstream_.start();
+    }
+
+    impairment_proxy& owner_;
+    tcp::socket client_;
+    tcp::socket server_;
+    pump upstream_;
+    pump downstream_;
+  };
+
+  void start_accept()
+  {
+    boost::shared_ptr<connection> c(new connection(*this));
+    acceptor_.async_accept(c->client(),
+        boost::bind(&impairment_proxy::handle_accept, this, c, _1));
+  }
+
+  void handle_accept(boost::shared_ptr<connection> c,
+      const boost::system::error_code& ec)
+  {
+    if (!ec)
+      c->start();
+    start_accept();
+  }
+
+  // A small linear congruential generator, so that the jitter sequence is the
+  // same on every platform for a given seed.
+  class random_generator
+  {
+  public:
+    explicit random_generator(boost::uint32_t seed)
+      : state_(seed)
+    {
+    }
+
+    boost::uint32_t operator()()
+    {
+      state_ = state_ * 1664525u + 1013904223u;
+      return state_ >> 8;
+    }
+
+  private:
+    boost::uint32_t state_;
+  };
+
+  boost::asio::io_service io_service_;
+  tcp::acceptor acceptor_;
+  tcp::endpoint target_;
+  impairment impairment_;
+  random_generator random_;
+  boost::scoped_ptr<boost::thread> thread_;
+};
+
+#endif // IMPAIRMENT_PROXY_HPP
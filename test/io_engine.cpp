@@ -0,0 +1,151 @@
+//
+// io_engine.cpp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Disable autolinking for unit tests.
+#if !defined(BOOST_ALL_NO_LIB)
+#define BOOST_ALL_NO_LIB 1
+#endif // !defined(BOOST_ALL_NO_LIB)
+
+// Test that header file is self-contained.
+#include "urdl/io_engine.hpp"
+
+#include "unit_test.hpp"
+#include "urdl/istream.hpp"
+#include "http_server.hpp"
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(BOOST_WINDOWS)
+# include <direct.h>
+#else // defined(BOOST_WINDOWS)
+# include <unistd.h>
+#endif // defined(BOOST_WINDOWS)
+
+// Ensure all functions compile correctly.
+void io_engine_compile_test()
+{
+  // Constructors
+
+  urdl::io_engine engine1;
+  urdl::io_engine engine2(2);
+
+  const urdl::io_engine& const_engine1 = engine1;
+
+  // thread_count()
+
+  want<std::size_t>(const_engine1.thread_count());
+
+  // Streams
+
+  urdl::istreambuf istreambuf1(engine1);
+  urdl::istream istream1(engine1);
+}
+
+// Returns a file URL for a file in the current directory.
+std::string file_url(const std::string& name)
+{
+  char buffer[4096] = "";
+#if defined(BOOST_WINDOWS)
+  _getcwd(buffer, sizeof(buffer));
+  std::string path = std::string("/") + buffer + "/" + name;
+  std::replace(path.begin(), path.end(), '\\', '/');
+#else // defined(BOOST_WINDOWS)
+  getcwd(buffer, sizeof(buffer));
+  std::string path = std::string(buffer) + "/" + name;
+#endif // defined(BOOST_WINDOWS)
+  return "file://" + path;
+}
+
+void read_file(urdl::io_engine& engine, const std::string& url,
+    std::string& content)
+{
+  urdl::istream is(engine);
+  is.open(url);
+  std::ostringstream os;
+  os << is.rdbuf();
+  content = os.str();
+}
+
+// Test many streams on several threads sharing the same engine.
+void io_engine_file_test()
+{
+  std::string content = make_content(100000);
+  {
+    std::ofstream os("io_engine_file_test.txt",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  urdl::io_engine engine(2);
+  BOOST_CHECK(engine.thread_count() == 2);
+
+  std::vector<std::string> returned_content(16);
+  boost::thread_group threads;
+  for (std::size_t i = 0; i < returned_content.size(); ++i)
+  {
+    threads.create_thread(boost::bind(&read_file, boost::ref(engine),
+          file_url("io_engine_file_test.txt"),
+          boost::ref(returned_content[i])));
+  }
+  threads.join_all();
+
+  std::remove("io_engine_file_test.txt");
+
+  for (std::size_t i = 0; i < returned_content.size(); ++i)
+    BOOST_CHECK(returned_content[i] == content);
+}
+
+// Test HTTP with a read timeout on a stream that shares an engine.
+void io_engine_http_read_timeout_test()
+{
+  http_server server;
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  std::string request = make_request(port);
+  std::string response = make_response(13);
+  std::string content = "Hello, World!";
+
+  urdl::io_engine engine;
+
+  server.start(request, 0, response, 0, content);
+  urdl::istream istream1(engine);
+  istream1.open("http://localhost:" + port + "/");
+  std::string returned_content;
+  std::getline(istream1, returned_content);
+  bool request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(returned_content == content);
+
+  server.start(request, 0, response, 1500, content);
+  urdl::istream istream2(engine);
+  istream2.open("http://localhost:" + port + "/");
+  istream2.read_timeout(1000);
+  std::getline(istream2, returned_content);
+  request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(istream2.error() == boost::system::errc::timed_out);
+}
+
+test_suite* init_unit_test_suite(int, char*[])
+{
+  test_suite* test = BOOST_TEST_SUITE("io_engine");
+  test->add(BOOST_TEST_CASE(&io_engine_compile_test));
+  test->add(BOOST_TEST_CASE(&io_engine_file_test));
+  test->add(BOOST_TEST_CASE(&io_engine_http_read_timeout_test));
+  return test;
+}
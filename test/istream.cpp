@@ -20,8 +20,11 @@
 #include "urdl/http.hpp"
 #include "urdl/option_set.hpp"
 #include "http_server.hpp"
+#include "impairment_proxy.hpp"
 #include <string>
 #include <sstream>
+#include <utility>
+#include <vector>
 
 // Ensure all functions compile correctly.
 void istream_compile_test()
@@ -79,6 +82,21 @@ void istream_compile_test()
   want<std::size_t>(const_istream1.read_timeout());
   istream1.read_timeout(std::size_t(123));
 
+  // buffer_size()
+
+  want<std::size_t>(const_istream1.buffer_size());
+  istream1.buffer_size(std::size_t(123));
+
+  // max_buffer_size()
+
+  want<std::size_t>(const_istream1.max_buffer_size());
+  istream1.max_buffer_size(std::size_t(123));
+
+  // read_ahead()
+
+  want<bool>(const_istream1.read_ahead());
+  istream1.read_ahead(true);
+
   // content_type()
 
   want<std::string>(const_istream1.content_type());
@@ -98,15 +116,8 @@ void istream_http_test()
   http_server server;
   std::string port = boost::lexical_cast<std::string>(server.port());
 
-  std::string request =
-    "GET / HTTP/1.0\r\n"
-    "Host: localhost:" + port + "\r\n"
-    "Accept: */*\r\n"
-    "Connection: close\r\n\r\n";
-  std::string response =
-    "HTTP/1.0 200 OK\r\n"
-    "Content-Length: 13\r\n"
-    "Content-Type: text/plain\r\n\r\n";
+  std::string request = make_request(port);
+  std::string response = make_response(13);
   std::string content = "Hello, World!";
 
   server.start(request, 0, response, 0, content);
@@ -127,15 +138,8 @@ void istream_http_not_found_test()
   http_server server;
   std::string port = boost::lexical_cast<std::string>(server.port());
 
-  std::string request =
-    "GET / HTTP/1.0\r\n"
-    "Host: localhost:" + port + "\r\n"
-    "Accept: */*\r\n"
-    "Connection: close\r\n\r\n";
-  std::string response =
-    "HTTP/1.0 404 Not Found\r\n"
-    "Content-Length: 9\r\n"
-    "Content-Type: text/plain\r\n\r\n";
+  std::string request = make_request(port);
+  std::string response = make_response(9, "404 Not Found");
   std::string content = "Not Found";
 
   server.start(request, 0, response, 0, content);
@@ -154,15 +158,8 @@ void istream_http_open_timeout_test()
   http_server server;
   std::string port = boost::lexical_cast<std::string>(server.port());
 
-  std::string request =
-    "GET / HTTP/1.0\r\n"
-    "Host: localhost:" + port + "\r\n"
-    "Accept: */*\r\n"
-    "Connection: close\r\n\r\n";
-  std::string response =
-    "HTTP/1.0 200 OK\r\n"
-    "Content-Length: 13\r\n"
-    "Content-Type: text/plain\r\n\r\n";
+  std::string request = make_request(port);
+  std::string response = make_response(13);
   std::string content = "Hello, World!";
 
   server.start(request, 1500, response, 0, content);
@@ -180,15 +177,8 @@ void istream_http_read_timeout_test()
   http_server server;
   std::string port = boost::lexical_cast<std::string>(server.port());
 
-  std::string request =
-    "GET / HTTP/1.0\r\n"
-    "Host: localhost:" + port + "\r\n"
-    "Accept: */*\r\n"
-    "Connection: close\r\n\r\n";
-  std::string response =
-    "HTTP/1.0 200 OK\r\n"
-    "Content-Length: 13\r\n"
-    "Content-Type: text/plain\r\n\r\n";
+  std::string request = make_request(port);
+  std::string response = make_response(13);
   std::string content = "Hello, World!";
 
   server.start(request, 0, response, 1500, content);
@@ -203,6 +193,352 @@ void istream_http_read_timeout_test()
   BOOST_CHECK(istream1.error() == boost::system::errc::timed_out);
 }
 
+// Test HTTP with a read timeout caused by a stall part way through the body.
+void istream_http_stall_read_timeout_test()
+{
+  http_server server;
+  impairment i;
+  std::string response = make_response(13);
+  i.stall_after = response.size() + 5;
+  i.stall_duration = 1500;
+  impairment_proxy proxy(server.port(), i);
+  std::string port = boost::lexical_cast<std::string>(proxy.port());
+
+  std::string request = make_request(port);
+  std::string content = "Hello, World!";
+
+  server.start(request, 0, response, 0, content);
+  urdl::istream istream1;
+  istream1.open("http://localhost:" + port + "/");
+  istream1.read_timeout(1000);
+  std::string returned_content;
+  std::getline(istream1, returned_content);
+  bool request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(returned_content == "Hello");
+  BOOST_CHECK(istream1.error() == boost::system::errc::timed_out);
+}
+
+// Test HTTP with a buffer that grows while reads keep filling it.
+void istream_http_adaptive_buffer_test()
+{
+  http_server server;
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  std::string content = make_content(200000);
+
+  std::string request = make_request(port);
+  std::string response = make_response(content.size());
+
+  server.start(request, 0, response, 0, content);
+  urdl::istream istream1;
+  istream1.buffer_size(1024);
+  istream1.max_buffer_size(65536);
+  istream1.open("http://localhost:" + port + "/");
+  std::string returned_content;
+  std::streamsize max_available = 0;
+  char c;
+  while (istream1.get(c))
+  {
+    returned_content += c;
+    if (istream1.rdbuf()->in_avail() > max_available)
+      max_available = istream1.rdbuf()->in_avail();
+  }
+  bool request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(returned_content == content);
+  BOOST_CHECK(max_available > 1024);
+  BOOST_CHECK(max_available < 65536);
+  BOOST_CHECK(istream1.buffer_size() == 1024);
+}
+
+// Test HTTP with reads that are larger than the buffer.
+void istream_http_large_read_test()
+{
+  http_server server;
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  std::string content = make_content(200000);
+
+  std::string request = make_request(port);
+  std::string response = make_response(content.size());
+
+  server.start(request, 0, response, 0, content);
+  urdl::istream istream1("http://localhost:" + port + "/");
+  std::string returned_content;
+  char c;
+  istream1.get(c);
+  returned_content += c;
+  std::vector<char> buffer(30000);
+  while (istream1.read(&buffer[0], buffer.size()) || istream1.gcount() > 0)
+  {
+    returned_content.append(&buffer[0], istream1.gcount());
+    if (istream1.gcount() == static_cast<std::streamsize>(buffer.size()))
+    {
+      // The last byte read is still available to be put back.
+      istream1.unget();
+      istream1.get(c);
+      BOOST_CHECK(c == buffer.back());
+    }
+  }
+  bool request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(!istream1.error());
+  BOOST_CHECK(returned_content == content);
+}
+
+// Test HTTP with reads started ahead of the consumer.
+void istream_http_read_ahead_test()
+{
+  http_server server;
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  std::string content = make_content(200000);
+
+  std::string request = make_request(port);
+  std::string response = make_response(content.size());
+
+  urdl::io_engine engine;
+  for (int use_engine = 0; use_engine < 2; ++use_engine)
+  {
+    server.start(request, 0, response, 0, content);
+    urdl::istream istream1;
+    urdl::istream istream2(engine);
+    urdl::istream& is = use_engine ? istream2 : istream1;
+    is.read_ahead(true);
+    is.max_buffer_size(16384);
+    is.open("http://localhost:" + port + "/");
+    std::string returned_content;
+    std::vector<char> buffer(1000);
+    char c;
+    while (is.get(c))
+    {
+      returned_content += c;
+
+      // Asking how much is available must not touch a read in progress.
+      BOOST_CHECK(is.rdbuf()->in_avail() >= 0
+          || returned_content.size() == content.size());
+
+      if (returned_content.size() % 5000 == 0)
+      {
+        // Mix in reads that span more than one buffer, and put back the
+        // last character read.
+        is.read(&buffer[0], buffer.size());
+        returned_content.append(&buffer[0], is.gcount());
+        if (is.gcount() > 0 && is.unget())
+          returned_content.erase(returned_content.size() - 1);
+      }
+    }
+    bool request_matched = server.stop();
+
+    BOOST_CHECK(request_matched);
+    BOOST_CHECK(!is.error());
+    BOOST_CHECK(returned_content == content);
+  }
+}
+
+// Test HTTP with a read timeout while waiting for a read ahead.
+void istream_http_read_ahead_timeout_test()
+{
+  http_server server;
+  impairment i;
+  std::string response = make_response(13);
+  i.stall_after = response.size() + 5;
+  i.stall_duration = 1500;
+  impairment_proxy proxy(server.port(), i);
+  std::string port = boost::lexical_cast<std::string>(proxy.port());
+
+  std::string request = make_request(port);
+  std::string content = "Hello, World!";
+
+  urdl::io_engine engine;
+  server.start(request, 0, response, 0, content);
+  urdl::istream istream1(engine);
+  istream1.read_ahead(true);
+  istream1.open("http://localhost:" + port + "/");
+  istream1.read_timeout(1000);
+  std::string returned_content;
+  std::getline(istream1, returned_content);
+  bool request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(returned_content == "Hello");
+  BOOST_CHECK(istream1.error() == boost::system::errc::timed_out);
+}
+
+// Test seeking, using a range request to move past the data already read.
+void istream_http_seek_test()
+{
+  http_server server;
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  std::string request = make_request(port);
+  std::string response = make_response(1000);
+  std::string content = make_content(1000);
+
+  server.start(request, 0, response, 0, content);
+  urdl::istream istream1;
+  istream1.buffer_size(16);
+  istream1.open("http://localhost:" + port + "/");
+  BOOST_CHECK(istream1.get() == content[0]);
+  BOOST_CHECK(istream1.tellg() == std::streampos(1));
+
+  // Positions within the data already read need no new request.
+  istream1.seekg(10);
+  BOOST_CHECK(istream1.get() == content[10]);
+  istream1.seekg(-11, std::ios_base::cur);
+  BOOST_CHECK(istream1.get() == content[0]);
+
+  // Seeking to the end of the content needs no new request either.
+  istream1.seekg(0, std::ios_base::end);
+  BOOST_CHECK(istream1.tellg() == std::streampos(1000));
+  BOOST_CHECK(istream1.get() == std::char_traits<char>::eof());
+  istream1.clear();
+  bool request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+
+  request = make_request(port, "Range: bytes=500-\r\n");
+  response =
+    "HTTP/1.0 206 Partial Content\r\n"
+    "Content-Length: 500\r\n"
+    "Content-Range: bytes 500-999/1000\r\n"
+    "Content-Type: text/plain\r\n\r\n";
+  server.start(request, 0, response, 0, content.substr(500));
+  istream1.seekg(-500, std::ios_base::end);
+  BOOST_CHECK(istream1.tellg() == std::streampos(500));
+  std::string returned_content;
+  std::getline(istream1, returned_content);
+  request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(returned_content == content.substr(500));
+}
+
+// Test seeking when the server ignores the range request.
+void istream_http_seek_fallback_test()
+{
+  http_server server;
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  std::string request = make_request(port);
+  std::string response = make_response(1000);
+  std::string content = make_content(1000);
+
+  server.start(request, 0, response, 0, content);
+  urdl::istream istream1;
+  istream1.buffer_size(16);
+  istream1.open("http://localhost:" + port + "/");
+  BOOST_CHECK(istream1.get() == content[0]);
+  bool request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+
+  request = make_request(port, "Range: bytes=500-\r\n");
+  server.start(request, 0, response, 0, content);
+  istream1.seekg(500);
+  BOOST_CHECK(istream1.tellg() == std::streampos(500));
+  std::string returned_content;
+  std::getline(istream1, returned_content);
+  request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(returned_content == content.substr(500));
+}
+
+#if defined(URDL_HAS_MOVE)
+
+// Opens a stream, as a factory function would.
+urdl::istream open_istream(const std::string& u)
+{
+  urdl::istream istream1;
+  istream1.buffer_size(4);
+  istream1.open(u);
+  return istream1;
+}
+
+// Test moving an open stream part way through reading the content.
+void istream_http_move_test()
+{
+  http_server server;
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  std::string request = make_request(port);
+  std::string response = make_response(27);
+  std::string content = "Hello, World!\nGoodbye, all!";
+
+  server.start(request, 0, response, 0, content);
+  urdl::istream istream1(open_istream("http://localhost:" + port + "/"));
+  BOOST_CHECK(istream1);
+
+  std::string line1;
+  std::getline(istream1, line1);
+
+  std::vector<urdl::istream> streams;
+  streams.push_back(std::move(istream1));
+  streams.push_back(urdl::istream());
+  std::swap(streams[0], streams[1]);
+
+  std::string line2;
+  std::getline(streams[1], line2);
+  bool request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(streams[1].rdbuf()->is_open());
+  BOOST_CHECK(!streams[0].rdbuf()->is_open());
+  BOOST_CHECK(streams[1].content_type() == "text/plain");
+  BOOST_CHECK(streams[1].buffer_size() == 4);
+  BOOST_CHECK(line1 == "Hello, World!");
+  BOOST_CHECK(line2 == "Goodbye, all!");
+}
+
+// Test reopening a stream after it has been moved from.
+void istream_http_move_reopen_test()
+{
+  http_server server1;
+  std::string port1 = boost::lexical_cast<std::string>(server1.port());
+  http_server server2;
+  std::string port2 = boost::lexical_cast<std::string>(server2.port());
+
+  std::string content1 = "Hello, World!";
+  std::string content2 = "Goodbye, all!";
+
+  server1.start(make_request(port1), 0, make_response(13), 0, content1);
+  urdl::istream istream1;
+  istream1.buffer_size(4);
+  istream1.open("http://localhost:" + port1 + "/");
+  urdl::istream istream2(std::move(istream1));
+
+  BOOST_CHECK(!istream1.rdbuf()->is_open());
+  BOOST_CHECK(istream1.buffer_size() != 4);
+
+  server2.start(make_request(port2), 0, make_response(13), 0, content2);
+  istream1.open("http://localhost:" + port2 + "/");
+  BOOST_CHECK(istream1);
+
+  std::string line1;
+  std::getline(istream2, line1);
+  std::string line2;
+  std::getline(istream1, line2);
+  bool request1_matched = server1.stop();
+  bool request2_matched = server2.stop();
+
+  BOOST_CHECK(request1_matched);
+  BOOST_CHECK(request2_matched);
+  BOOST_CHECK(line1 == content1);
+  BOOST_CHECK(line2 == content2);
+
+  urdl::istream istream3;
+  istream3 = std::move(istream2);
+  BOOST_CHECK(!istream2.rdbuf()->is_open());
+  BOOST_CHECK(istream2.rdbuf()->puberror() == boost::system::error_code());
+}
+
+#endif // defined(URDL_HAS_MOVE)
+
 test_suite* init_unit_test_suite(int, char*[])
 {
   test_suite* test = BOOST_TEST_SUITE("istream");
@@ -211,5 +547,16 @@ test_suite* init_unit_test_suite(int, char*[])
   test->add(BOOST_TEST_CASE(&istream_http_not_found_test));
   test->add(BOOST_TEST_CASE(&istream_http_open_timeout_test));
   test->add(BOOST_TEST_CASE(&istream_http_read_timeout_test));
+  test->add(BOOST_TEST_CASE(&istream_http_stall_read_timeout_test));
+  test->add(BOOST_TEST_CASE(&istream_http_adaptive_buffer_test));
+  test->add(BOOST_TEST_CASE(&istream_http_large_read_test));
+  test->add(BOOST_TEST_CASE(&istream_http_read_ahead_test));
+  test->add(BOOST_TEST_CASE(&istream_http_read_ahead_timeout_test));
+  test->add(BOOST_TEST_CASE(&istream_http_seek_test));
+  test->add(BOOST_TEST_CASE(&istream_http_seek_fallback_test));
+#if defined(URDL_HAS_MOVE)
+  test->add(BOOST_TEST_CASE(&istream_http_move_test));
+  test->add(BOOST_TEST_CASE(&istream_http_move_reopen_test));
+#endif // defined(URDL_HAS_MOVE)
   return test;
 }
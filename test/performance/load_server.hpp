@@ -0,0 +1,163 @@
+//
+// load_server.hpp
+// ~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef LOAD_SERVER_HPP
+#define LOAD_SERVER_HPP
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <cstdlib>
+#include <istream>
+#include <string>
+#include <vector>
+
+// Multi-connection HTTP server for benchmarks. A request for the path "/N"
+// receives a response with a body of N bytes. The body is generated from a
+// fixed block, so arbitrarily large responses cost no memory.
+class load_server
+{
+public:
+  typedef boost::asio::ip::tcp tcp;
+
+  enum { block_size = 64 * 1024 };
+
+  explicit load_server(std::size_t threads = 2)
+    : acceptor_(io_service_, tcp::endpoint(
+          boost::asio::ip::address_v4::loopback(), 0)),
+      block_(block_size)
+  {
+    for (std::size_t i = 0; i < block_.size(); ++i)
+      block_[i] = static_cast<char>('a' + i % 26);
+
+    start_accept();
+    for (std::size_t i = 0; i < threads; ++i)
+      threads_.create_thread(
+          boost::bind(&boost::asio::io_service::run, &io_service_));
+  }
+
+  ~load_server()
+  {
+    io_service_.stop();
+    threads_.join_all();
+  }
+
+  unsigned short port() const
+  {
+    return acceptor_.local_endpoint().port();
+  }
+
+  std::string url(std::size_t body_size) const
+  {
+    return "http://localhost:" + boost::lexical_cast<std::string>(port())
+      + "/" + boost::lexical_cast<std::string>(body_size);
+  }
+
+private:
+  class connection
+    : public boost::enable_shared_from_this<connection>
+  {
+  public:
+    connection(boost::asio::io_service& io_service,
+        const std::vector<char>& block)
+      : socket_(io_service),
+        block_(block),
+        remaining_(0)
+    {
+    }
+
+    tcp::socket& socket()
+    {
+      return socket_;
+    }
+
+    void start()
+    {
+      boost::asio::async_read_until(socket_, request_, "\r\n\r\n",
+          boost::bind(&connection::handle_request, shared_from_this(), _1));
+    }
+
+  private:
+    void handle_request(const boost::system::error_code& ec)
+    {
+      if (ec)
+        return;
+
+      // The request line is "GET /N HTTP/1.0".
+      std::istream is(&request_);
+      std::string method, path;
+      is >> method >> path;
+      remaining_ = path.size() > 1
+        ? std::strtoul(path.c_str() + 1, 0, 10) : 0;
+
+      headers_ = "HTTP/1.0 200 OK\r\nContent-Type: application/octet-stream"
+        "\r\nContent-Length: " + boost::lexical_cast<std::string>(remaining_)
+        + "\r\n\r\n";
+      boost::asio::async_write(socket_, boost::asio::buffer(headers_),
+          boost::bind(&connection::handle_write, shared_from_this(), _1));
+    }
+
+    void handle_write(const boost::system::error_code& ec)
+    {
+      if (ec)
+        return;
+
+      if (remaining_ == 0)
+      {
+        boost::system::error_code ignored_ec;
+        socket_.shutdown(tcp::socket::shutdown_both, ignored_ec);
+        return;
+      }
+
+      std::size_t length = remaining_ < block_.size()
+        ? remaining_ : block_.size();
+      remaining_ -= length;
+      boost::asio::async_write(socket_, boost::asio::buffer(&block_[0], length),
+          boost::bind(&connection::handle_write, shared_from_this(), _1));
+    }
+
+    tcp::socket socket_;
+    const std::vector<char>& block_;
+    boost::asio::streambuf request_;
+    std::string headers_;
+    std::size_t remaining_;
+  };
+
+  void start_accept()
+  {
+    boost::shared_ptr<connection> c(new connection(io_service_, block_));
+    acceptor_.async_accept(c->socket(),
+        boost::bind(&load_server::handle_accept, this, c, _1));
+  }
+
+  void handle_accept(boost::shared_ptr<connection> c,
+      const boost::system::error_code& ec)
+  {
+    if (!ec)
+      c->start();
+    start_accept();
+  }
+
+  boost::asio::io_service io_service_;
+  tcp::acceptor acceptor_;
+  std::vector<char> block_;
+  boost::thread_group threads_;
+};
+
+#endif // LOAD_SERVER_HPP
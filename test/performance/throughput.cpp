@@ -0,0 +1,400 @@
+//
+// throughput.cpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measures requests/sec and MB/s for each of the ways of reading a URL, against
+// a loopback server. Parameters are given as name=value pairs, where each
+// value is a comma-separated list. Every combination of the values is run:
+//
+//   modes=sync,async,istream,istreambuf
+//   bodies=1K,64K,1M,64M         (sizes accept K, M and G suffixes)
+//   buffers=4K,64K               (size of each read)
+//   concurrency=1,8              (simultaneous downloads)
+//   threads=1,4                  (threads running the io_service, async only)
+//   seconds=2                    (time for which new downloads are started)
+//   server_threads=2
+//   format=json|csv
+//
+// Each result is written to standard output as a single line.
+
+#include <urdl/istream.hpp>
+#include <urdl/istreambuf.hpp>
+#include <urdl/read_stream.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "load_server.hpp"
+
+typedef boost::posix_time::ptime time_type;
+
+time_type now()
+{
+  return boost::posix_time::microsec_clock::universal_time();
+}
+
+struct config
+{
+  std::string mode;
+  std::size_t body;
+  std::size_t buffer;
+  std::size_t concurrency;
+  std::size_t threads;
+  double seconds;
+  std::string url;
+};
+
+// Results are gathered per worker and summed at the end, so that workers
+// never contend on shared counters.
+struct counters
+{
+  counters() : requests(0), errors(0), bytes(0) {}
+  std::size_t requests;
+  std::size_t errors;
+  unsigned long long bytes;
+};
+
+void sync_worker(const config& c, time_type deadline, counters& result)
+{
+  boost::asio::io_service io_service;
+  urdl::read_stream stream(io_service);
+  std::vector<char> buffer(c.buffer);
+  while (now() < deadline)
+  {
+    boost::system::error_code ec;
+    stream.open(c.url, ec);
+    while (!ec)
+      result.bytes += stream.read_some(boost::asio::buffer(buffer), ec);
+    if (ec == boost::asio::error::eof)
+      ++result.requests;
+    else
+      ++result.errors;
+    stream.close(ec);
+  }
+}
+
+void istream_worker(const config& c, time_type deadline, counters& result)
+{
+  std::vector<char> buffer(c.buffer);
+  while (now() < deadline)
+  {
+    urdl::istream is(c.url);
+    while (is.read(&buffer[0], buffer.size()) || is.gcount() > 0)
+      result.bytes += is.gcount();
+    if (!is.error())
+      ++result.requests;
+    else
+      ++result.errors;
+  }
+}
+
+void istreambuf_worker(const config& c, time_type deadline, counters& result)
+{
+  std::vector<char> buffer(c.buffer);
+  while (now() < deadline)
+  {
+    try
+    {
+      urdl::istreambuf sb;
+      if (sb.open(c.url))
+      {
+        // A short count from sgetn means the end of the content was reached.
+        std::streamsize length;
+        do
+        {
+          length = sb.sgetn(&buffer[0], buffer.size());
+          result.bytes += length;
+        } while (length == static_cast<std::streamsize>(buffer.size()));
+        ++result.requests;
+      }
+      else
+      {
+        ++result.errors;
+      }
+    }
+    catch (std::exception&)
+    {
+      ++result.errors;
+    }
+  }
+}
+
+class async_client
+{
+public:
+  async_client(boost::asio::io_service& io_service, const config& c,
+      time_type deadline)
+    : stream_(io_service),
+      config_(c),
+      deadline_(deadline),
+      buffer_(c.buffer)
+  {
+  }
+
+  void start()
+  {
+    if (now() < deadline_)
+    {
+      stream_.async_open(config_.url,
+          boost::bind(&async_client::handle_open, this, _1));
+    }
+  }
+
+  const counters& result() const
+  {
+    return result_;
+  }
+
+private:
+  void handle_open(const boost::system::error_code& ec)
+  {
+    if (ec)
+      finish(ec);
+    else
+      stream_.async_read_some(boost::asio::buffer(buffer_),
+          boost::bind(&async_client::handle_read, this, _1, _2));
+  }
+
+  void handle_read(const boost::system::error_code& ec, std::size_t length)
+  {
+    result_.bytes += length;
+    if (ec)
+      finish(ec);
+    else
+      stream_.async_read_some(boost::asio::buffer(buffer_),
+          boost::bind(&async_client::handle_read, this, _1, _2));
+  }
+
+  void finish(const boost::system::error_code& ec)
+  {
+    if (ec == boost::asio::error::eof)
+      ++result_.requests;
+    else
+      ++result_.errors;
+    boost::system::error_code ignored_ec;
+    stream_.close(ignored_ec);
+    start();
+  }
+
+  urdl::read_stream stream_;
+  const config& config_;
+  time_type deadline_;
+  std::vector<char> buffer_;
+  counters result_;
+};
+
+counters run_async(const config& c, time_type deadline)
+{
+  boost::asio::io_service io_service;
+  std::vector<boost::shared_ptr<async_client> > clients;
+  for (std::size_t i = 0; i < c.concurrency; ++i)
+  {
+    clients.push_back(boost::shared_ptr<async_client>(
+          new async_client(io_service, c, deadline)));
+    clients.back()->start();
+  }
+
+  boost::thread_group threads;
+  for (std::size_t i = 0; i < c.threads; ++i)
+    threads.create_thread(
+        boost::bind(&boost::asio::io_service::run, &io_service));
+  threads.join_all();
+
+  counters total;
+  for (std::size_t i = 0; i < clients.size(); ++i)
+  {
+    total.requests += clients[i]->result().requests;
+    total.errors += clients[i]->result().errors;
+    total.bytes += clients[i]->result().bytes;
+  }
+  return total;
+}
+
+counters run_threaded(const config& c, time_type deadline,
+    void (*worker)(const config&, time_type, counters&))
+{
+  std::vector<counters> results(c.concurrency);
+  boost::thread_group threads;
+  for (std::size_t i = 0; i < c.concurrency; ++i)
+    threads.create_thread(boost::bind(worker,
+          boost::cref(c), deadline, boost::ref(results[i])));
+  threads.join_all();
+
+  counters total;
+  for (std::size_t i = 0; i < results.size(); ++i)
+  {
+    total.requests += results[i].requests;
+    total.errors += results[i].errors;
+    total.bytes += results[i].bytes;
+  }
+  return total;
+}
+
+std::size_t parse_size(const std::string& s)
+{
+  char* end = 0;
+  std::size_t value = std::strtoul(s.c_str(), &end, 10);
+  switch (*end)
+  {
+  case 'k': case 'K': return value * 1024;
+  case 'm': case 'M': return value * 1024 * 1024;
+  case 'g': case 'G': return value * 1024 * 1024 * 1024;
+  default: return value;
+  }
+}
+
+std::vector<std::string> split(const std::string& s)
+{
+  std::vector<std::string> result;
+  std::string::size_type start = 0, comma;
+  while ((comma = s.find(',', start)) != std::string::npos)
+  {
+    result.push_back(s.substr(start, comma - start));
+    start = comma + 1;
+  }
+  result.push_back(s.substr(start));
+  return result;
+}
+
+std::vector<std::size_t> split_sizes(const std::string& s)
+{
+  std::vector<std::string> items = split(s);
+  std::vector<std::size_t> result;
+  for (std::size_t i = 0; i < items.size(); ++i)
+    result.push_back(parse_size(items[i]));
+  return result;
+}
+
+void report(const std::string& format, const config& c,
+    const counters& r, double elapsed)
+{
+  double requests_per_sec = r.requests / elapsed;
+  double mb_per_sec = r.bytes / elapsed / (1024 * 1024);
+  if (format == "csv")
+  {
+    std::printf("%s,%lu,%lu,%lu,%lu,%.3f,%lu,%lu,%llu,%.1f,%.1f\n",
+        c.mode.c_str(), (unsigned long)c.body, (unsigned long)c.buffer,
+        (unsigned long)c.concurrency, (unsigned long)c.threads, elapsed,
+        (unsigned long)r.requests, (unsigned long)r.errors, r.bytes,
+        requests_per_sec, mb_per_sec);
+  }
+  else
+  {
+    std::printf("{\"mode\":\"%s\",\"body\":%lu,\"buffer\":%lu,"
+        "\"concurrency\":%lu,\"threads\":%lu,\"seconds\":%.3f,"
+        "\"requests\":%lu,\"errors\":%lu,\"bytes\":%llu,"
+        "\"requests_per_sec\":%.1f,\"mb_per_sec\":%.1f}\n",
+        c.mode.c_str(), (unsigned long)c.body, (unsigned long)c.buffer,
+        (unsigned long)c.concurrency, (unsigned long)c.threads, elapsed,
+        (unsigned long)r.requests, (unsigned long)r.errors, r.bytes,
+        requests_per_sec, mb_per_sec);
+  }
+  std::fflush(stdout);
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    std::map<std::string, std::string> args;
+    args["modes"] = "sync,async,istream,istreambuf";
+    args["bodies"] = "1K,64K,1M,64M";
+    args["buffers"] = "4K,64K";
+    args["concurrency"] = "1,8";
+    args["threads"] = "1,4";
+    args["seconds"] = "2";
+    args["server_threads"] = "2";
+    args["format"] = "json";
+    for (int i = 1; i < argc; ++i)
+    {
+      std::string arg = argv[i];
+      std::string::size_type eq = arg.find('=');
+      if (eq == std::string::npos || !args.count(arg.substr(0, eq)))
+      {
+        std::cerr << "Usage: throughput [name=value[,value...]] ...\n";
+        std::cerr << "Names: modes bodies buffers concurrency threads";
+        std::cerr << " seconds server_threads format\n";
+        return 1;
+      }
+      args[arg.substr(0, eq)] = arg.substr(eq + 1);
+    }
+
+    std::vector<std::string> modes = split(args["modes"]);
+    std::vector<std::size_t> bodies = split_sizes(args["bodies"]);
+    std::vector<std::size_t> buffers = split_sizes(args["buffers"]);
+    std::vector<std::size_t> concurrencies = split_sizes(args["concurrency"]);
+    std::vector<std::size_t> thread_counts = split_sizes(args["threads"]);
+    double seconds = std::atof(args["seconds"].c_str());
+    std::string format = args["format"];
+
+    load_server server(parse_size(args["server_threads"]));
+
+    if (format == "csv")
+      std::printf("mode,body,buffer,concurrency,threads,seconds,requests,"
+          "errors,bytes,requests_per_sec,mb_per_sec\n");
+
+    for (std::size_t m = 0; m < modes.size(); ++m)
+    for (std::size_t b = 0; b < bodies.size(); ++b)
+    for (std::size_t r = 0; r < buffers.size(); ++r)
+    for (std::size_t n = 0; n < concurrencies.size(); ++n)
+    for (std::size_t t = 0; t < thread_counts.size(); ++t)
+    {
+      config c;
+      c.mode = modes[m];
+      c.body = bodies[b];
+      c.buffer = buffers[r];
+      c.concurrency = concurrencies[n];
+      c.seconds = seconds;
+      c.url = server.url(c.body);
+
+      // The synchronous modes use one thread per download, so the thread
+      // count only varies for the asynchronous mode.
+      if (c.mode == "async")
+        c.threads = thread_counts[t];
+      else if (t == 0)
+        c.threads = c.concurrency;
+      else
+        continue;
+
+      time_type start = now();
+      time_type deadline = start + boost::posix_time::microseconds(
+          static_cast<long>(seconds * 1000000));
+
+      counters result;
+      if (c.mode == "sync")
+        result = run_threaded(c, deadline, sync_worker);
+      else if (c.mode == "async")
+        result = run_async(c, deadline);
+      else if (c.mode == "istream")
+        result = run_threaded(c, deadline, istream_worker);
+      else if (c.mode == "istreambuf")
+        result = run_threaded(c, deadline, istreambuf_worker);
+      else
+        throw std::runtime_error("Unknown mode: " + c.mode);
+
+      double elapsed = (now() - start).total_microseconds() / 1000000.0;
+      report(format, c, result, elapsed);
+    }
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,392 @@
+//
+// random_access_reader.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Disable autolinking for unit tests.
+#if !defined(BOOST_ALL_NO_LIB)
+#define BOOST_ALL_NO_LIB 1
+#endif // !defined(BOOST_ALL_NO_LIB)
+
+// Test that header file is self-contained.
+#include "urdl/random_access_reader.hpp"
+
+#include "unit_test.hpp"
+#include "urdl/http.hpp"
+#include "http_server.hpp"
+#include "range_server.hpp"
+#include <boost/asio/read_at.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(BOOST_WINDOWS)
+# include <direct.h>
+#else // defined(BOOST_WINDOWS)
+# include <unistd.h>
+#endif // defined(BOOST_WINDOWS)
+
+// Ensure all functions compile correctly.
+void random_access_reader_compile_test()
+{
+  try
+  {
+    boost::system::error_code ec;
+    char buffer[1024];
+
+    // Constructors
+
+    urdl::random_access_reader reader1;
+
+    // set_option()
+
+    reader1.set_option(0);
+    reader1.set_option<char>(0);
+
+    // set_options()
+
+    reader1.set_options(urdl::option_set());
+
+    // get_option()
+
+    const urdl::random_access_reader& const_reader1 = reader1;
+    want<int>(const_reader1.get_option<int>());
+    want<char>(const_reader1.get_option<char>());
+
+    // get_options()
+
+    want<urdl::option_set>(const_reader1.get_options());
+
+    // is_open()
+
+    want<bool>(const_reader1.is_open());
+
+    // open()
+
+    reader1.open("file://xyz");
+    want<boost::system::error_code>(reader1.open("file://xyz", ec));
+
+    // close()
+
+    reader1.close();
+
+    // size()
+
+    want<boost::uint64_t>(const_reader1.size());
+
+    // read_some_at()
+
+    want<std::size_t>(reader1.read_some_at(0, boost::asio::buffer(buffer)));
+    want<std::size_t>(reader1.read_some_at(0,
+          boost::asio::buffer(buffer), ec));
+
+    // block_size()
+
+    want<std::size_t>(const_reader1.block_size());
+    reader1.block_size(std::size_t(123));
+
+    // cache_blocks()
+
+    want<std::size_t>(const_reader1.cache_blocks());
+    reader1.cache_blocks(std::size_t(123));
+
+    // max_read_ahead()
+
+    want<std::size_t>(const_reader1.max_read_ahead());
+    reader1.max_read_ahead(std::size_t(123));
+
+    // max_parallel_requests()
+
+    want<std::size_t>(const_reader1.max_parallel_requests());
+    reader1.max_parallel_requests(std::size_t(123));
+
+    // read_timeout()
+
+    want<std::size_t>(const_reader1.read_timeout());
+    reader1.read_timeout(std::size_t(123));
+  }
+  catch (std::exception&)
+  {
+  }
+}
+
+// Test reading parts of the content from an HTTP server.
+void random_access_reader_http_test()
+{
+  std::string content = make_content(10000);
+  range_server server(content);
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  urdl::random_access_reader reader1;
+  reader1.block_size(1000);
+  reader1.open("http://localhost:" + port + "/");
+
+  BOOST_CHECK(reader1.is_open());
+  BOOST_CHECK(reader1.size() == content.size());
+
+  const std::size_t offsets[] = { 8500, 1234, 0, 4999, 7777 };
+  for (std::size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i)
+  {
+    std::vector<char> data(1500);
+    std::size_t length = boost::asio::read_at(reader1, offsets[i],
+        boost::asio::buffer(data));
+    BOOST_CHECK(length == data.size());
+    BOOST_CHECK(std::string(data.begin(), data.end())
+        == content.substr(offsets[i], data.size()));
+  }
+
+  // A read that passes the end of the content is short.
+  std::vector<char> data(1000);
+  boost::system::error_code ec;
+  std::size_t length = reader1.read_some_at(9500,
+      boost::asio::buffer(data), ec);
+  BOOST_CHECK(!ec);
+  BOOST_CHECK(length == 500);
+  BOOST_CHECK(std::string(data.begin(), data.begin() + length)
+      == content.substr(9500));
+
+  length = reader1.read_some_at(10000, boost::asio::buffer(data), ec);
+  BOOST_CHECK(ec == boost::asio::error::eof);
+  BOOST_CHECK(length == 0);
+
+  reader1.close();
+  BOOST_CHECK(!reader1.is_open());
+}
+
+// Test that adjacent missing blocks are fetched using a single request.
+void random_access_reader_merge_test()
+{
+  std::string content = make_content(1000);
+  range_server server(content);
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  urdl::random_access_reader reader1;
+  reader1.block_size(100);
+  reader1.max_read_ahead(0);
+  reader1.open("http://localhost:" + port + "/");
+
+  std::vector<char> data(400);
+  boost::asio::read_at(reader1, 250, boost::asio::buffer(data));
+  BOOST_CHECK(std::string(data.begin(), data.end())
+      == content.substr(250, 400));
+
+  // Blocks 0 and 2 to 6 are cached, so the rest is fetched in two runs.
+  data.resize(1000);
+  boost::asio::read_at(reader1, 0, boost::asio::buffer(data));
+  BOOST_CHECK(std::string(data.begin(), data.end()) == content);
+
+  std::vector<std::string> ranges = server.ranges();
+  BOOST_REQUIRE(ranges.size() == 4);
+  BOOST_CHECK(ranges[0] == "0-99");
+  BOOST_CHECK(ranges[1] == "200-699");
+  std::sort(ranges.begin() + 2, ranges.end());
+  BOOST_CHECK(ranges[2] == "100-199");
+  BOOST_CHECK(ranges[3] == "700-999");
+}
+
+// Test that the least recently used blocks are discarded.
+void random_access_reader_lru_test()
+{
+  std::string content = make_content(1000);
+  range_server server(content);
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  urdl::random_access_reader reader1;
+  reader1.block_size(100);
+  reader1.cache_blocks(3);
+  reader1.max_read_ahead(0);
+  reader1.open("http://localhost:" + port + "/");
+
+  const std::size_t blocks[] = { 5, 1, 3, 1, 0, 1, 5 };
+  for (std::size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); ++i)
+  {
+    std::vector<char> data(100);
+    boost::asio::read_at(reader1, blocks[i] * 100, boost::asio::buffer(data));
+    BOOST_CHECK(std::string(data.begin(), data.end())
+        == content.substr(blocks[i] * 100, 100));
+  }
+
+  // Block 1 stays in the cache. Block 0 is discarded when block 3 is read,
+  // and block 5 when block 0 is read again.
+  std::vector<std::string> ranges = server.ranges();
+  BOOST_REQUIRE(ranges.size() == 6);
+  BOOST_CHECK(ranges[0] == "0-99");
+  BOOST_CHECK(ranges[1] == "500-599");
+  BOOST_CHECK(ranges[2] == "100-199");
+  BOOST_CHECK(ranges[3] == "300-399");
+  BOOST_CHECK(ranges[4] == "0-99");
+  BOOST_CHECK(ranges[5] == "500-599");
+}
+
+// Test that sequential reads fetch the following blocks in growing runs.
+void random_access_reader_read_ahead_test()
+{
+  std::string content = make_content(10000);
+  range_server server(content);
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  urdl::random_access_reader reader1;
+  reader1.block_size(100);
+  reader1.max_read_ahead(8);
+  reader1.open("http://localhost:" + port + "/");
+
+  std::string returned_content;
+  for (std::size_t offset = 0; offset < content.size(); offset += 100)
+  {
+    std::vector<char> data(100);
+    boost::asio::read_at(reader1, offset, boost::asio::buffer(data));
+    returned_content.append(data.begin(), data.end());
+  }
+
+  BOOST_CHECK(returned_content == content);
+
+  // Each request fetches the block that is read and the blocks after it, up
+  // to eight of them.
+  std::vector<std::string> ranges = server.ranges();
+  BOOST_REQUIRE(ranges.size() == 14);
+  BOOST_CHECK(ranges[1] == "100-299");
+  BOOST_CHECK(ranges[2] == "300-799");
+  BOOST_CHECK(ranges[3] == "800-1699");
+  BOOST_CHECK(ranges[13] == "9800-9999");
+}
+
+struct random_access_read_task
+{
+  urdl::random_access_reader* reader_;
+  std::size_t offset_;
+  std::size_t length_;
+  std::string* result_;
+  void operator()()
+  {
+    std::vector<char> data(length_);
+    boost::system::error_code ec;
+    boost::asio::read_at(*reader_, offset_, boost::asio::buffer(data), ec);
+    if (!ec)
+      result_->assign(data.begin(), data.end());
+  }
+};
+
+// Test that reads from several threads fetch their blocks in parallel.
+void random_access_reader_parallel_test()
+{
+  std::string content = make_content(100000);
+  range_server server(content, 100);
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  urdl::random_access_reader reader1;
+  reader1.block_size(1000);
+  reader1.max_read_ahead(0);
+  reader1.open("http://localhost:" + port + "/");
+
+  // Neighbouring threads' reads share a block, so that some of them wait for
+  // blocks being fetched by others.
+  const std::size_t thread_count = 8;
+  std::vector<std::string> results(thread_count);
+  boost::thread_group threads;
+  for (std::size_t i = 0; i < thread_count; ++i)
+  {
+    random_access_read_task task
+      = { &reader1, 500 + i * 10000, 10000, &results[i] };
+    threads.create_thread(task);
+  }
+  threads.join_all();
+
+  for (std::size_t i = 0; i < thread_count; ++i)
+    BOOST_CHECK(results[i] == content.substr(500 + i * 10000, 10000));
+  BOOST_CHECK(server.max_active() > 1);
+
+  // The blocks fetched by the threads are reused.
+  std::vector<char> data(100000);
+  boost::asio::read_at(reader1, 0, boost::asio::buffer(data));
+  BOOST_CHECK(std::string(data.begin(), data.end()) == content);
+}
+
+// Test that a server that does not support byte ranges is detected.
+void random_access_reader_range_not_supported_test()
+{
+  http_server server;
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  std::string request = make_request(port, "Range: bytes=0-99\r\n");
+  std::string response =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Length: 1000\r\n\r\n";
+
+  server.start(request, 0, response, 0, make_content(1000));
+  urdl::random_access_reader reader1;
+  reader1.block_size(100);
+  boost::system::error_code ec;
+  reader1.open("http://localhost:" + port + "/", ec);
+  bool request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(ec == urdl::http::errc::range_not_supported);
+  BOOST_CHECK(!reader1.is_open());
+}
+
+// Returns a file URL for a file in the current directory.
+std::string file_url(const std::string& name)
+{
+  char buffer[4096] = "";
+#if defined(BOOST_WINDOWS)
+  _getcwd(buffer, sizeof(buffer));
+  std::string path = std::string("/") + buffer + "/" + name;
+  std::replace(path.begin(), path.end(), '\\', '/');
+#else // defined(BOOST_WINDOWS)
+  getcwd(buffer, sizeof(buffer));
+  std::string path = std::string(buffer) + "/" + name;
+#endif // defined(BOOST_WINDOWS)
+  return "file://" + path;
+}
+
+// Test reading parts of a file.
+void random_access_reader_file_test()
+{
+  std::string content = make_content(300000);
+  {
+    std::ofstream os("random_access_reader_file_test.txt",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  urdl::random_access_reader reader1;
+  reader1.block_size(4096);
+  reader1.open(file_url("random_access_reader_file_test.txt"));
+  BOOST_CHECK(reader1.size() == content.size());
+
+  const std::size_t offsets[] = { 250000, 12345, 0, 299000, 100000 };
+  for (std::size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i)
+  {
+    std::vector<char> data(10000);
+    std::size_t length = reader1.read_some_at(offsets[i],
+        boost::asio::buffer(data));
+    BOOST_CHECK(std::string(data.begin(), data.begin() + length)
+        == content.substr(offsets[i], data.size()));
+  }
+
+  reader1.close();
+  std::remove("random_access_reader_file_test.txt");
+}
+
+test_suite* init_unit_test_suite(int, char*[])
+{
+  test_suite* test = BOOST_TEST_SUITE("random_access_reader");
+  test->add(BOOST_TEST_CASE(&random_access_reader_compile_test));
+  test->add(BOOST_TEST_CASE(&random_access_reader_http_test));
+  test->add(BOOST_TEST_CASE(&random_access_reader_merge_test));
+  test->add(BOOST_TEST_CASE(&random_access_reader_lru_test));
+  test->add(BOOST_TEST_CASE(&random_access_reader_read_ahead_test));
+  test->add(BOOST_TEST_CASE(&random_access_reader_parallel_test));
+  test->add(BOOST_TEST_CASE(&random_access_reader_range_not_supported_test));
+  test->add(BOOST_TEST_CASE(&random_access_reader_file_test));
+  return test;
+}
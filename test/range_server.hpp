@@ -0,0 +1,197 @@
+//
+// range_server.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef RANGE_SERVER_HPP
+#define RANGE_SERVER_HPP
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// An HTTP server that serves a single resource, honouring the Range header of
+// each request. Connections are handled in parallel, and the byte range of
+// each request is recorded.
+class range_server
+{
+public:
+  typedef boost::asio::ip::tcp tcp;
+
+  explicit range_server(const std::string& content,
+      std::size_t response_delay = 0)
+    : acceptor_(io_service_, tcp::endpoint(
+          boost::asio::ip::address_v4::loopback(), 0)),
+      content_(content),
+      response_delay_(response_delay),
+      stopped_(false),
+      active_(0),
+      max_active_(0)
+  {
+    thread_.reset(new boost::thread(
+          boost::bind(&range_server::accept_loop, this)));
+  }
+
+  ~range_server()
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stopped_ = true;
+    }
+
+    // Wake the accepting thread with a connection of our own.
+    boost::system::error_code ec;
+    tcp::socket socket(io_service_);
+    socket.connect(acceptor_.local_endpoint(), ec);
+    thread_->join();
+    connections_.join_all();
+  }
+
+  unsigned short port() const
+  {
+    return acceptor_.local_endpoint().port();
+  }
+
+  // The ranges requested, in the form "first-last", or an empty string for a
+  // request without a Range header.
+  std::vector<std::string> ranges() const
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return ranges_;
+  }
+
+  // The largest number of requests that were handled at the same time.
+  std::size_t max_active() const
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return max_active_;
+  }
+
+private:
+  void accept_loop()
+  {
+    for (;;)
+    {
+      boost::shared_ptr<tcp::socket> socket(new tcp::socket(io_service_));
+      boost::system::error_code ec;
+      acceptor_.accept(*socket, ec);
+
+      boost::mutex::scoped_lock lock(mutex_);
+      if (stopped_)
+        return;
+      if (!ec)
+      {
+        connections_.create_thread(
+            boost::bind(&range_server::handle_connection, this, socket));
+      }
+    }
+  }
+
+  void handle_connection(boost::shared_ptr<tcp::socket> socket)
+  {
+    try
+    {
+      boost::asio::streambuf buffer;
+      std::size_t size = boost::asio::read_until(*socket, buffer, "\r\n\r\n");
+      std::string request(size, 0);
+      buffer.sgetn(&request[0], size);
+
+      std::string range;
+      std::string::size_type pos = request.find("\r\nRange: bytes=");
+      if (pos != std::string::npos)
+      {
+        pos += 15;
+        range = request.substr(pos, request.find("\r\n", pos) - pos);
+      }
+
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        ranges_.push_back(range);
+        if (++active_ > max_active_)
+          max_active_ = active_;
+      }
+
+      boost::this_thread::sleep(
+          boost::posix_time::milliseconds(response_delay_));
+
+      std::string response;
+      std::string body;
+      std::string length = boost::lexical_cast<std::string>(content_.size());
+      if (range.empty())
+      {
+        response = "HTTP/1.0 200 OK\r\n";
+        body = content_;
+      }
+      else
+      {
+        std::size_t first = std::atoi(range.c_str());
+        std::size_t last = content_.size() - 1;
+        std::string::size_type dash = range.find('-');
+        if (dash + 1 < range.size())
+          last = std::atoi(range.c_str() + dash + 1);
+        if (last >= content_.size())
+          last = content_.size() - 1;
+
+        if (first >= content_.size())
+        {
+          response = "HTTP/1.0 416 Requested Range Not Satisfiable\r\n"
+            "Content-Range: bytes */" + length + "\r\n";
+        }
+        else
+        {
+          response = "HTTP/1.0 206 Partial Content\r\n"
+            "Content-Range: bytes "
+            + boost::lexical_cast<std::string>(first) + "-"
+            + boost::lexical_cast<std::string>(last) + "/" + length + "\r\n";
+          body = content_.substr(first, last - first + 1);
+        }
+      }
+      response += "Content-Length: "
+        + boost::lexical_cast<std::string>(body.size()) + "\r\n\r\n";
+
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        --active_;
+      }
+
+      boost::system::error_code ec;
+      boost::asio::write(*socket, boost::asio::buffer(response), ec);
+      boost::asio::write(*socket, boost::asio::buffer(body), ec);
+      socket->shutdown(tcp::socket::shutdown_both, ec);
+      socket->close(ec);
+    }
+    catch (std::exception&)
+    {
+    }
+  }
+
+  boost::asio::io_service io_service_;
+  tcp::acceptor acceptor_;
+  std::string content_;
+  std::size_t response_delay_;
+  mutable boost::mutex mutex_;
+  bool stopped_;
+  std::vector<std::string> ranges_;
+  std::size_t active_;
+  std::size_t max_active_;
+  boost::thread_group connections_;
+  boost::scoped_ptr<boost::thread> thread_;
+};
+
+#endif // RANGE_SERVER_HPP
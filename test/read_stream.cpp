@@ -17,11 +17,27 @@
 #include "urdl/read_stream.hpp"
 
 #include "unit_test.hpp"
+#include "urdl/file.hpp"
 #include "urdl/option_set.hpp"
 #include "http_server.hpp"
+#include "impairment_proxy.hpp"
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/read.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#if defined(BOOST_WINDOWS)
+# include <direct.h>
+#else // defined(BOOST_WINDOWS)
+# include <sys/stat.h>
+# include <unistd.h>
+#endif // defined(BOOST_WINDOWS)
 
 void open_handler(const boost::system::error_code&) {}
 void read_handler(const boost::system::error_code&, std::size_t) {}
@@ -62,6 +78,11 @@ void read_stream_compile_test()
 
     want<urdl::option_set>(const_stream1.get_options());
 
+    // immediate_completion()
+
+    want<std::size_t>(const_stream1.immediate_completion());
+    stream1.immediate_completion(16);
+
     // is_open()
 
     want<bool>(const_stream1.is_open());
@@ -83,6 +104,11 @@ void read_stream_compile_test()
     stream1.close();
     want<boost::system::error_code>(stream1.close(ec));
 
+    // seek()
+
+    stream1.seek(boost::uint64_t(0));
+    want<boost::system::error_code>(stream1.seek(boost::uint64_t(0), ec));
+
     // content_type()
 
     want<std::string>(const_stream1.content_type());
@@ -103,6 +129,49 @@ void read_stream_compile_test()
     // async_read_some()
 
     stream1.async_read_some(boost::asio::buffer(buffer), read_handler);
+
+    // read_body()
+
+    std::string string_body;
+    std::vector<char> vector_body;
+    want<std::size_t>(stream1.read_body(string_body));
+    want<std::size_t>(stream1.read_body(vector_body, 1024));
+    want<std::size_t>(stream1.read_body(string_body, ec));
+    want<std::size_t>(stream1.read_body(vector_body, 1024, ec));
+    want<std::size_t>(stream1.read_body(boost::asio::buffer(buffer)));
+    want<std::size_t>(stream1.read_body(boost::asio::buffer(buffer), ec));
+
+    // async_read_body()
+
+    stream1.async_read_body(string_body, read_handler);
+    stream1.async_read_body(vector_body, 1024, read_handler);
+    stream1.async_read_body(boost::asio::buffer(buffer), read_handler);
+
+    // read_to_file()
+
+    want<std::size_t>(stream1.read_to_file("file.txt"));
+    want<std::size_t>(stream1.read_to_file("file.txt", ec));
+
+    // async_read_to_file()
+
+    stream1.async_read_to_file("file.txt", read_handler);
+
+    // data()
+
+    want<boost::asio::const_buffers_1>(const_stream1.data());
+
+    // consume()
+
+    stream1.consume(0);
+
+    // fill()
+
+    want<std::size_t>(stream1.fill());
+    want<std::size_t>(stream1.fill(ec));
+
+    // async_fill()
+
+    stream1.async_fill(read_handler);
   }
   catch (std::exception&)
   {
@@ -115,15 +184,8 @@ void read_stream_synchronous_http_test()
   http_server server;
   std::string port = boost::lexical_cast<std::string>(server.port());
 
-  std::string request =
-    "GET / HTTP/1.0\r\n"
-    "Host: localhost:" + port + "\r\n"
-    "Accept: */*\r\n"
-    "Connection: close\r\n\r\n";
-  std::string response =
-    "HTTP/1.0 200 OK\r\n"
-    "Content-Length: 13\r\n"
-    "Content-Type: text/plain\r\n\r\n";
+  std::string request = make_request(port);
+  std::string response = make_response(13);
   std::string content = "Hello, World!";
 
   server.start(request, 0, response, 0, content);
@@ -151,15 +213,8 @@ void read_stream_synchronous_http_not_found_test()
   http_server server;
   std::string port = boost::lexical_cast<std::string>(server.port());
 
-  std::string request =
-    "GET / HTTP/1.0\r\n"
-    "Host: localhost:" + port + "\r\n"
-    "Accept: */*\r\n"
-    "Connection: close\r\n\r\n";
-  std::string response =
-    "HTTP/1.0 404 Not Found\r\n"
-    "Content-Length: 9\r\n"
-    "Content-Type: text/plain\r\n\r\n";
+  std::string request = make_request(port);
+  std::string response = make_response(9, "404 Not Found");
   std::string content = "Not Found";
 
   server.start(request, 0, response, 0, content);
@@ -193,15 +248,8 @@ void read_stream_asynchronous_http_test()
   http_server server;
   std::string port = boost::lexical_cast<std::string>(server.port());
 
-  std::string request =
-    "GET / HTTP/1.0\r\n"
-    "Host: localhost:" + port + "\r\n"
-    "Accept: */*\r\n"
-    "Connection: close\r\n\r\n";
-  std::string response =
-    "HTTP/1.0 200 OK\r\n"
-    "Content-Length: 13\r\n"
-    "Content-Type: text/plain\r\n\r\n";
+  std::string request = make_request(port);
+  std::string response = make_response(13);
   std::string content = "Hello, World!";
 
   server.start(request, 0, response, 0, content);
@@ -239,15 +287,8 @@ void read_stream_asynchronous_http_not_found_test()
   http_server server;
   std::string port = boost::lexical_cast<std::string>(server.port());
 
-  std::string request =
-    "GET / HTTP/1.0\r\n"
-    "Host: localhost:" + port + "\r\n"
-    "Accept: */*\r\n"
-    "Connection: close\r\n\r\n";
-  std::string response =
-    "HTTP/1.0 404 Not Found\r\n"
-    "Content-Length: 9\r\n"
-    "Content-Type: text/plain\r\n\r\n";
+  std::string request = make_request(port);
+  std::string response = make_response(9, "404 Not Found");
   std::string content = "Not Found";
 
   server.start(request, 0, response, 0, content);
@@ -268,6 +309,997 @@ void read_stream_asynchronous_http_not_found_test()
   BOOST_CHECK(ec == urdl::http::errc::not_found);
 }
 
+// Test HTTP with a byte range, where the server's partial response must start
+// at the first byte of the range.
+void read_stream_http_range_test()
+{
+  http_server server;
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  std::string request = make_request(port, "Range: bytes=500-999\r\n");
+  std::string content = make_content(500);
+
+  const char* content_ranges[] =
+  {
+    "Content-Range: bytes 500-999/1000\r\n",
+    "Content-Range: bytes 0-499/1000\r\n",
+    ""
+  };
+
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int async = 0; async < 2; ++async)
+    {
+      std::string response = "HTTP/1.0 206 Partial Content\r\n"
+        "Content-Length: 500\r\n" + std::string(content_ranges[i])
+        + "Content-Type: text/plain\r\n\r\n";
+      server.start(request, 0, response, 0, content);
+
+      boost::asio::io_service io_service;
+      urdl::read_stream stream1(io_service);
+      stream1.set_option(urdl::http::byte_range(500, 999));
+
+      boost::system::error_code ec;
+      if (async)
+      {
+        std::size_t bytes_transferred = 0;
+        handler h = { ec, bytes_transferred };
+        stream1.async_open("http://localhost:" + port + "/", h);
+        io_service.run();
+      }
+      else
+        stream1.open("http://localhost:" + port + "/", ec);
+
+      std::string returned_content;
+      if (!ec)
+      {
+        returned_content.resize(stream1.content_length());
+        boost::asio::read(stream1, boost::asio::buffer(
+              &returned_content[0], returned_content.size()), ec);
+      }
+      stream1.close();
+      server.stop();
+
+      if (i == 0)
+      {
+        BOOST_CHECK(!ec);
+        BOOST_CHECK(returned_content == content);
+      }
+      else
+        BOOST_CHECK(ec == urdl::http::errc::range_not_supported);
+    }
+  }
+}
+
+// Test synchronous HTTP over a slow network.
+void read_stream_impaired_http_test()
+{
+  http_server server;
+  impairment i;
+  i.rtt = 200;
+  i.jitter = 20;
+  i.bandwidth = 64 * 1024;
+  i.drip_size = 4;
+  i.drip_interval = 10;
+  impairment_proxy proxy(server.port(), i);
+  std::string port = boost::lexical_cast<std::string>(proxy.port());
+
+  std::string request = make_request(port);
+  std::string response = make_response(13);
+  std::string content = "Hello, World!";
+
+  server.start(request, 0, response, 0, content);
+
+  boost::asio::io_service io_service;
+  urdl::read_stream stream1(io_service);
+
+  boost::posix_time::ptime start =
+    boost::posix_time::microsec_clock::universal_time();
+  stream1.open("http://localhost:" + port + "/");
+
+  std::string returned_content(stream1.content_length(), 0);
+  boost::asio::read(stream1, boost::asio::buffer(
+        &returned_content[0], returned_content.size()));
+  boost::posix_time::time_duration elapsed =
+    boost::posix_time::microsec_clock::universal_time() - start;
+
+  bool request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(returned_content == content);
+  BOOST_CHECK(elapsed >= boost::posix_time::milliseconds(200));
+}
+
+// Test synchronous HTTP with the connection reset part way through the body.
+void read_stream_http_reset_test()
+{
+  http_server server;
+  impairment i;
+  std::string response = make_response(1000);
+  i.reset_after = response.size() + 100;
+  impairment_proxy proxy(server.port(), i);
+  std::string port = boost::lexical_cast<std::string>(proxy.port());
+
+  std::string request = make_request(port);
+  std::string content(1000, 'x');
+
+  server.start(request, 0, response, 0, content);
+
+  boost::asio::io_service io_service;
+  urdl::read_stream stream1(io_service);
+
+  boost::system::error_code ec;
+  stream1.open("http://localhost:" + port + "/", ec);
+  BOOST_CHECK(!ec);
+
+  std::string returned_content(content.size(), 0);
+  std::size_t length = boost::asio::read(stream1, boost::asio::buffer(
+        &returned_content[0], returned_content.size()), ec);
+  server.stop();
+
+  BOOST_CHECK(ec);
+  BOOST_CHECK(length < content.size());
+}
+
+// Test that a connection reset found while returning buffered data is
+// reported by the next read, rather than being lost.
+void read_stream_http_reset_after_fill_test()
+{
+  http_server server;
+  impairment i;
+  std::string response = make_response(1000);
+  i.reset_after = response.size() + 100;
+  impairment_proxy proxy(server.port(), i);
+  std::string port = boost::lexical_cast<std::string>(proxy.port());
+
+  std::string request = make_request(port);
+  std::string content = make_content(1000);
+
+  server.start(request, 0, response, 0, content);
+
+  boost::asio::io_service io_service;
+  urdl::read_stream stream1(io_service);
+
+  boost::system::error_code ec;
+  stream1.open("http://localhost:" + port + "/", ec);
+  BOOST_CHECK(!ec);
+
+  // Let the content and the reset arrive, then buffer the content so that the
+  // reset is found by the read that returns it.
+  boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+  std::size_t length = stream1.fill(ec);
+  BOOST_CHECK(!ec);
+  BOOST_CHECK(length > 0);
+
+  std::string returned_content(content.size(), 0);
+  length = stream1.read_some(boost::asio::buffer(
+        &returned_content[0], returned_content.size()), ec);
+  BOOST_CHECK(!ec);
+  BOOST_CHECK(length == 100);
+  BOOST_CHECK(returned_content.substr(0, length) == content.substr(0, length));
+
+  stream1.read_some(boost::asio::buffer(
+        &returned_content[0], returned_content.size()), ec);
+  BOOST_CHECK(ec == boost::asio::error::connection_reset);
+
+  server.stop();
+}
+
+// Test reading HTTP content in place.
+void read_stream_http_fill_test()
+{
+  http_server server;
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  std::string request = make_request(port);
+  std::string response = make_response(13);
+  std::string content = "Hello, World!";
+
+  server.start(request, 0, response, 10, content);
+
+  boost::asio::io_service io_service;
+  urdl::read_stream stream1(io_service);
+
+  stream1.open("http://localhost:" + port + "/");
+
+  std::string returned_content;
+  boost::system::error_code ec;
+  while (stream1.fill(ec) > 0)
+  {
+    boost::asio::const_buffers_1 data = stream1.data();
+    const char* p = boost::asio::buffer_cast<const char*>(data);
+    returned_content.append(p, p + 1);
+    stream1.consume(1);
+  }
+
+  bool request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(ec == boost::asio::error::eof);
+  BOOST_CHECK(boost::asio::buffer_size(stream1.data()) == 0);
+  BOOST_CHECK(returned_content == content);
+}
+
+// Returns a file URL for a file in the current directory.
+std::string file_url(const std::string& name)
+{
+  char buffer[4096] = "";
+#if defined(BOOST_WINDOWS)
+  _getcwd(buffer, sizeof(buffer));
+  std::string path = std::string("/") + buffer + "/" + name;
+  std::replace(path.begin(), path.end(), '\\', '/');
+#else // defined(BOOST_WINDOWS)
+  getcwd(buffer, sizeof(buffer));
+  std::string path = std::string(buffer) + "/" + name;
+#endif // defined(BOOST_WINDOWS)
+  return "file://" + path;
+}
+
+// Test reading file content in place, mixed with read_some.
+void read_stream_file_fill_test()
+{
+  std::string content = make_content(50000);
+  {
+    std::ofstream os("read_stream_file_fill_test.txt",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  boost::asio::io_service io_service;
+  urdl::read_stream stream1(io_service);
+
+  stream1.open(file_url("read_stream_file_fill_test.txt"));
+
+  std::string returned_content;
+  boost::system::error_code ec;
+  std::size_t bytes_available = 0;
+  while ((bytes_available = stream1.fill(ec)) > 0)
+  {
+    BOOST_CHECK(boost::asio::buffer_size(stream1.data()) == bytes_available);
+    const char* p = boost::asio::buffer_cast<const char*>(stream1.data());
+    returned_content.append(p, p + bytes_available / 2);
+    stream1.consume(bytes_available / 2);
+
+    char buffer[1024];
+    std::size_t length = stream1.read_some(boost::asio::buffer(buffer), ec);
+    returned_content.append(buffer, buffer + length);
+  }
+
+  stream1.close();
+  std::remove("read_stream_file_fill_test.txt");
+
+  BOOST_CHECK(ec == boost::asio::error::eof);
+  BOOST_CHECK(returned_content == content);
+}
+
+// Test the information reported about a file.
+void read_stream_file_info_test()
+{
+  std::string content(12345, 'x');
+  {
+    std::ofstream os("read_stream_file_info_test.html",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  boost::asio::io_service io_service;
+  urdl::read_stream stream1(io_service);
+
+  stream1.open(file_url("read_stream_file_info_test.html"));
+  BOOST_CHECK(stream1.content_length() == content.size());
+  BOOST_CHECK(stream1.content_type().empty());
+  BOOST_CHECK(stream1.headers().find("Content-Length: 12345\r\n")
+      != std::string::npos);
+  BOOST_CHECK(stream1.headers().find("Last-Modified: ") != std::string::npos);
+  stream1.close();
+  BOOST_CHECK(stream1.content_length() == ~std::size_t(0));
+
+  stream1.set_option(urdl::file::guess_content_type(true));
+  stream1.open(file_url("read_stream_file_info_test.html"));
+  BOOST_CHECK(stream1.content_type() == "text/html");
+  BOOST_CHECK(stream1.headers().find("Content-Type: text/html\r\n")
+      != std::string::npos);
+  stream1.close();
+
+  std::remove("read_stream_file_info_test.html");
+}
+
+// Test that a read from a file fills all of the buffers it is given.
+void read_stream_file_scatter_read_test()
+{
+  std::string content = make_content(1000);
+  {
+    std::ofstream os("read_stream_file_scatter_read_test.txt",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  boost::asio::io_service io_service;
+  urdl::read_stream stream1(io_service);
+  stream1.open(file_url("read_stream_file_scatter_read_test.txt"));
+
+  char buffer1[100], buffer2[200], buffer3[300];
+  std::vector<boost::asio::mutable_buffer> buffers;
+  buffers.push_back(boost::asio::buffer(buffer1));
+  buffers.push_back(boost::asio::mutable_buffer());
+  buffers.push_back(boost::asio::buffer(buffer2));
+  buffers.push_back(boost::asio::buffer(buffer3));
+
+  boost::system::error_code ec;
+  std::size_t length = stream1.read_some(buffers, ec);
+
+  stream1.close();
+  std::remove("read_stream_file_scatter_read_test.txt");
+
+  BOOST_CHECK(!ec);
+  BOOST_CHECK(length == 600);
+  BOOST_CHECK(std::string(buffer1, 100) == content.substr(0, 100));
+  BOOST_CHECK(std::string(buffer2, 200) == content.substr(100, 200));
+  BOOST_CHECK(std::string(buffer3, 300) == content.substr(300, 300));
+}
+
+// Test reading a file with the page cache bypassed or dropped.
+void read_stream_file_cache_options_test()
+{
+  std::string content = make_content(3000000);
+  {
+    std::ofstream os("read_stream_file_cache_options_test.txt",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  for (int direct_io = 0; direct_io < 2; ++direct_io)
+  {
+    boost::asio::io_service io_service;
+    urdl::read_stream stream1(io_service);
+    stream1.set_option(urdl::file::direct_io(direct_io != 0));
+    stream1.set_option(urdl::file::drop_cache(direct_io == 0));
+
+    stream1.open(file_url("read_stream_file_cache_options_test.txt"));
+
+    std::vector<char> returned_content(content.size() + 1);
+    boost::system::error_code ec;
+    std::size_t length = boost::asio::read(stream1,
+        boost::asio::buffer(returned_content), ec);
+
+    stream1.close();
+
+    BOOST_CHECK(ec == boost::asio::error::eof);
+    BOOST_CHECK(length == content.size());
+    BOOST_CHECK(std::string(returned_content.begin(),
+          returned_content.begin() + length) == content);
+  }
+
+  std::remove("read_stream_file_cache_options_test.txt");
+}
+
+// Test reading a file through a memory mapping.
+void read_stream_file_memory_map_test()
+{
+  std::string content = make_content(50000);
+  {
+    std::ofstream os("read_stream_file_memory_map_test.txt",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  boost::asio::io_service io_service;
+  urdl::read_stream stream1(io_service);
+  stream1.set_option(urdl::file::memory_map(true));
+
+  stream1.open(file_url("read_stream_file_memory_map_test.txt"));
+  BOOST_CHECK(stream1.content_length() == content.size());
+
+  // The whole file is available in place.
+  boost::system::error_code ec;
+  BOOST_CHECK(stream1.fill(ec) == content.size());
+  BOOST_CHECK(!ec);
+  const char* p = boost::asio::buffer_cast<const char*>(stream1.data());
+  std::string returned_content(p, p + 1000);
+  stream1.consume(1000);
+
+  char buffer[1024];
+  std::size_t length = 0;
+  while ((length = stream1.read_some(boost::asio::buffer(buffer), ec)) > 0)
+    returned_content.append(buffer, buffer + length);
+
+  stream1.close();
+  std::remove("read_stream_file_memory_map_test.txt");
+
+  BOOST_CHECK(ec == boost::asio::error::eof);
+  BOOST_CHECK(returned_content == content);
+}
+
+// Test reading a file using io_uring, synchronously and asynchronously.
+void read_stream_file_io_uring_test()
+{
+  std::string content = make_content(300000);
+  {
+    std::ofstream os("read_stream_file_io_uring_test.txt",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  for (int asynchronous = 0; asynchronous < 2; ++asynchronous)
+  {
+    boost::asio::io_service io_service;
+    urdl::read_stream stream1(io_service);
+    stream1.set_option(urdl::file::io_uring(true));
+
+    stream1.open(file_url("read_stream_file_io_uring_test.txt"));
+
+    std::vector<char> returned_content(content.size() + 1);
+    boost::system::error_code ec;
+    std::size_t length = 0;
+    if (asynchronous)
+    {
+      handler h = { ec, length };
+      boost::asio::async_read(stream1,
+          boost::asio::buffer(returned_content), h);
+      io_service.run();
+    }
+    else
+    {
+      length = boost::asio::read(stream1,
+          boost::asio::buffer(returned_content), ec);
+    }
+
+    stream1.close();
+
+    BOOST_CHECK(ec == boost::asio::error::eof);
+    BOOST_CHECK(length == content.size());
+    BOOST_CHECK(std::string(returned_content.begin(),
+          returned_content.begin() + length) == content);
+  }
+
+  std::remove("read_stream_file_io_uring_test.txt");
+}
+
+// Test moving the read position of a file, using each way of reading it.
+void read_stream_file_seek_test()
+{
+  std::string content = make_content(300000);
+  {
+    std::ofstream os("read_stream_file_seek_test.txt",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  for (int mode = 0; mode < 4; ++mode)
+  {
+    boost::asio::io_service io_service;
+    urdl::read_stream stream1(io_service);
+    stream1.set_option(urdl::file::direct_io(mode == 1));
+    stream1.set_option(urdl::file::memory_map(mode == 2));
+    stream1.set_option(urdl::file::io_uring(mode == 3));
+
+    stream1.open(file_url("read_stream_file_seek_test.txt"));
+
+    const std::size_t offsets[] = { 12345, 100, 299990, 0, 300000 };
+    for (std::size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i)
+    {
+      boost::system::error_code ec;
+      stream1.seek(offsets[i], ec);
+      BOOST_CHECK(!ec);
+
+      std::vector<char> returned_content(20);
+      std::size_t length = boost::asio::read(stream1,
+          boost::asio::buffer(returned_content), ec);
+      std::size_t expected_length = content.size() - offsets[i];
+      if (expected_length > returned_content.size())
+        expected_length = returned_content.size();
+      BOOST_CHECK(length == expected_length);
+      BOOST_CHECK(std::string(returned_content.begin(),
+            returned_content.begin() + length)
+          == content.substr(offsets[i], length));
+    }
+
+    stream1.close();
+  }
+
+  std::remove("read_stream_file_seek_test.txt");
+}
+
+#if !defined(BOOST_WINDOWS)
+
+// Writes content to a FIFO, waiting for a reader to open it.
+void write_fifo(const std::string& name, const std::string& content)
+{
+  std::ofstream os(name.c_str(), std::ios_base::out | std::ios_base::binary);
+  os.write(content.data(), content.size());
+}
+
+// Test reading a FIFO, which cannot be read at an offset or mapped, whatever
+// the options.
+void read_stream_file_fifo_test()
+{
+  std::string content = make_content(100000);
+
+  for (int mode = 0; mode < 4; ++mode)
+  {
+    ::unlink("read_stream_file_fifo_test.fifo");
+    BOOST_REQUIRE(::mkfifo("read_stream_file_fifo_test.fifo", 0600) == 0);
+    boost::thread writer(boost::bind(&write_fifo,
+          "read_stream_file_fifo_test.fifo", content));
+
+    boost::asio::io_service io_service;
+    urdl::read_stream stream1(io_service);
+    stream1.set_option(urdl::file::direct_io(mode == 1));
+    stream1.set_option(urdl::file::memory_map(mode == 2));
+    stream1.set_option(urdl::file::io_uring(mode == 3));
+
+    boost::system::error_code ec;
+    stream1.open(file_url("read_stream_file_fifo_test.fifo"), ec);
+    BOOST_CHECK(!ec);
+    BOOST_CHECK(stream1.content_length() == ~std::size_t(0));
+
+    std::string returned_content(content.size(), 0);
+    std::size_t length = boost::asio::read(stream1,
+        boost::asio::buffer(&returned_content[0], returned_content.size()),
+        ec);
+    BOOST_CHECK(!ec);
+    BOOST_CHECK(length == content.size());
+    BOOST_CHECK(returned_content == content);
+
+    stream1.seek(0, ec);
+    BOOST_CHECK(ec == boost::asio::error::operation_not_supported);
+
+    stream1.close();
+    writer.join();
+  }
+
+  ::unlink("read_stream_file_fifo_test.fifo");
+}
+
+#endif // !defined(BOOST_WINDOWS)
+
+#if defined(URDL_HAS_MOVE)
+
+// Opens a stream for a file, as a factory function would.
+urdl::read_stream open_file_stream(boost::asio::io_service& io_service,
+    const std::string& name)
+{
+  urdl::read_stream stream1(io_service);
+  stream1.set_option(urdl::file::memory_map(true));
+  stream1.open(file_url(name));
+  return stream1;
+}
+
+// Test moving open streams into a container and between streams.
+void read_stream_move_test()
+{
+  std::string content = make_content(50000);
+  {
+    std::ofstream os("read_stream_move_test.txt",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  boost::asio::io_service io_service;
+  std::vector<urdl::read_stream> streams;
+  std::vector<char> returned_content(content.size() + 1);
+  for (std::size_t i = 0; i < 8; ++i)
+  {
+    urdl::read_stream stream1(
+        open_file_stream(io_service, "read_stream_move_test.txt"));
+    boost::asio::read(stream1, boost::asio::buffer(&returned_content[0], i));
+    streams.push_back(std::move(stream1));
+    BOOST_CHECK(!stream1.is_open());
+  }
+
+  for (std::size_t i = 0; i < streams.size(); ++i)
+  {
+    BOOST_CHECK(streams[i].is_open());
+    BOOST_CHECK(streams[i].get_option<urdl::file::memory_map>().value()
+        == true);
+    BOOST_CHECK(streams[i].content_length() == content.size());
+
+    boost::system::error_code ec;
+    std::size_t length = boost::asio::read(streams[i],
+        boost::asio::buffer(returned_content), ec);
+    BOOST_CHECK(ec == boost::asio::error::eof);
+    BOOST_CHECK(length == content.size() - i);
+    BOOST_CHECK(std::string(returned_content.begin(),
+          returned_content.begin() + length) == content.substr(i));
+  }
+
+  urdl::read_stream stream2(io_service);
+  stream2 = open_file_stream(io_service, "read_stream_move_test.txt");
+  streams[0] = std::move(stream2);
+  BOOST_CHECK(!stream2.is_open());
+  std::size_t length = boost::asio::read(streams[0],
+      boost::asio::buffer(&returned_content[0], 100));
+  BOOST_CHECK(length == 100);
+  BOOST_CHECK(std::string(returned_content.begin(),
+        returned_content.begin() + length) == content.substr(0, 100));
+
+  // A moved-from stream has no options set, and can be opened again.
+  BOOST_CHECK(stream2.get_option<urdl::file::memory_map>().value() == false);
+  stream2.open(file_url("read_stream_move_test.txt"));
+  length = boost::asio::read(stream2,
+      boost::asio::buffer(&returned_content[0], 100));
+  BOOST_CHECK(length == 100);
+  BOOST_CHECK(std::string(returned_content.begin(),
+        returned_content.begin() + length) == content.substr(0, 100));
+  stream2.close();
+
+  streams.clear();
+  std::remove("read_stream_move_test.txt");
+}
+
+#endif // defined(URDL_HAS_MOVE)
+
+// Test opening and reading a file asynchronously on the thread pool.
+void read_stream_file_thread_pool_test()
+{
+  std::string content = make_content(300000);
+  {
+    std::ofstream os("read_stream_file_thread_pool_test.txt",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  boost::asio::io_service io_service;
+  urdl::read_stream stream1(io_service);
+  stream1.set_option(urdl::file::thread_pool(true));
+
+  boost::system::error_code ec;
+  std::size_t length = 0;
+  handler h = { ec, length };
+
+  stream1.async_open(file_url("read_stream_file_thread_pool_test.txt"), h);
+  io_service.run();
+  BOOST_CHECK(!ec);
+
+  std::vector<char> returned_content(content.size() + 1);
+  boost::asio::async_read(stream1, boost::asio::buffer(returned_content), h);
+  io_service.reset();
+  io_service.run();
+
+  stream1.close();
+  std::remove("read_stream_file_thread_pool_test.txt");
+
+  BOOST_CHECK(ec == boost::asio::error::eof);
+  BOOST_CHECK(length == content.size());
+  BOOST_CHECK(std::string(returned_content.begin(),
+        returned_content.begin() + length) == content);
+}
+
+// Test closing and destroying a stream while operations are outstanding on
+// the thread pool.
+void read_stream_file_thread_pool_close_test()
+{
+  std::string content = make_content(300000);
+  {
+    std::ofstream os("read_stream_file_thread_pool_close_test.txt",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  for (int destroy = 0; destroy < 2; ++destroy)
+  {
+    boost::asio::io_service io_service;
+    boost::system::error_code ec;
+    std::size_t length = 0;
+    handler h = { ec, length };
+    std::vector<char> returned_content(content.size());
+
+    {
+      urdl::read_stream stream1(io_service);
+      stream1.set_option(urdl::file::thread_pool(true));
+      stream1.open(file_url("read_stream_file_thread_pool_close_test.txt"));
+
+      for (int i = 0; i < 10; ++i)
+      {
+        stream1.async_read_some(boost::asio::buffer(
+              &returned_content[0], returned_content.size()), h);
+      }
+
+      if (!destroy)
+      {
+        stream1.close();
+        BOOST_CHECK(!stream1.is_open());
+      }
+    }
+
+    // Each handler is still called, either with the data read before the
+    // stream was closed, or with operation_aborted.
+    std::size_t handlers = io_service.run();
+    BOOST_CHECK(handlers == 10);
+  }
+
+  std::remove("read_stream_file_thread_pool_close_test.txt");
+}
+
+struct immediate_reader
+{
+  urdl::read_stream& stream_;
+  std::string& content_;
+  std::size_t& depth_;
+  std::size_t& max_depth_;
+  std::size_t& completions_;
+  char* buffer_;
+
+  void start()
+  {
+    stream_.async_read_some(boost::asio::buffer(buffer_, 100), *this);
+  }
+
+  void operator()(const boost::system::error_code& ec, std::size_t size)
+  {
+    ++completions_;
+    if (++depth_ > max_depth_)
+      max_depth_ = depth_;
+    content_.append(buffer_, buffer_ + size);
+    if (!ec)
+      start();
+    --depth_;
+  }
+};
+
+// Test immediate completion of asynchronous reads from a file.
+void read_stream_immediate_completion_test()
+{
+  std::string content = make_content(5000);
+  {
+    std::ofstream os("read_stream_immediate_completion_test.txt",
+        std::ios_base::out | std::ios_base::binary);
+    os.write(content.data(), content.size());
+  }
+
+  boost::asio::io_service io_service;
+  urdl::read_stream stream1(io_service);
+  stream1.immediate_completion(4);
+
+  stream1.open(file_url("read_stream_immediate_completion_test.txt"));
+
+  std::string returned_content;
+  std::size_t depth = 0, max_depth = 0, completions = 0;
+  char buffer[100];
+  immediate_reader reader = { stream1, returned_content,
+    depth, max_depth, completions, buffer };
+  reader.start();
+
+  // The first four reads complete inside the call to start().
+  BOOST_CHECK(completions == 4);
+  BOOST_CHECK(returned_content == content.substr(0, 400));
+
+  io_service.run();
+
+  stream1.close();
+  std::remove("read_stream_immediate_completion_test.txt");
+
+  // A posted handler may have up to four immediate handlers nested inside it.
+  BOOST_CHECK(max_depth == 5);
+  BOOST_CHECK(returned_content == content);
+}
+
+// Test reading a whole HTTP body, with and without a known length.
+void read_stream_http_read_body_test()
+{
+  std::string content = make_content(100000);
+
+  for (int known_length = 0; known_length < 2; ++known_length)
+  {
+    http_server server;
+    std::string port = boost::lexical_cast<std::string>(server.port());
+
+    std::string request = make_request(port);
+    std::string response = known_length
+      ? "HTTP/1.0 200 OK\r\nContent-Length: 100000\r\n\r\n"
+      : "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n\r\n";
+
+    server.start(request, 0, response, 0, content);
+
+    boost::asio::io_service io_service;
+    urdl::read_stream stream1(io_service);
+    stream1.open("http://localhost:" + port + "/");
+
+    std::vector<char> body;
+    boost::system::error_code ec;
+    std::size_t length = stream1.read_body(body, ec);
+
+    bool request_matched = server.stop();
+
+    BOOST_CHECK(request_matched);
+    BOOST_CHECK(!ec);
+    BOOST_CHECK(length == content.size());
+    BOOST_CHECK(std::string(body.begin(), body.end()) == content);
+  }
+}
+
+// Test reading the rest of an HTTP body after some of it has been read.
+void read_stream_http_read_body_after_read_test()
+{
+  http_server server;
+  std::string port = boost::lexical_cast<std::string>(server.port());
+
+  std::string request = make_request(port);
+  std::string response = make_response(100000);
+  std::string content = make_content(100000);
+
+  server.start(request, 0, response, 0, content);
+
+  boost::asio::io_service io_service;
+  urdl::read_stream stream1(io_service);
+  stream1.open("http://localhost:" + port + "/");
+
+  char head[1000];
+  boost::asio::read(stream1, boost::asio::buffer(head));
+
+  std::string body;
+  boost::system::error_code ec;
+  std::size_t length = stream1.read_body(body, ec);
+
+  bool request_matched = server.stop();
+
+  BOOST_CHECK(request_matched);
+  BOOST_CHECK(!ec);
+  BOOST_CHECK(length == content.size() - sizeof(head));
+  BOOST_CHECK(body == content.substr(sizeof(head)));
+}
+
+// Test reading a whole HTTP body asynchronously, into a caller-provided arena
+// that is exactly the right size, and then into one that is too small.
+void read_stream_asynchronous_http_read_body_test()
+{
+  std::string content(20000, 'x');
+
+  for (std::size_t arena_size = 20000; arena_size >= 19999; --arena_size)
+  {
+    http_server server;
+    std::string port = boost::lexical_cast<std::string>(server.port());
+
+    std::string request = make_request(port);
+    std::string response =
+      "HTTP/1.0 200 OK\r\n"
+      "Content-Type: text/plain\r\n\r\n";
+
+    server.start(request, 0, response, 0, content);
+
+    boost::asio::io_service io_service;
+    urdl::read_stream stream1(io_service);
+
+    boost::system::error_code ec;
+    std::size_t bytes_transferred = 0;
+    handler h = { ec, bytes_transferred };
+
+    stream1.async_open("http://localhost:" + port + "/", h);
+    io_service.run();
+    BOOST_CHECK(!ec);
+
+    std::vector<char> arena(arena_size);
+    stream1.async_read_body(boost::asio::buffer(arena), h);
+    io_service.reset();
+    io_service.run();
+
+    server.stop();
+
+    if (arena_size == content.size())
+    {
+      BOOST_CHECK(!ec);
+      BOOST_CHECK(bytes_transferred == content.size());
+      BOOST_CHECK(std::string(arena.begin(), arena.end()) == content);
+    }
+    else
+    {
+      BOOST_CHECK(ec == boost::asio::error::message_size);
+    }
+  }
+}
+
+// Test reading HTTP content into a file, with and without a known length, and
+// with some of the content already buffered when the read starts.
+void read_stream_http_read_to_file_test()
+{
+  // Larger than the amount spliced for each wait on the socket.
+  std::string content = make_content(3000000);
+
+  for (int test = 0; test < 4; ++test)
+  {
+    bool asynchronous = (test & 1) != 0;
+    bool known_length = (test & 2) != 0;
+
+    http_server server;
+    std::string port = boost::lexical_cast<std::string>(server.port());
+
+    std::string request = make_request(port);
+    std::string response = known_length
+      ? make_response(content.size())
+      : "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n\r\n";
+
+    server.start(request, 0, response, 0, content);
+
+    boost::asio::io_service io_service;
+    urdl::read_stream stream1(io_service);
+    stream1.open("http://localhost:" + port + "/");
+
+    char buffer[1000];
+    boost::system::error_code ec;
+    std::size_t length = stream1.read_some(boost::asio::buffer(buffer), ec);
+    BOOST_CHECK(!ec);
+
+    std::size_t bytes_transferred = 0;
+    if (asynchronous)
+    {
+      handler h = { ec, bytes_transferred };
+      stream1.async_read_to_file("read_stream_http_read_to_file_test.txt", h);
+      io_service.run();
+    }
+    else
+    {
+      bytes_transferred = stream1.read_to_file(
+          "read_stream_http_read_to_file_test.txt", ec);
+    }
+
+    bool request_matched = server.stop();
+
+    std::ifstream is("read_stream_http_read_to_file_test.txt",
+        std::ios_base::in | std::ios_base::binary);
+    std::string returned_content(buffer, buffer + length);
+    returned_content.append(std::istreambuf_iterator<char>(is),
+        std::istreambuf_iterator<char>());
+    is.close();
+    std::remove("read_stream_http_read_to_file_test.txt");
+
+    BOOST_CHECK(request_matched);
+    BOOST_CHECK(!ec);
+    BOOST_CHECK(bytes_transferred == content.size() - length);
+    BOOST_CHECK(returned_content == content);
+  }
+}
+
+// Test that reading HTTP content into a file fails when the content is
+// shorter than its stated length.
+void read_stream_http_read_to_file_short_test()
+{
+  std::string content = make_content(150000);
+
+  for (int asynchronous = 0; asynchronous < 2; ++asynchronous)
+  {
+    http_server server;
+    std::string port = boost::lexical_cast<std::string>(server.port());
+
+    std::string request = make_request(port);
+    std::string response = make_response(200000);
+
+    server.start(request, 0, response, 0, content);
+
+    boost::asio::io_service io_service;
+    urdl::read_stream stream1(io_service);
+    stream1.open("http://localhost:" + port + "/");
+
+    boost::system::error_code ec;
+    std::size_t bytes_transferred = 0;
+    if (asynchronous)
+    {
+      handler h = { ec, bytes_transferred };
+      stream1.async_read_to_file(
+          "read_stream_http_read_to_file_short_test.txt", h);
+      io_service.run();
+    }
+    else
+    {
+      bytes_transferred = stream1.read_to_file(
+          "read_stream_http_read_to_file_short_test.txt", ec);
+    }
+
+    bool request_matched = server.stop();
+
+    std::ifstream is("read_stream_http_read_to_file_short_test.txt",
+        std::ios_base::in | std::ios_base::binary);
+    std::string returned_content((std::istreambuf_iterator<char>(is)),
+        std::istreambuf_iterator<char>());
+    is.close();
+    std::remove("read_stream_http_read_to_file_short_test.txt");
+
+    BOOST_CHECK(request_matched);
+    BOOST_CHECK(ec == boost::asio::error::eof);
+    BOOST_CHECK(bytes_transferred == content.size());
+    BOOST_CHECK(returned_content == content);
+  }
+}
+
 test_suite* init_unit_test_suite(int, char*[])
 {
   test_suite* test = BOOST_TEST_SUITE("read_stream");
@@ -276,5 +1308,31 @@ test_suite* init_unit_test_suite(int, char*[])
   test->add(BOOST_TEST_CASE(&read_stream_synchronous_http_not_found_test));
   test->add(BOOST_TEST_CASE(&read_stream_asynchronous_http_test));
   test->add(BOOST_TEST_CASE(&read_stream_asynchronous_http_not_found_test));
+  test->add(BOOST_TEST_CASE(&read_stream_http_range_test));
+  test->add(BOOST_TEST_CASE(&read_stream_impaired_http_test));
+  test->add(BOOST_TEST_CASE(&read_stream_http_reset_test));
+  test->add(BOOST_TEST_CASE(&read_stream_http_reset_after_fill_test));
+  test->add(BOOST_TEST_CASE(&read_stream_http_fill_test));
+  test->add(BOOST_TEST_CASE(&read_stream_file_fill_test));
+  test->add(BOOST_TEST_CASE(&read_stream_file_info_test));
+  test->add(BOOST_TEST_CASE(&read_stream_file_scatter_read_test));
+  test->add(BOOST_TEST_CASE(&read_stream_file_cache_options_test));
+  test->add(BOOST_TEST_CASE(&read_stream_file_memory_map_test));
+  test->add(BOOST_TEST_CASE(&read_stream_file_io_uring_test));
+  test->add(BOOST_TEST_CASE(&read_stream_file_seek_test));
+#if !defined(BOOST_WINDOWS)
+  test->add(BOOST_TEST_CASE(&read_stream_file_fifo_test));
+#endif // !defined(BOOST_WINDOWS)
+#if defined(URDL_HAS_MOVE)
+  test->add(BOOST_TEST_CASE(&read_stream_move_test));
+#endif // defined(URDL_HAS_MOVE)
+  test->add(BOOST_TEST_CASE(&read_stream_file_thread_pool_test));
+  test->add(BOOST_TEST_CASE(&read_stream_file_thread_pool_close_test));
+  test->add(BOOST_TEST_CASE(&read_stream_immediate_completion_test));
+  test->add(BOOST_TEST_CASE(&read_stream_http_read_body_test));
+  test->add(BOOST_TEST_CASE(&read_stream_http_read_body_after_read_test));
+  test->add(BOOST_TEST_CASE(&read_stream_asynchronous_http_read_body_test));
+  test->add(BOOST_TEST_CASE(&read_stream_http_read_to_file_test));
+  test->add(BOOST_TEST_CASE(&read_stream_http_read_to_file_short_test));
   return test;
 }
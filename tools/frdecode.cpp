@@ -0,0 +1,138 @@
+//
+// frdecode.cpp
+// ~~~~~~~~~~~~
+//
+// Copyright (c) 2009-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Prints the contents of a file written by urdl::flight_recorder::dump(). All
+// threads' events are merged into a single timeline. The final column shows
+// the time elapsed since the previous event for the same stream.
+
+#include <urdl/flight_recorder.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+struct decoded_event
+{
+  boost::uint32_t thread;
+  urdl::flight_recorder::event e;
+
+  bool operator<(const decoded_event& other) const
+  {
+    return e.timestamp < other.e.timestamp;
+  }
+};
+
+const char* category_name(int category)
+{
+  switch (category)
+  {
+  case urdl::flight_recorder::no_error:
+    return "";
+  case urdl::flight_recorder::system_error:
+    return "system:";
+  case urdl::flight_recorder::http_error:
+    return "http:";
+  case urdl::flight_recorder::asio_error:
+    return "asio:";
+  default:
+    return "other:";
+  }
+}
+
+template <typename T>
+void read_object(std::istream& is, T& t)
+{
+  if (!is.read(reinterpret_cast<char*>(&t), sizeof(T)))
+    throw std::runtime_error("Truncated flight recorder file");
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    if (argc != 2)
+    {
+      std::cerr << "Usage: frdecode <file>\n";
+      return 1;
+    }
+
+    std::ifstream is(argv[1], std::ios_base::in | std::ios_base::binary);
+    if (!is)
+      throw std::runtime_error("Unable to open file");
+
+    urdl::flight_recorder::file_header header;
+    read_object(is, header);
+    if (std::memcmp(header.magic, "URDLFR1", sizeof(header.magic)) != 0)
+      throw std::runtime_error("Not a flight recorder file");
+    if (header.event_size != sizeof(urdl::flight_recorder::event))
+      throw std::runtime_error("Unsupported event size");
+
+    std::vector<decoded_event> events;
+    for (boost::uint32_t t = 0; t < header.threads; ++t)
+    {
+      urdl::flight_recorder::thread_header th;
+      read_object(is, th);
+      for (boost::uint32_t i = 0; i < th.events; ++i)
+      {
+        decoded_event d;
+        d.thread = th.thread;
+        read_object(is, d.e);
+        events.push_back(d);
+      }
+    }
+
+    std::stable_sort(events.begin(), events.end());
+
+    // Timestamps are shown in microseconds relative to the dump, so that they
+    // can be matched against wall clock times in application logs.
+    double us_per_tick = 1000000.0 / header.ticks_per_second;
+    std::printf("# dumped at %.6f, %u threads, %u events\n",
+        header.dump_time / 1000000.0, static_cast<unsigned>(header.threads),
+        static_cast<unsigned>(events.size()));
+    std::printf("# %14s %6s %18s %-18s %12s %-16s %12s\n", "time_us",
+        "thread", "stream", "stage", "bytes", "error", "delta_us");
+
+    std::map<boost::uint64_t, boost::uint64_t> last_by_stream;
+    for (std::size_t i = 0; i < events.size(); ++i)
+    {
+      const urdl::flight_recorder::event& e = events[i].e;
+
+      double time_us = -static_cast<double>(header.dump_ticks - e.timestamp)
+        * us_per_tick;
+
+      double delta_us = 0;
+      std::map<boost::uint64_t, boost::uint64_t>::iterator last
+        = last_by_stream.find(e.stream);
+      if (last != last_by_stream.end())
+        delta_us = (e.timestamp - last->second) * us_per_tick;
+      last_by_stream[e.stream] = e.timestamp;
+
+      char error[32] = "";
+      if (e.category != urdl::flight_recorder::no_error)
+        std::sprintf(error, "%s%d", category_name(e.category),
+            static_cast<int>(e.error));
+
+      std::printf("  %14.3f %6u %#18llx %-18s %12llu %-16s %12.3f\n",
+          time_us, static_cast<unsigned>(events[i].thread),
+          static_cast<unsigned long long>(e.stream),
+          urdl::flight_recorder::stage_name(e.stage),
+          static_cast<unsigned long long>(e.bytes), error, delta_us);
+    }
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return 1;
+  }
+}